@@ -38,6 +38,7 @@
 #include "../../../../Common_3/Application/Interfaces/IFont.h"
 #include "../../../../Common_3/Application/Interfaces/IUI.h"
 #include "../../../../Common_3/Utilities/RingBuffer.h"
+#include "../../../../Common_3/Utilities/Threading/ThreadSystem.h"
 
 //Renderer
 #include "../../../../Common_3/Graphics/Interfaces/IGraphics.h"
@@ -52,60 +53,111 @@
 
 #include "Shaders/Shared.h"
 
+// CPU reference light culling
+#include "TiledCullCPU.h"
+#include "LightBVH.h"
+#include "LightAnimation.h"
+#include "DrawCullCPU.h"
+#include "GbufferPacking.h"
+#include "LightPacking.h"
+#include "LightLayout.h"
+#include "PipelineCacheFile.h"
+#include "ObjectInstances.h"
+#include "TileSizeTuner.h"
+
 #define DEFERRED_RT_COUNT 2
 
-const uint32_t gDataBufferCount = 2;
+// Every per frame resource exists MAX_FRAMES_IN_FLIGHT times, the first gFramesInFlight are cycled ("-framesInFlight <N>").
+// More frames in flight let the CPU absorb a GPU hitch before waitForFences() stalls it. The swapchain image count is
+// independent of it ("-swapchainImages <N>" or the UI).
+#define MAX_FRAMES_IN_FLIGHT 4
+uint32_t gFramesInFlight = 3;
+uint32_t gSwapchainImageCount = 3;
 Renderer* pRenderer = NULL;
 
 Queue*   pGraphicsQueue = NULL;
 GpuCmdRing gGraphicsCmdRing = {};
 
+// Async compute light culling: the Gbuffer pass of a slot signals pGbufferDoneSemaphores, the culling pass on the compute queue
+// waits for it and signals pCullDoneSemaphores, which the composition of the frame waits for. The composition is recorded in
+// Draw() but submitted in the next one, behind the next Gbuffer pass, so the culling of a frame overlaps the Gbuffer of the next.
+Queue*     pComputeQueue = NULL;
+GpuCmdRing gComputeCmdRing = {};
+Semaphore* pGbufferDoneSemaphores[MAX_FRAMES_IN_FLIGHT] = { NULL };
+Semaphore* pCullDoneSemaphores[MAX_FRAMES_IN_FLIGHT] = { NULL };
+static bool bAsyncCompute = false;
+
+// Composition recorded by the last async compute frame, submitted and presented by the next Draw()
+struct PendingComposite
+{
+	Cmd*       pCmd;
+	Fence*     pFence;
+	Semaphore* pRenderCompleteSemaphore;
+	uint32_t   mSlot;
+	uint32_t   mSwapchainImageIndex;
+	bool       mValid;
+};
+PendingComposite gPendingComposite = {};
+
 SwapChain*    pSwapChain = NULL;
-RenderTarget* pDepthBuffer = NULL;
+// Gbuffer, depth and scene targets are per buffer slot, the async compute culling of one frame reads them while the next frame fills its own
+RenderTarget* pDepthBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
 Semaphore*    pImageAcquiredSemaphore = NULL;
 
 Sampler* pSamplerBilinear = NULL;
 
 uint32_t gFrameIndex = 0;
 ProfileToken gGpuProfileToken = PROFILE_INVALID_TOKEN;
+ProfileToken gComputeProfileToken = PROFILE_INVALID_TOKEN;
+
+// Pipelines are created through a cache that persists across runs (PipelineCacheFile.h)
+const char*       gPipelineCacheFileName = "TiledDeferredRendering.cache";
+PipelineCache*    pPipelineCache = NULL;
+PipelineCacheFile gPipelineCacheFile = {};
+uint64_t          gShaderHash = PIPELINE_CACHE_HASH_SEED; // binaries of the last addShaders()
+
+ThreadSystem* pThreadSystem = NULL;
 
 ICameraController* pCameraController = NULL;
 UIComponent* pGuiWindow = NULL;
 uint32_t gFontID = 0;
 
-// holds index of pMaterialTextures
-struct Material {
-	uint albedoIndex = 1;
-	uint normalIndex = 1;
-	uint metallicIndex = 1;
-	uint roughnessIndex = 1;
-};
-
 struct ObjectInfo
 {
 	float3 mPosition;
 	float3 mRotation;
 	float mScale;
-	Material mMaterial;
+	uint32_t mMaterialId; // into gMaterials
 };
 
-struct Light
+// Per draw object and material of the Gbuffer / Forward+ draws (DrawData in drawData.h.fsl)
+struct DrawData
 {
-	vec4 mPosition; // float4(position.xyz, radius)
-	vec4 mColor; // float4(color.rgb, intensity)
+	uint mObjectIndex; // world matrix in the object buffer
+	uint mFlags;       // DRAW_FLAG_*
+	uint mMaterialId;  // into the material buffer
+	uint mPad;
 };
 
-// Have a buffer for object data
-struct LightData
+// Texture indices of a material (MaterialData in materialData.h.fsl), the material ID is its position in gMaterials
+struct MaterialData
 {
-	Light lights[MAX_LIGHTS] = {};
+	uint mAlbedoMap;
+	uint mNormalMap;
+	uint mMetallicMap;
+	uint mRoughnessMap;
+	uint mAoMap;
+	uint mPad[3];
 };
 
-// Have a push constant for object data
-struct ConstantObjData 
+// Have a uniform for the Gbuffer draw culling
+struct UniformDrawCullData
 {
-	mat4 mWorldMat;
-	uint mMaterialId;
+	vec4 mFrustumPlanes[6]; // world space, inside when dot(plane.xyz, p) + plane.w >= 0
+	uint mDrawCount;
+	uint mSkipAlphaBlended;
+	uint mFrustumCull;
+	uint mPad;
 };
 
 // Have a uniform for camera data
@@ -134,47 +186,116 @@ struct UniformTileCullData
 	uint mNumOfLights; // Active lights
 	uint mDebugDraw;
 	uint2 mResolution;
+	float mClusterSliceScale;
+	float mClusterSliceBias;
+	uint mWriteLightGrid; // Forward+ light grid on/off => (1/0)
+	uint mUseLightBVH;    // light binning traverses the light BVH => (1/0)
+	uint mLightBVHRootCount;
+	uint mTileResX; // pixels per tile of gTileSize
+	uint mTileResY;
+	uint mLightBinCapacity; // elements of pLightBinIndicesBuffer
+	uint mLightGridCapacity; // elements of pLightIndexBuffer
+	uint mClusterLightCapacity; // elements of pClusterLightIndicesBuffer
 };
 
 // Gbuffer
 Shader* pGbufferShader = NULL;
 Pipeline* pGbufferPipeline = NULL;
 RootSignature* pGbufferRootSignature = NULL;
-RenderTarget* pGbufferRenderTargets[DEFERRED_RT_COUNT]; //
+RenderTarget* pGbufferRenderTargets[MAX_FRAMES_IN_FLIGHT][DEFERRED_RT_COUNT]; // albedo + metallic / octahedral normal, roughness, ao (per slot)
+// thin: R10G10B10A2_UNORM second target (8 instead of 12 bytes per pixel), see GbufferPacking.h
+static bool bThinGbuffer = true;
 
 // Descriptor for Gbuffer fill
-DescriptorSet* pDescriptorSetGbuffers[2]; // 0 = texture (none), 1 = camera, object (per frame) 
-uint32_t gModelIdRootConstantIndex = 0;
+DescriptorSet* pDescriptorSetGbuffers[2]; // 0 = texture (none), 1 = camera, draw data, objects (per frame) 
+
+// GPU driven Gbuffer: the Sponza draws are frustum culled and compacted by GbufferDrawCull.comp and issued with one cmdExecuteIndirect.
+// Draw i < mDrawArgCount is Sponza submesh i, the single meshes follow; the draw index reaches the shaders as the start instance.
+Shader* pGbufferDrawCullShader = NULL;
+Pipeline* pGbufferDrawCullPipeline = NULL;
+RootSignature* pGbufferDrawCullRootSignature = NULL;
+DescriptorSet* pDescriptorSetGbufferDrawCull = NULL; // per frame
+CommandSignature* pGbufferCommandSignature = NULL;
+Buffer* pDrawDataBuffer = NULL;           // DrawData per draw
+Buffer* pMaterialBuffer = NULL;           // MaterialData per material ID
+Buffer* pDrawBoundsBuffer = NULL;         // local center, extents per draw
+Buffer* pDrawArgsBuffer = NULL;           // IndirectDrawIndexArguments per draw
+Buffer* pDrawIdBuffer = NULL;             // instance rate vertex buffer, drawId[i] = i
+Buffer* pVisibleDrawArgsBuffer = NULL;    // compacted arguments of the visible Sponza draws
+Buffer* pVisibleDrawCountBuffer = NULL;
+Buffer* pVisibleDrawCountResetBuffer = NULL;
+Buffer* pObjectBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };        // world matrix per model
+Buffer* pDrawCullUniformBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
+vec4* gDrawBounds = NULL;                 // CPU copy of pDrawBoundsBuffer
+uint32_t gDrawCount = 0;
 
 // render screenQuad
 Shader* pRenderQuadShader = NULL;
 Pipeline* pRenderQuadPipeline = NULL;
 RootSignature* pRenderQuadRootSignature = NULL;
 RenderTarget* pRenderQuadRenderTargets = NULL;
-DescriptorSet* pDescritporSetRenderQuad = NULL; // 0 = scene textures (none)
+DescriptorSet* pDescritporSetRenderQuad = NULL; // 0 = scene texture (one per slot)
 
 Shader* pDeferredShader = NULL;
 Pipeline* pDeferredPipeline = NULL;
 RootSignature* pDeferredRootSignature = NULL;
-DescriptorSet* pDescriptorSetDeferredLightPass[2] = { NULL };
+DescriptorSet* pDescriptorSetDeferredLightPass[2] = { NULL }; // 0 = Gbuffer, depth (one per slot) / 1 = camera, lights
 uint32_t gLightCountRootConstantIndex = 0;
 
-// Tiled Culling Base
-RenderTarget* pSceneBuffer = NULL;
-Shader* pTiledCullShader = NULL;
-Pipeline* pTiledCullPipeline = NULL;
+// Tiled Culling Base, Half-Z and Modified-Z: one permutation per tile size (TILE_SIZE_*) and light list encoding (LIGHT_LIST_*)
+RenderTarget* pSceneBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
+Shader* pTiledCullShader[TILE_SIZE_COUNT][LIGHT_LIST_ENCODING_COUNT] = {};
+Pipeline* pTiledCullPipeline[TILE_SIZE_COUNT][LIGHT_LIST_ENCODING_COUNT] = {};
 // Tiled Culling HalfZ
-Shader* pTiledCullHalfZShader = NULL;
-Pipeline* pTiledCullHalfZPipeline = NULL;
+Shader* pTiledCullHalfZShader[TILE_SIZE_COUNT][LIGHT_LIST_ENCODING_COUNT] = {};
+Pipeline* pTiledCullHalfZPipeline[TILE_SIZE_COUNT][LIGHT_LIST_ENCODING_COUNT] = {};
 
 RootSignature* pTiledCullRootSignature = NULL;
-DescriptorSet* pDescriptorSetCullPass[2] = { NULL }; // 0 = material_rts, depth, scene / 1 = ext_camera, light buffer
+DescriptorSet* pDescriptorSetCullPass[2] = { NULL }; // 0 = material_rts, depth, scene, light grid (one per slot) / 1 = ext_camera, light buffer
 
 // Tiled Culling ModifiedZ
-Shader* pTiledCullModifiedZShader = NULL;
-Pipeline* pTiledCullModifiedZPipeline = NULL;
-
-Buffer* pTileCullDataBuffer[gDataBufferCount] = { NULL };
+Shader* pTiledCullModifiedZShader[TILE_SIZE_COUNT][LIGHT_LIST_ENCODING_COUNT] = {};
+Pipeline* pTiledCullModifiedZPipeline[TILE_SIZE_COUNT][LIGHT_LIST_ENCODING_COUNT] = {};
+
+// Clustered: exponential depth slices between gClusterZNear and gClusterZFar, one permutation per tile size
+Shader* pTiledCullClusteredShader[TILE_SIZE_COUNT] = { NULL };
+Pipeline* pTiledCullClusteredPipeline[TILE_SIZE_COUNT] = { NULL };
+Buffer* pClusterLightGridBuffer = NULL;    // uint2(offset, count) per cluster
+Buffer* pClusterLightIndicesBuffer = NULL; // gClusterLightCapacity indices, each tile gets the range it counted
+
+// Tile light lists, clusters and Forward+ grids without room spill into linked overflow nodes (lightSpill.h.fsl). The LIGHT_OVERFLOW_*
+// counters of every culling pass are copied to the readback buffer of the slot and read once its fence has been waited on.
+// per slot like the light grid, the Forward+ pass walks the grid spill lists of its slot
+Buffer* pLightOverflowBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL }; // uint2(light index, next node), LIGHT_OVERFLOW_CAPACITY nodes
+Buffer* pLightOverflowCounterBuffer = NULL; // LIGHT_OVERFLOW_COUNTER_COUNT uints, cleared before every culling pass
+Buffer* pLightOverflowCounterResetBuffer = NULL;
+Buffer* pLightOverflowReadbackBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
+bool gLightOverflowReadback[MAX_FRAMES_IN_FLIGHT] = {}; // the culling pass of the slot copied its counters
+
+struct LightOverflowStats
+{
+	uint32_t mOverflowTiles; // tile light lists past their capacity
+	uint32_t mSpilledLights; // lights shaded from the overflow buffer
+	uint32_t mDroppedLights; // lights lost: overflow buffer or light bins full, clusters cut from the cluster indices
+	uint32_t mMaxTileLights; // most lights culled into one tile list
+};
+LightOverflowStats gLightOverflowStats = {}; // latest frame read back
+LightOverflowStats gLightOverflowPeak = {};  // maximum of every field over the run, logged on Exit
+uint32_t gLightOverflowFrames = 0;           // frames read back with an overflowed tile list
+char gLightOverflowText[320] = {};
+const float gClusterZNear = 1.0f;
+const float gClusterZFar = 100.0f;
+
+// Forward+ (alpha blended geometry shaded from the per-tile light grid)
+Shader* pForwardPlusShader = NULL;
+Pipeline* pForwardPlusPipeline = NULL;
+RootSignature* pForwardPlusRootSignature = NULL;
+DescriptorSet* pDescriptorSetForwardPlus[2] = { NULL }; // 0 = texture (none), 1 = camera, lights, light grid (per frame)
+// per slot, the Forward+ pass of a frame may read them while the culling of the next frame writes its own
+Buffer* pLightGridBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };  // uint4(offset, count, spill head, 0) per tile
+Buffer* pLightIndexBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL }; // gLightGridCapacity indices, each tile gets the range it counted
+
+Buffer* pTileCullDataBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
 UniformTileCullData gUniformTileCullData = {};
 
 // Object Data
@@ -182,31 +303,396 @@ Geometry* gModels[MODEL_COUNT] = { NULL };
 ObjectInfo gObjectInfo[MODEL_COUNT] = {};
 
 VertexLayout gVertexLayoutModel = {};
+VertexLayout gVertexLayoutModelDrawId = {}; // + instance rate draw index at binding 1
 
 // Quad
 Buffer* pScreenQuadVertexBuffer = NULL;
 
 // Camera Data
-Buffer* pCameraBuffer[gDataBufferCount] = { NULL };
+Buffer* pCameraBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
 UniformCamData gUniformCamData = {};
 
 // Extended Camera Data
-Buffer* pExtCameraBuffer[gDataBufferCount] = { NULL };
+Buffer* pExtCameraBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
 UniformExtCamData gUniformExtCamData = {};
 
-// Light Data (Cache-friendly)
-Buffer* pLightPosAndRadiusBuffer[gDataBufferCount] = { NULL };
-Buffer* pLightColorAndIntensityBuffer[gDataBufferCount] = { NULL };
+// Light Data, grown by reserveLights(). What each buffer holds depends on LIGHT_LAYOUT (LightLayout.h),
+// the color buffer is not allocated for the interleaved layout
+Buffer* pLightPosAndRadiusBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
+Buffer* pLightColorAndIntensityBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
 float4 gLightPos;
-vec4 gLightPositionAndRadius[MAX_LIGHTS];
-vec4 gLightColorAndIntensity[MAX_LIGHTS];
+vec4* gLightPositionAndRadius = NULL;
+vec4* gLightColorAndIntensity = NULL;
+// bytes per light in each GPU light buffer, LIGHT_FORMAT_FP16 packs the vec4 into four halves (LightPacking.h)
+const uint32_t gLightElementSize = LIGHT_FORMAT_FP16 ? sizeof(uint32_t) * 2 : sizeof(float) * 4;
+
+// Rest pose, velocities and noise phases of the lights (SoA), animated straight into the mapped position buffer
+LightAnimation gLightAnimation = {};
+// Sponza submeshes culled on the CPU when the Gbuffer draws are recorded on the CPU
+DrawCullCpu gDrawCullCpu = {};
+static uint32_t gLightMotion = LIGHT_MOTION_ORBIT;
+static float gLightAnimationTime = 0.0f;
+static bool bLightsAnimated = false; // the mapped buffer of a slot holds positions gLightPositionAndRadius does not have
+
+uint32_t gLightCapacity = 0;       // size of the light arrays
+uint32_t gLightBufferCapacity = 0; // size of the light buffers, reallocated in Draw when it falls behind gLightCapacity
+const uint32_t gMaxLightCount = 1024 * 1024;
+
+// Light BVH rebuilt on the thread system whenever the light positions change, two float4 per node on the GPU
+Buffer* pLightBVHNodeBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
+Buffer* pLightBVHRootBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
+LightBVH gLightBVH = {};
+
+// Coarse light bins, built before the tile culling so a tile only tests the lights of its bin
+Shader* pLightBinningShader = NULL;
+Pipeline* pLightBinningPipeline = NULL;
+Buffer* pLightBinBuffer = NULL;        // uint2(offset, count) per bin
+Buffer* pLightBinIndicesBuffer = NULL; // gLightBinCapacity indices, each bin gets the range it counted
+// The light bin, Forward+ and cluster indices are doubled up to the LIGHT_OVERFLOW_*_LIGHTS read back, the light grid buffers
+// are recreated in Draw when one of them falls behind
+#define LIGHT_INDEX_MAX_CAPACITY (1u << 26)
+uint32_t gLightBinCapacity = LIGHT_BIN_INITIAL_CAPACITY;
+uint32_t gLightBinRequiredCapacity = 0; // most light bin indices a culling pass asked for
+uint32_t gLightGridCapacity = LIGHT_GRID_INITIAL_CAPACITY;
+uint32_t gLightGridRequiredCapacity = 0;
+uint32_t gClusterLightCapacity = CLUSTER_LIGHT_INITIAL_CAPACITY;
+uint32_t gClusterLightRequiredCapacity = 0;
+
+bool isLightIndexCapacityShort(uint32_t capacity, uint32_t requiredCapacity)
+{
+	return capacity < requiredCapacity && capacity < LIGHT_INDEX_MAX_CAPACITY;
+}
+
+// doubling, until the most indices a culling pass asked for fit
+uint32_t growLightIndexCapacity(uint32_t capacity, uint32_t requiredCapacity)
+{
+	while (isLightIndexCapacityShort(capacity, requiredCapacity))
+		capacity *= 2;
+	return capacity;
+}
+
+// Hi-Z pyramid of view space depth (min, max) built once after the Gbuffer pass, level 0 at tile granularity.
+// The tile culling kernels read their depth bounds from level 0, the light binning from the level of a bin.
+// Level 0 is written by the DepthPyramid permutation of the tile size.
+Shader* pDepthPyramidShader[TILE_SIZE_COUNT] = { NULL };
+Pipeline* pDepthPyramidPipeline[TILE_SIZE_COUNT] = { NULL };
+Shader* pDepthPyramidDownsampleShader = NULL;
+Pipeline* pDepthPyramidDownsamplePipeline = NULL;
+Buffer* pDepthPyramidBuffer = NULL;
+uint32_t gDepthPyramidLevelCount = 0;
+uint32_t gDepthPyramidRootConstantIndex = 0;
+
+template <typename T>
+void growLightArray(T** ppArray, uint32_t count, uint32_t capacity)
+{
+	T* pArray = (T*)tf_memalign(alignof(T), capacity * sizeof(T));
+	if (*ppArray)
+	{
+		memcpy(pArray, *ppArray, count * sizeof(T));
+		tf_free(*ppArray);
+	}
+	memset((void*)(pArray + count), 0, (capacity - count) * sizeof(T));
+	*ppArray = pArray;
+}
+
+/**
+ * @brief Grows the light arrays (doubling) so that lightCount lights fit. The GPU buffers follow in the next Draw.
+ */
+void reserveLights(uint32_t lightCount)
+{
+	if (lightCount <= gLightCapacity)
+		return;
+
+	uint32_t capacity = max(gLightCapacity, (uint32_t)INITIAL_LIGHT_CAPACITY);
+	while (capacity < lightCount)
+		capacity *= 2;
+
+	growLightArray(&gLightPositionAndRadius, gLightCapacity, capacity);
+	growLightArray(&gLightColorAndIntensity, gLightCapacity, capacity);
+	reserveLightAnimation(&gLightAnimation, capacity);
+	gLightCapacity = capacity;
+}
+
+// Dirty range tracking of an array mirrored in per-slot GPU buffers (lights, object instances). Every change bumps mVersion
+// and is recorded in a small ring; each slot remembers the version it holds and uploads only the (coalesced) ranges changed since.
+#define DIRTY_RANGE_HISTORY 32
+#define DIRTY_RANGE_MERGE_GAP 64 // elements between two ranges that are still copied as one
+
+struct DirtyRange
+{
+	uint32_t mBegin;
+	uint32_t mEnd;
+	uint64_t mVersion;
+};
+
+struct DirtyRangeTracker
+{
+	uint64_t        mVersion;
+	DirtyRange mRanges[DIRTY_RANGE_HISTORY]; // ring, indexed by version
+	uint64_t        mSlotVersion[MAX_FRAMES_IN_FLIGHT];     // 0: slot holds nothing valid, upload everything
+};
+
+DirtyRangeTracker gLightPositionTracker = {};
+DirtyRangeTracker gLightColorTracker = {};
+uint64_t gLightBVHVersion = 0;                             // position version the BVH was built from
+uint64_t gLightBVHSlotVersion[MAX_FRAMES_IN_FLIGHT] = { 0 };
+uint32_t gLightUploadBytes = 0;                            // light + BVH bytes uploaded by the current frame
+
+void markDirtyRange(DirtyRangeTracker* pTracker, uint32_t begin, uint32_t end)
+{
+	if (begin >= end)
+		return;
+
+	DirtyRange& range = pTracker->mRanges[++pTracker->mVersion % DIRTY_RANGE_HISTORY];
+	range.mBegin = begin;
+	range.mEnd = end;
+	range.mVersion = pTracker->mVersion;
+}
+
+// The next upload of every slot copies the whole array, e.g. after the buffers were recreated
+void invalidateDirtyRangeSlots(DirtyRangeTracker* pTracker)
+{
+	memset(pTracker->mSlotVersion, 0, sizeof(pTracker->mSlotVersion));
+}
+
+// Writes count lights into the mapped light buffer, stride elements apart, packed to halves with LIGHT_FORMAT_FP16
+void writeLights(void* pMappedData, const vec4* pLights, uint32_t count, uint32_t stride, bool positions)
+{
+#if LIGHT_FORMAT_FP16
+	packLights(pThreadSystem, pLights, count, (uint32_t*)pMappedData, stride, positions);
+#else
+	if (stride == 1)
+	{
+		memcpy(pMappedData, pLights, count * sizeof(vec4));
+		return;
+	}
+	vec4* pDst = (vec4*)pMappedData;
+	for (uint32_t i = 0; i < count; ++i)
+		pDst[i * stride] = pLights[i];
+#endif
+}
+
+Buffer* getLightBuffer(uint32_t buffer, uint32_t slot)
+{
+	return buffer ? pLightColorAndIntensityBuffer[slot] : pLightPosAndRadiusBuffer[slot];
+}
+
+// Descriptor of lightColorAndIntensity, the interleaved layout binds the position buffer under both names
+Buffer** getLightColorBinding(uint32_t slot)
+{
+	return gLightBufferElementsPerLight[1] ? &pLightColorAndIntensityBuffer[slot] : &pLightPosAndRadiusBuffer[slot];
+}
+
+/**
+ * @brief Writes lights [begin, end) of pLights through every view of the layout into the slot's buffers.
+ * @return uploaded bytes
+ */
+uint32_t writeLightViews(const LightBufferView* pViews, uint32_t viewCount, uint32_t slot, const vec4* pLights, uint32_t begin, uint32_t end,
+	bool positions)
+{
+	uint32_t uploadBytes = 0;
+	for (uint32_t v = 0; v < viewCount; ++v)
+	{
+		const LightBufferView& view = pViews[v];
+		BufferUpdateDesc updateDesc = { getLightBuffer(view.mBuffer, slot) };
+		updateDesc.mDstOffset = (view.mFirst + begin * view.mStride) * gLightElementSize;
+		updateDesc.mSize = ((end - begin - 1) * view.mStride + 1) * gLightElementSize;
+		beginUpdateResource(&updateDesc);
+		writeLights(updateDesc.pMappedData, pLights + begin, end - begin, view.mStride, positions);
+		endUpdateResource(&updateDesc, NULL);
+		uploadBytes += (end - begin) * gLightElementSize;
+	}
+	return uploadBytes;
+}
 
-// Initial Light position before rotation
-float3 gInitLightPos[MAX_LIGHTS] = {};
+/**
+ * @brief Collects the ranges of [0, count) changed since the last upload of the slot, sorted and coalesced, and marks the slot up to date.
+ * @param pRanges DIRTY_RANGE_HISTORY ranges
+ * @return range count
+ */
+uint32_t getDirtyRanges(DirtyRangeTracker* pTracker, uint32_t slot, uint32_t count, DirtyRange* pRanges)
+{
+	const uint64_t slotVersion = pTracker->mSlotVersion[slot];
+	if (slotVersion == pTracker->mVersion && slotVersion != 0)
+		return 0;
+
+	DirtyRange* ranges = pRanges;
+	uint32_t rangeCount = 0;
+	if (slotVersion == 0 || pTracker->mVersion - slotVersion > DIRTY_RANGE_HISTORY)
+	{
+		// the changes this slot missed are no longer in the ring
+		ranges[rangeCount++] = { 0, count, pTracker->mVersion };
+	}
+	else
+	{
+		for (uint64_t version = slotVersion + 1; version <= pTracker->mVersion; ++version)
+		{
+			DirtyRange range = pTracker->mRanges[version % DIRTY_RANGE_HISTORY];
+			range.mEnd = min(range.mEnd, count);
+			if (range.mBegin >= range.mEnd)
+				continue;
+
+			// insertion sort by begin, there are at most DIRTY_RANGE_HISTORY ranges
+			uint32_t i = rangeCount++;
+			for (; i > 0 && ranges[i - 1].mBegin > range.mBegin; --i)
+				ranges[i] = ranges[i - 1];
+			ranges[i] = range;
+		}
+	}
+
+	// coalesce overlapping and nearby ranges
+	uint32_t mergedCount = 0;
+	for (uint32_t i = 0; i < rangeCount; ++i)
+	{
+		if (mergedCount && ranges[i].mBegin <= ranges[mergedCount - 1].mEnd + DIRTY_RANGE_MERGE_GAP)
+			ranges[mergedCount - 1].mEnd = max(ranges[mergedCount - 1].mEnd, ranges[i].mEnd);
+		else
+			ranges[mergedCount++] = ranges[i];
+	}
+
+	pTracker->mSlotVersion[slot] = pTracker->mVersion;
+	return mergedCount;
+}
+
+/**
+ * @brief Copies the ranges of pLights changed since the last upload through the views of the layout into the slot's buffers.
+ * @param positions pLights holds (position, radius), whose packed radius has to cover the rounded position
+ * @return uploaded bytes
+ */
+uint32_t uploadDirtyLights(DirtyRangeTracker* pTracker, uint32_t slot, const LightBufferView* pViews, uint32_t viewCount, const vec4* pLights,
+	uint32_t numLights, bool positions)
+{
+	DirtyRange ranges[DIRTY_RANGE_HISTORY];
+	const uint32_t rangeCount = getDirtyRanges(pTracker, slot, numLights, ranges);
+
+	uint32_t uploadBytes = 0;
+	for (uint32_t i = 0; i < rangeCount; ++i)
+		uploadBytes += writeLightViews(pViews, viewCount, slot, pLights, ranges[i].mBegin, ranges[i].mEnd, positions);
+	return uploadBytes;
+}
+
+// Instanced lions, all drawn by one cmdDrawIndexedInstanced. Instance k is draw gDrawCount + k: its DrawData points at world matrix
+// MODEL_COUNT + k of the object buffer and at its material, and the instance rate draw index walks them. Only the matrices of
+// instances that moved are rebuilt, and every slot copies the ranges it has not seen yet (same dirty range tracker as the lights).
+#define OBJECT_INSTANCE_CAPACITY 65536
+#define OBJECT_INSTANCE_GRID 256 // instances per row
+ObjectInstances gObjectInstances = {};
+DirtyRangeTracker gObjectInstanceTracker = {};
+uint32_t gObjectInstanceCount = 0;       // "-objectInstances <N>"
+uint32_t gMovingObjectInstanceCount = 0; // the first ones turn in place every frame
+uint32_t gLastObjectInstanceCount = 0;
+float gObjectInstanceTime = 0.0f;
 
 // Texture for Materials
-Texture* pMaterialTextures[TOTAL_IMGS];
-int gSponzaTextureIndexForMaterial[26][5] = {};
+// The material textures stream in after the first frame: pMaterialTextures is what textureMaps binds, a placeholder until
+// pStreamedMaterialTextures[i] has finished loading. Swaps bump gMaterialTextureVersion, each frame slot rewrites its
+// textureMaps sets once (one update for every swap since) after waiting for its fence.
+enum MaterialPlaceholder
+{
+	MATERIAL_PLACEHOLDER_ALBEDO, // mid gray
+	MATERIAL_PLACEHOLDER_NORMAL, // flat tangent space normal
+	MATERIAL_PLACEHOLDER_WHITE,  // ao, roughness
+	MATERIAL_PLACEHOLDER_BLACK,  // metallic
+	MATERIAL_PLACEHOLDER_COUNT
+};
+Texture*  pMaterialTextures[MAX_MATERIAL_TEXTURES]; // slots past TOTAL_IMGS stay on the white placeholder
+Texture*  pStreamedMaterialTextures[TOTAL_IMGS] = { NULL };
+SyncToken gMaterialTextureTokens[TOTAL_IMGS] = {};
+bool      gMaterialTextureStreamed[TOTAL_IMGS] = {};
+Texture*  pMaterialPlaceholders[MATERIAL_PLACEHOLDER_COUNT] = { NULL };
+uint32_t  gMaterialTexturesPending = 0;
+uint64_t  gMaterialTextureVersion = 1;
+uint64_t  gMaterialTextureSlotVersion[MAX_FRAMES_IN_FLIGHT] = { 0 };
+HiresTimer gMaterialTextureTimer;
+
+MaterialPlaceholder getMaterialPlaceholder(const char* pFileName)
+{
+	if (strstr(pFileName, "Albedo") || strstr(pFileName, "diffuse"))
+		return MATERIAL_PLACEHOLDER_ALBEDO;
+	if (strstr(pFileName, "Normal") || strstr(pFileName, "normal"))
+		return MATERIAL_PLACEHOLDER_NORMAL;
+	if (strstr(pFileName, "Metallic") || strstr(pFileName, "metallic"))
+		return MATERIAL_PLACEHOLDER_BLACK;
+	return MATERIAL_PLACEHOLDER_WHITE;
+}
+
+// 1x1 textures the material slots point at until their file is loaded
+void addMaterialPlaceholders()
+{
+	const uint32_t texels[MATERIAL_PLACEHOLDER_COUNT] = { 0xff808080u, 0xffff8080u, 0xffffffffu, 0xff000000u }; // ABGR
+	SyncToken token = {};
+	for (uint32_t i = 0; i < MATERIAL_PLACEHOLDER_COUNT; ++i)
+	{
+		TextureDesc textureDesc = {};
+		textureDesc.mWidth = 1;
+		textureDesc.mHeight = 1;
+		textureDesc.mDepth = 1;
+		textureDesc.mArraySize = 1;
+		textureDesc.mMipLevels = 1;
+		textureDesc.mSampleCount = SAMPLE_COUNT_1;
+		textureDesc.mFormat = i == MATERIAL_PLACEHOLDER_ALBEDO ? TinyImageFormat_R8G8B8A8_SRGB : TinyImageFormat_R8G8B8A8_UNORM;
+		textureDesc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+		textureDesc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+		textureDesc.pName = "Material Placeholder";
+		TextureLoadDesc loadDesc = {};
+		loadDesc.pDesc = &textureDesc;
+		loadDesc.ppTexture = &pMaterialPlaceholders[i];
+		addResource(&loadDesc, NULL);
+
+		TextureUpdateDesc updateDesc = { pMaterialPlaceholders[i] };
+		beginUpdateResource(&updateDesc);
+		memcpy(updateDesc.pMappedData, &texels[i], sizeof(uint32_t));
+		endUpdateResource(&updateDesc, &token);
+	}
+	waitForToken(&token);
+}
+
+/**
+ * @brief Swaps every material texture that finished loading since the last call into pMaterialTextures.
+ * @return true if any slot changed.
+ */
+bool swapInStreamedMaterialTextures()
+{
+	if (!gMaterialTexturesPending)
+		return false;
+
+	bool swapped = false;
+	for (uint32_t i = 0; i < TOTAL_IMGS; ++i)
+	{
+		if (gMaterialTextureStreamed[i] || !isTokenCompleted(&gMaterialTextureTokens[i]))
+			continue;
+		gMaterialTextureStreamed[i] = true;
+		--gMaterialTexturesPending;
+		// a texture that failed to load keeps its placeholder
+		if (pStreamedMaterialTextures[i])
+		{
+			pMaterialTextures[i] = pStreamedMaterialTextures[i];
+			swapped = true;
+		}
+	}
+
+	if (swapped)
+		++gMaterialTextureVersion;
+	if (!gMaterialTexturesPending)
+		LOGF(eINFO, "Startup: material textures streamed in %.2f ms", (float)getHiresTimerUSec(&gMaterialTextureTimer, false) / 1000.0f);
+	return swapped;
+}
+
+// Material table, grows on demand and is uploaded with the draw data
+MaterialData* gMaterials = NULL;
+uint32_t      gMaterialCount = 0;
+uint32_t      gMaterialCapacity = 0;
+
+uint32_t addMaterial(uint32_t albedoMap, uint32_t normalMap, uint32_t metallicMap, uint32_t roughnessMap, uint32_t aoMap)
+{
+	if (gMaterialCount == gMaterialCapacity)
+	{
+		gMaterialCapacity = max(64u, gMaterialCapacity * 2);
+		gMaterials = (MaterialData*)tf_realloc(gMaterials, gMaterialCapacity * sizeof(MaterialData));
+	}
+	gMaterials[gMaterialCount] = { albedoMap, normalMap, metallicMap, roughnessMap, aoMap };
+	return gMaterialCount++;
+}
 
 // Material ID only for Sponza
 uint32_t    gMaterialIds[] = {
@@ -215,6 +701,263 @@ uint32_t    gMaterialIds[] = {
 	19, 18, 17, 20, 21, 20, 21, 20, 21, 20, 21, 3, 1,  3, 1,  3, 1, 3,  1, 3,  1,  3,  1,  3,  1,  22, 23, 4,  23, 4,  5,  24, 5,
 };
 
+// Sponza materials with alpha (leaf, Material__57 (Plant), chain), drawn by the Forward+ pass instead of the Gbuffer
+bool isAlphaBlendedMaterial(int materialID)
+{
+	return materialID == 0 || materialID == 3 || materialID == 20;
+}
+
+// Gbuffer draws, gathered on the main thread and recorded in contiguous ranges by the thread system.
+// Every recording task owns a command pool per frame, its command is submitted between the two ring commands
+// of the frame in task order, so the GPU sees the draws in the same order as the single threaded path.
+#define GBUFFER_MAX_RECORD_TASKS 8
+#define GBUFFER_MIN_DRAWS_PER_TASK 64
+
+struct GbufferDraw
+{
+	uint32_t mDrawId;
+	uint32_t mModel;
+	uint32_t mMaterialId;
+	uint32_t mIndexCount;
+	uint32_t mStartIndex;
+	uint32_t mVertexOffset;
+	uint32_t mInstanceCount; // instances read consecutive draw indices
+};
+
+// Render queue ("Draw Batching"): the Sponza submeshes are sorted once by their key (pipeline, material, mesh, submesh) and their
+// indices are copied in that order, vertex offset applied, into pBatchedIndexBuffer. The draw arguments of the queue are built with it
+// and only copied per frame, and consecutive visible submeshes of a material are contiguous there, so they merge into one draw.
+// The merged draw reads the DrawData of its first submesh, which only differs from the others in the draw index.
+#define SPONZA_BATCHED_MODEL MODEL_COUNT // Sponza vertices with pBatchedIndexBuffer
+
+enum DrawQueuePipeline
+{
+	DRAW_QUEUE_GBUFFER = 0,
+	DRAW_QUEUE_FORWARD_PLUS, // alpha blended, last in the queue
+};
+
+// pipeline 4 bits | material 24 bits | mesh 8 bits | submesh 28 bits, the submesh keeps the file order within a material
+static inline uint64_t makeDrawSortKey(uint32_t pipeline, uint32_t materialId, uint32_t model, uint32_t submesh)
+{
+	return ((uint64_t)pipeline << 60) | ((uint64_t)(materialId & 0xffffffu) << 36) | ((uint64_t)(model & 0xffu) << 28) | (submesh & 0xfffffffu);
+}
+
+static inline uint32_t getDrawSortKeySubmesh(uint64_t key) { return (uint32_t)(key & 0xfffffffu); }
+
+static int compareDrawSortKeys(const void* pLhs, const void* pRhs)
+{
+	const uint64_t lhs = *(const uint64_t*)pLhs;
+	const uint64_t rhs = *(const uint64_t*)pRhs;
+	return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+struct GbufferRecordTask
+{
+	const GbufferDraw* pDraws;
+	uint32_t mDrawCount;
+	uint32_t mTaskCount;
+};
+
+CmdPool* pGbufferCmdPools[MAX_FRAMES_IN_FLIGHT][GBUFFER_MAX_RECORD_TASKS] = { { NULL } };
+Cmd* pGbufferCmds[MAX_FRAMES_IN_FLIGHT][GBUFFER_MAX_RECORD_TASKS] = { { NULL } };
+GbufferDraw* gGbufferDraws = NULL;
+uint32_t gGbufferDrawCapacity = 0;
+uint32_t gGbufferStateChanges = 0; // vertex / index buffer binds and material switches of the gathered draws
+GbufferDraw* gDrawQueue = NULL;    // Sponza submeshes in sort key order
+uint32_t gDrawQueueCount = 0;
+uint32_t gDrawQueueOpaqueCount = 0;
+Buffer* pBatchedIndexBuffer = NULL;
+static bool bDrawBatching = true;
+GbufferRecordTask gGbufferRecordTask = {};
+static bool bMultithreadedGbuffer = true;
+static bool bGpuDrivenGbuffer = true;
+static bool bGbufferFrustumCull = true;
+static bool bCpuDrawCull = true;
+static bool bCpuOcclusionCull = false;
+
+// Gathers the CPU recorded draws, the Sponza submeshes only when they are not issued indirectly.
+// pDrawCullResults (DrawCullCpuResult per Sponza draw) drops the culled submeshes, NULL keeps all of them.
+// With batching, the Sponza submeshes come from the render queue and contiguous ones of a material are merged.
+uint32_t gatherGbufferDraws(bool includeSponza, bool skipAlphaBlended, bool batch, const uint8_t* pDrawCullResults)
+{
+	// + the instanced draw
+	if (gGbufferDrawCapacity < gDrawCount + 1)
+	{
+		tf_free(gGbufferDraws);
+		gGbufferDrawCapacity = gDrawCount + 1;
+		gGbufferDraws = (GbufferDraw*)tf_malloc(gGbufferDrawCapacity * sizeof(GbufferDraw));
+	}
+
+	uint32_t drawCount = 0;
+	if (includeSponza && batch)
+	{
+		const uint32_t queueCount = skipAlphaBlended ? gDrawQueueOpaqueCount : gDrawQueueCount;
+		for (uint32_t q = 0; q < queueCount; ++q)
+		{
+			const GbufferDraw& draw = gDrawQueue[q];
+			if (pDrawCullResults && pDrawCullResults[draw.mDrawId] != DRAW_CULL_CPU_VISIBLE)
+				continue;
+
+			GbufferDraw* pLast = drawCount ? &gGbufferDraws[drawCount - 1] : NULL;
+			if (pLast && pLast->mMaterialId == draw.mMaterialId && pLast->mStartIndex + pLast->mIndexCount == draw.mStartIndex)
+				pLast->mIndexCount += draw.mIndexCount;
+			else
+				gGbufferDraws[drawCount++] = draw;
+		}
+	}
+
+	for (uint32_t i = 0; includeSponza && !batch && i < gModels[SPONZA_MODEL]->mDrawArgCount; ++i)
+	{
+		if (skipAlphaBlended && isAlphaBlendedMaterial(gMaterialIds[i]))
+			continue;
+		if (pDrawCullResults && pDrawCullResults[i] != DRAW_CULL_CPU_VISIBLE)
+			continue;
+
+		const IndirectDrawIndexArguments& args = gModels[SPONZA_MODEL]->pDrawArgs[i];
+		gGbufferDraws[drawCount++] = { i, SPONZA_MODEL, (uint32_t)gMaterialIds[i], args.mIndexCount, args.mStartIndex, args.mVertexOffset, 1 };
+	}
+
+	for (uint32_t i = 1; i < MODEL_COUNT; ++i)
+		gGbufferDraws[drawCount++] = { gModels[SPONZA_MODEL]->mDrawArgCount + i - 1, i, gObjectInfo[i].mMaterialId, gModels[i]->mIndexCount, 0, 0, 1 };
+
+	if (gObjectInstanceCount)
+		gGbufferDraws[drawCount++] = { gDrawCount, LION_MODEL, gObjectInfo[LION_MODEL].mMaterialId, gModels[LION_MODEL]->mIndexCount, 0, 0, gObjectInstanceCount };
+
+	uint32_t boundModel = UINT32_MAX;
+	uint32_t material = UINT32_MAX;
+	gGbufferStateChanges = 0;
+	for (uint32_t i = 0; i < drawCount; ++i)
+	{
+		gGbufferStateChanges += (gGbufferDraws[i].mModel != boundModel) + (gGbufferDraws[i].mMaterialId != material);
+		boundModel = gGbufferDraws[i].mModel;
+		material = gGbufferDraws[i].mMaterialId;
+	}
+
+	return drawCount;
+}
+
+// Model vertices at binding 0, the draw index buffer (stepped per instance) at binding 1
+void bindModelBuffers(Cmd* cmd, uint32_t model)
+{
+	const Geometry* pModel = gModels[model == SPONZA_BATCHED_MODEL ? SPONZA_MODEL : model];
+	Buffer* pVertexBuffers[] = { pModel->pVertexBuffers[0], pDrawIdBuffer };
+	uint32_t vertexStrides[] = { pModel->mVertexStrides[0], sizeof(uint32_t) };
+	cmdBindVertexBuffer(cmd, 2, pVertexBuffers, vertexStrides, NULL);
+	if (model == SPONZA_BATCHED_MODEL)
+		cmdBindIndexBuffer(cmd, pBatchedIndexBuffer, INDEX_TYPE_UINT32, 0);
+	else
+		cmdBindIndexBuffer(cmd, pModel->pIndexBuffer, pModel->mIndexType, 0);
+}
+
+void bindGbufferPipeline(Cmd* cmd)
+{
+	cmdBindPipeline(cmd, pGbufferPipeline);
+	cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetGbuffers[0]); // textureMap
+	cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetGbuffers[1]); // cameraUBO, draw data, objects
+}
+
+// Records draws [begin, end) into a Gbuffer pass that is already bound on cmd, the draw index goes in as the start instance
+void recordGbufferDraws(Cmd* cmd, const GbufferDraw* pDraws, uint32_t begin, uint32_t end)
+{
+	uint32_t boundModel = UINT32_MAX;
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const GbufferDraw& draw = pDraws[i];
+		if (draw.mModel != boundModel)
+		{
+			boundModel = draw.mModel;
+			bindModelBuffers(cmd, boundModel);
+		}
+
+		cmdDrawIndexedInstanced(cmd, draw.mIndexCount, draw.mStartIndex, draw.mInstanceCount, draw.mVertexOffset, draw.mDrawId);
+	}
+}
+
+// Each task resumes the cleared Gbuffer pass in its own command
+void recordGbufferTask(void* pUser, uint64_t taskIndex)
+{
+	const GbufferRecordTask* pTask = (const GbufferRecordTask*)pUser;
+	const uint32_t drawsPerTask = (pTask->mDrawCount + pTask->mTaskCount - 1) / pTask->mTaskCount;
+	const uint32_t begin = min((uint32_t)taskIndex * drawsPerTask, pTask->mDrawCount);
+	const uint32_t end = min(begin + drawsPerTask, pTask->mDrawCount);
+
+	Cmd* cmd = pGbufferCmds[gFrameIndex][taskIndex];
+	beginCmd(cmd);
+
+	LoadActionsDesc loadActions = {};
+	loadActions.mLoadActionsColor[0] = LOAD_ACTION_LOAD;
+	loadActions.mLoadActionsColor[1] = LOAD_ACTION_LOAD;
+	loadActions.mLoadActionDepth = LOAD_ACTION_LOAD;
+	RenderTarget** ppGbuffers = pGbufferRenderTargets[gFrameIndex];
+	cmdBindRenderTargets(cmd, DEFERRED_RT_COUNT, ppGbuffers, pDepthBuffer[gFrameIndex], &loadActions, NULL, NULL, -1, -1);
+	cmdSetViewport(cmd, 0.0f, 0.0f, (float)ppGbuffers[0]->mWidth, (float)ppGbuffers[0]->mHeight, 0.0f, 1.0f);
+	cmdSetScissor(cmd, 0, 0, ppGbuffers[0]->mWidth, ppGbuffers[0]->mHeight);
+
+	bindGbufferPipeline(cmd);
+	recordGbufferDraws(cmd, pTask->pDraws, begin, end);
+
+	cmdBindRenderTargets(cmd, 0, NULL, NULL, NULL, NULL, NULL, -1, -1);
+	endCmd(cmd);
+}
+
+enum QueueTransfer
+{
+	QUEUE_TRANSFER_NONE = 0, // culling on the graphics queue
+	QUEUE_TRANSFER_RELEASE,  // last barriers of the queue that hands the targets over
+	QUEUE_TRANSFER_ACQUIRE,  // the same barriers on the queue that takes them over
+};
+
+/**
+ * @brief Transitions the targets of a slot in front of (beforeCulling) or behind the culling pass.
+ * With async compute, the Gbuffer pass releases them to the compute queue and the culling pass acquires them with the same barriers,
+ * then the culling pass releases the scene, depth and light grid to the composition. The Gbuffer is cleared before its next use, so it stays.
+ */
+void cmdCullPassBarriers(Cmd* cmd, uint32_t slot, bool beforeCulling, QueueTransfer transfer)
+{
+	RenderTargetBarrier rtBarriers[DEFERRED_RT_COUNT + 2] = {};
+	BufferBarrier bufferBarriers[3] = {};
+	uint32_t rtBarrierCount = 0;
+	if (beforeCulling)
+	{
+		rtBarriers[rtBarrierCount++] = { pGbufferRenderTargets[slot][0], RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_SHADER_RESOURCE };
+		rtBarriers[rtBarrierCount++] = { pGbufferRenderTargets[slot][1], RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_SHADER_RESOURCE };
+		rtBarriers[rtBarrierCount++] = { pDepthBuffer[slot], RESOURCE_STATE_DEPTH_WRITE, RESOURCE_STATE_SHADER_RESOURCE };
+		rtBarriers[rtBarrierCount++] = { pSceneBuffer[slot], RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS };
+		bufferBarriers[0] = { pLightGridBuffer[slot], RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS };
+		bufferBarriers[1] = { pLightIndexBuffer[slot], RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS };
+		bufferBarriers[2] = { pLightOverflowBuffer[slot], RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS };
+	}
+	else
+	{
+		rtBarriers[rtBarrierCount++] = { pSceneBuffer[slot], RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE };
+		if (transfer != QUEUE_TRANSFER_NONE)
+			rtBarriers[rtBarrierCount++] = { pDepthBuffer[slot], RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_SHADER_RESOURCE };
+		bufferBarriers[0] = { pLightGridBuffer[slot], RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE };
+		bufferBarriers[1] = { pLightIndexBuffer[slot], RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE };
+		bufferBarriers[2] = { pLightOverflowBuffer[slot], RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE };
+	}
+
+	if (transfer != QUEUE_TRANSFER_NONE)
+	{
+		// the queue on the other side: compute for the Gbuffer release and the composition acquire, graphics otherwise
+		const QueueType otherQueue = (beforeCulling == (transfer == QUEUE_TRANSFER_RELEASE)) ? QUEUE_TYPE_COMPUTE : QUEUE_TYPE_GRAPHICS;
+		for (uint32_t i = 0; i < rtBarrierCount; ++i)
+		{
+			rtBarriers[i].mRelease = transfer == QUEUE_TRANSFER_RELEASE;
+			rtBarriers[i].mAcquire = transfer == QUEUE_TRANSFER_ACQUIRE;
+			rtBarriers[i].mQueueType = otherQueue;
+		}
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			bufferBarriers[i].mRelease = transfer == QUEUE_TRANSFER_RELEASE;
+			bufferBarriers[i].mAcquire = transfer == QUEUE_TRANSFER_ACQUIRE;
+			bufferBarriers[i].mQueueType = otherQueue;
+		}
+	}
+
+	cmdResourceBarrier(cmd, 3, bufferBarriers, 0, NULL, rtBarrierCount, rtBarriers);
+}
+
 FontDrawDesc gFrameTimeDraw; 
 
 //Generate sky box vertex buffer
@@ -256,26 +999,455 @@ enum // run script (tile base or tile half -> set tex2d descriptor set / )
 	NON_TILE = 0,
 	TILE_BASE = 1,
 	TILE_HALFZ = 2,
-	TILE_MODIFIED_Z
+	TILE_MODIFIED_Z,
+	TILE_CLUSTERED
 };
 
 static uint32_t gTileCullMode = TILE_BASE;
+static const char* gTileCullModeNames[] = { "Basic Deferred Rendering","Tile Culling Baseline", "Tile Culling Half-Z", "Tile Culling Modified - Z", "Clustered"};
+static const uint32_t gTileCullModeCount = sizeof(gTileCullModeNames) / sizeof(gTileCullModeNames[0]);
+
+// groupshared light list of the Baseline / Half-Z / Modified-Z kernels, Clustered always uses 32-bit indices
+static uint32_t gLightListEncoding = LIGHT_LIST_INDEX32;
+static const char* gLightListEncodingNames[LIGHT_LIST_ENCODING_COUNT] = { "32-bit", "16-bit", "Bitmask" };
+// shader file suffix of each encoding (ShaderList.fsl)
+static const char* gLightListEncodingSuffixes[LIGHT_LIST_ENCODING_COUNT] = { "", "16", "Bitmask" };
+
+// tile size of the depth pyramid and culling kernels ("-tileSize 8x8|16x16|32x32|32x8"), the light grid buffers follow it in Draw
+static uint32_t gTileSize = TILE_SIZE_16X16;
+static uint32_t gLightGridTileSize = TILE_SIZE_16X16; // tile size the light grid buffers were created for
+// shader file suffix of each tile size (ShaderList.fsl)
+static const char* gTileSizeSuffixes[TILE_SIZE_COUNT] = { "_8x8", "", "_32x32", "_32x8" };
+
+// groupshared bytes of the light lists of one tile, see lightList.h.fsl
+uint32_t getLightListGroupSharedBytes(uint32_t tileCullMode, uint32_t encoding)
+{
+	if (tileCullMode != TILE_BASE && tileCullMode != TILE_HALFZ && tileCullMode != TILE_MODIFIED_Z)
+		return 0;
+
+	const uint32_t buckets = tileCullMode == TILE_BASE ? 1 : 2;
+	uint32_t words = MAX_NUM_LIGHTS_PER_TILE;
+	if (encoding == LIGHT_LIST_INDEX16)
+		words = MAX_NUM_LIGHTS_PER_TILE / 2;
+	else if (encoding == LIGHT_LIST_BITMASK)
+		words = LIGHT_LIST_MASK_LIGHTS / 32;
+	// + the counter and the spill list head of every bucket, and the spill list head of the Forward+ grid
+	return ((words + 2) * buckets + 1) * (uint32_t)sizeof(uint32_t);
+}
 
 static bool bDebugDraw = false;
+static bool bForwardPlus = true;
 static bool bDynamicLight = false;
 static bool bRandomizePosition = false;
-// increased per frame and update light buffer only for 3 times after the actual data update in cpu
-static uint32_t gLightFrameCount = 0;
 static uint32_t gCurrentLightCount = 0;
 static float gLightSpawnBoxScale = 5.0f;
 static uint32_t gSelectedModel = LION_MODEL;
+static bool bRunCpuCullBenchmark = false;
+// "-cpuCullBenchmark": run the CPU culling benchmark without creating a renderer, then quit
+static bool bCpuBenchmarkOnly = false;
+static bool bLightBVH = true;
+
+bool hasCommandLineArgument(const char* pArgument)
+{
+	for (int i = 1; i < IApp::argc; ++i)
+	{
+		if (strcmp(IApp::argv[i], pArgument) == 0)
+			return true;
+	}
+	return false;
+}
+
+uint32_t getCommandLineUint(const char* pArgument, uint32_t defaultValue)
+{
+	for (int i = 1; i + 1 < IApp::argc; ++i)
+	{
+		if (strcmp(IApp::argv[i], pArgument) == 0)
+			return (uint32_t)strtoul(IApp::argv[i + 1], NULL, 10);
+	}
+	return defaultValue;
+}
+
+const char* getCommandLineString(const char* pArgument, const char* defaultValue)
+{
+	for (int i = 1; i + 1 < IApp::argc; ++i)
+	{
+		if (strcmp(IApp::argv[i], pArgument) == 0)
+			return IApp::argv[i + 1];
+	}
+	return defaultValue;
+}
+
+/************************************************************************/
+// Scripted benchmark ("-benchmarkFrames <frames per mode>")
+// Every light setup is run with every gTileCullMode along the same camera path with a fixed time step.
+// With "-benchmarkLightLists" every mode is also run with every light list encoding.
+// With "-benchmarkDrawBatching" every mode is run with and without draw batching, the Sponza draws are recorded on the CPU then.
+// Per-frame results go to TiledDeferredBenchmark.csv, per-mode averages to TiledDeferredBenchmark.json.
+/************************************************************************/
+enum
+{
+	BENCHMARK_PASS_FILL_GBUFFERS = 0,
+	BENCHMARK_PASS_LIGHT_CULLING,
+	BENCHMARK_PASS_RENDER_QUAD,
+	BENCHMARK_PASS_DEFERRED_LIGHT,
+	BENCHMARK_PASS_FORWARD_PLUS,
+	BENCHMARK_PASS_COUNT
+};
+
+// same names as the GPU profiler regions
+static const char* gBenchmarkPassNames[BENCHMARK_PASS_COUNT] = { "Fill Gbuffers", "Light Culling Compute", "Render Quad", "Deferred Rendering: Light Pass", "Forward+ Transparency" };
+
+enum
+{
+	BENCHMARK_LIGHTS_SCENARIO = 0, // scenarioLightPosition
+	BENCHMARK_LIGHTS_RANDOM,       // randomizeLightPosition(gBenchmarkLightSeed), animated
+	BENCHMARK_LIGHT_SETUP_COUNT
+};
+
+static const char* gBenchmarkLightSetupNames[BENCHMARK_LIGHT_SETUP_COUNT] = { "Scenario", "Random" };
+
+struct BenchmarkFrame
+{
+	uint32_t mLightSetup;
+	uint32_t mTileCullMode;
+	uint32_t mLightListEncoding;
+	uint32_t mLightListBytes; // groupshared light list bytes per tile
+	uint32_t mNumLights;
+	uint32_t mDrawBatching;
+	uint32_t mGbufferDraws;        // CPU recorded Gbuffer draws
+	uint32_t mGbufferStateChanges; // vertex / index buffer binds and material switches between them
+	float    mCpuUpdateMs;
+	float    mCpuDrawMs;
+	float    mLightUploadKB; // light + light BVH upload of the frame
+	float    mGbufferRecordMs; // gathering and recording the Gbuffer draws
+	float    mGpuMs[BENCHMARK_PASS_COUNT];
+	float    mAsyncOverlapMs; // culling of this frame overlapping the Gbuffer pass of the next one
+	uint64_t mGbufferTicks[2]; // raw timestamps, the overlap is measured across frames and queues
+	uint64_t mCullTicks[2];
+	LightOverflowStats mLightOverflow;
+};
+
+static const float gBenchmarkDeltaTime = 1.0f / 60.0f;
+static const uint32_t gBenchmarkLightSeed = 1234;
+static uint32_t gBenchmarkLightCount = INITIAL_LIGHT_CAPACITY; // "-benchmarkLights <count>"
+// frames at the start of every mode that are left out of the averages
+static const uint32_t gBenchmarkWarmupFrames = 8;
+
+static bool bBenchmark = false;
+static uint32_t gBenchmarkFramesPerMode = 0;
+static uint32_t gBenchmarkLightListEncodingCount = 1;
+static uint32_t gBenchmarkDrawBatchingCount = 1; // 2 with "-benchmarkDrawBatching": off, on
+static uint32_t gBenchmarkFrameCount = 0;
+static uint32_t gBenchmarkFrame = 0;
+BenchmarkFrame* pBenchmarkFrames = NULL;
+
+QueryPool* pBenchmarkQueryPool = NULL;
+Buffer* pBenchmarkQueryReadbackBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
+double gBenchmarkTimestampFrequency = 0.0;
+// benchmark frame recorded in each buffer slot and the passes it wrote
+uint32_t gBenchmarkQueryFrame[MAX_FRAMES_IN_FLIGHT] = {};
+uint32_t gBenchmarkQueryPassMask[MAX_FRAMES_IN_FLIGHT] = {};
+
+void cmdBeginBenchmarkPass(Cmd* pCmd, uint32_t pass)
+{
+	if (!bBenchmark)
+		return;
+
+	QueryDesc queryDesc = { (gFrameIndex * BENCHMARK_PASS_COUNT + pass) * 2 };
+	cmdBeginQuery(pCmd, pBenchmarkQueryPool, &queryDesc);
+	gBenchmarkQueryPassMask[gFrameIndex] |= 1u << pass;
+}
+
+void cmdEndBenchmarkPass(Cmd* pCmd, uint32_t pass)
+{
+	if (!bBenchmark)
+		return;
+
+	QueryDesc queryDesc = { (gFrameIndex * BENCHMARK_PASS_COUNT + pass) * 2 + 1 };
+	cmdEndQuery(pCmd, pBenchmarkQueryPool, &queryDesc);
+}
+
+// Called once the fence of the buffer slot has been waited on
+void readBenchmarkPassTimes(uint32_t frameIndex)
+{
+	if (gBenchmarkQueryFrame[frameIndex] >= gBenchmarkFrameCount)
+		return;
+
+	const uint64_t* pTimestamps = (const uint64_t*)pBenchmarkQueryReadbackBuffer[frameIndex]->pCpuMappedAddress;
+	BenchmarkFrame& frame = pBenchmarkFrames[gBenchmarkQueryFrame[frameIndex]];
+	for (uint32_t pass = 0; pass < BENCHMARK_PASS_COUNT; ++pass)
+	{
+		if (gBenchmarkQueryPassMask[frameIndex] & (1u << pass))
+			frame.mGpuMs[pass] = (float)((double)(pTimestamps[pass * 2 + 1] - pTimestamps[pass * 2]) / gBenchmarkTimestampFrequency * 1000.0);
+	}
+	if (gBenchmarkQueryPassMask[frameIndex] & (1u << BENCHMARK_PASS_FILL_GBUFFERS))
+		memcpy(frame.mGbufferTicks, pTimestamps + BENCHMARK_PASS_FILL_GBUFFERS * 2, sizeof(frame.mGbufferTicks));
+	if (gBenchmarkQueryPassMask[frameIndex] & (1u << BENCHMARK_PASS_LIGHT_CULLING))
+		memcpy(frame.mCullTicks, pTimestamps + BENCHMARK_PASS_LIGHT_CULLING * 2, sizeof(frame.mCullTicks));
+
+	gBenchmarkQueryFrame[frameIndex] = UINT32_MAX;
+}
+
+// Time the culling of frame i ran on the compute queue while the Gbuffer of frame i + 1 was filled, 0 without async compute
+float getBenchmarkAsyncOverlapMs(uint32_t i)
+{
+	if (i + 1 >= gBenchmarkFrameCount)
+		return 0.0f;
+
+	const BenchmarkFrame& frame = pBenchmarkFrames[i];
+	const BenchmarkFrame& next = pBenchmarkFrames[i + 1];
+	if (!frame.mCullTicks[1] || !next.mGbufferTicks[1])
+		return 0.0f;
+
+	const uint64_t begin = max(frame.mCullTicks[0], next.mGbufferTicks[0]);
+	const uint64_t end = min(frame.mCullTicks[1], next.mGbufferTicks[1]);
+	return end > begin ? (float)((double)(end - begin) / gBenchmarkTimestampFrequency * 1000.0) : 0.0f;
+}
+
+void writeBenchmarkResults()
+{
+	for (uint32_t i = 0; i < gBenchmarkFrameCount; ++i)
+		pBenchmarkFrames[i].mAsyncOverlapMs = getBenchmarkAsyncOverlapMs(i);
+
+	FileStream csv = {};
+	if (fsOpenStreamFromPath(RD_LOG, "TiledDeferredBenchmark.csv", FM_WRITE, &csv))
+	{
+		fsPrintToStream(&csv, "frame,lights,mode,lightList,lightListBytes,numLights,drawBatching,gbufferDraws,gbufferStateChanges,cpuUpdateMs,cpuDrawMs,lightUploadKB,gbufferRecordMs,asyncOverlapMs,overflowTiles,spilledLights,droppedLights,maxTileLights");
+		for (uint32_t pass = 0; pass < BENCHMARK_PASS_COUNT; ++pass)
+			fsPrintToStream(&csv, ",%s", gBenchmarkPassNames[pass]);
+		fsPrintToStream(&csv, "\n");
+
+		for (uint32_t i = 0; i < gBenchmarkFrameCount; ++i)
+		{
+			const BenchmarkFrame& frame = pBenchmarkFrames[i];
+			fsPrintToStream(&csv, "%u,%s,%s,%s,%u,%u,%u,%u,%u,%.4f,%.4f,%.2f,%.4f,%.4f,%u,%u,%u,%u", i, gBenchmarkLightSetupNames[frame.mLightSetup], gTileCullModeNames[frame.mTileCullMode],
+				gLightListEncodingNames[frame.mLightListEncoding], frame.mLightListBytes, frame.mNumLights, frame.mDrawBatching, frame.mGbufferDraws, frame.mGbufferStateChanges, frame.mCpuUpdateMs, frame.mCpuDrawMs, frame.mLightUploadKB, frame.mGbufferRecordMs,
+				frame.mAsyncOverlapMs, frame.mLightOverflow.mOverflowTiles, frame.mLightOverflow.mSpilledLights, frame.mLightOverflow.mDroppedLights,
+				frame.mLightOverflow.mMaxTileLights);
+			for (uint32_t pass = 0; pass < BENCHMARK_PASS_COUNT; ++pass)
+				fsPrintToStream(&csv, ",%.4f", frame.mGpuMs[pass]);
+			fsPrintToStream(&csv, "\n");
+		}
+		fsCloseStream(&csv);
+	}
+
+	FileStream json = {};
+	if (fsOpenStreamFromPath(RD_LOG, "TiledDeferredBenchmark.json", FM_WRITE, &json))
+	{
+		fsPrintToStream(&json, "{\n\t\"framesPerMode\": %u,\n\t\"warmupFrames\": %u,\n\t\"lightLayout\": \"%s\",\n\t\"asyncCompute\": %s,\n\t\"framesInFlight\": %u,\n\t\"swapchainImages\": %u,\n\t\"tileSize\": \"%s\",\n\t\"results\": [",
+			gBenchmarkFramesPerMode, gBenchmarkWarmupFrames, gLightLayoutNames[LIGHT_LAYOUT], bAsyncCompute ? "true" : "false", gFramesInFlight,
+			gSwapchainImageCount, gTileSizeNames[gTileSize]);
+
+		const uint32_t segmentCount = gBenchmarkFrameCount / gBenchmarkFramesPerMode;
+		for (uint32_t segment = 0; segment < segmentCount; ++segment)
+		{
+			BenchmarkFrame average = {};
+			uint32_t count = 0;
+			for (uint32_t i = gBenchmarkWarmupFrames; i < gBenchmarkFramesPerMode; ++i, ++count)
+			{
+				const BenchmarkFrame& frame = pBenchmarkFrames[segment * gBenchmarkFramesPerMode + i];
+				average.mCpuUpdateMs += frame.mCpuUpdateMs;
+				average.mCpuDrawMs += frame.mCpuDrawMs;
+				average.mLightUploadKB += frame.mLightUploadKB;
+				average.mGbufferRecordMs += frame.mGbufferRecordMs;
+				average.mGbufferDraws += frame.mGbufferDraws;
+				average.mGbufferStateChanges += frame.mGbufferStateChanges;
+				average.mAsyncOverlapMs += frame.mAsyncOverlapMs;
+				average.mLightOverflow.mOverflowTiles += frame.mLightOverflow.mOverflowTiles;
+				average.mLightOverflow.mSpilledLights += frame.mLightOverflow.mSpilledLights;
+				average.mLightOverflow.mDroppedLights += frame.mLightOverflow.mDroppedLights;
+				average.mLightOverflow.mMaxTileLights = max(average.mLightOverflow.mMaxTileLights, frame.mLightOverflow.mMaxTileLights);
+				for (uint32_t pass = 0; pass < BENCHMARK_PASS_COUNT; ++pass)
+					average.mGpuMs[pass] += frame.mGpuMs[pass];
+			}
+
+			const float invCount = count ? 1.0f / (float)count : 0.0f;
+			const BenchmarkFrame& first = pBenchmarkFrames[segment * gBenchmarkFramesPerMode];
+			fsPrintToStream(&json, "%s\n\t\t{ \"lights\": \"%s\", \"mode\": \"%s\", \"lightList\": \"%s\", \"lightListBytes\": %u, \"numLights\": %u, \"drawBatching\": %s, \"gbufferDraws\": %.1f, \"gbufferStateChanges\": %.1f, \"cpuUpdateMs\": %.4f, \"cpuDrawMs\": %.4f, \"lightUploadKB\": %.2f, \"gbufferRecordMs\": %.4f, \"asyncOverlapMs\": %.4f, \"overflowTiles\": %.1f, \"spilledLights\": %.1f, \"droppedLights\": %.1f, \"maxTileLights\": %u",
+				segment ? "," : "", gBenchmarkLightSetupNames[first.mLightSetup], gTileCullModeNames[first.mTileCullMode],
+				gLightListEncodingNames[first.mLightListEncoding], first.mLightListBytes, first.mNumLights, first.mDrawBatching ? "true" : "false",
+				(float)average.mGbufferDraws * invCount, (float)average.mGbufferStateChanges * invCount,
+				average.mCpuUpdateMs * invCount, average.mCpuDrawMs * invCount, average.mLightUploadKB * invCount, average.mGbufferRecordMs * invCount,
+				average.mAsyncOverlapMs * invCount, (float)average.mLightOverflow.mOverflowTiles * invCount, (float)average.mLightOverflow.mSpilledLights * invCount,
+				(float)average.mLightOverflow.mDroppedLights * invCount, average.mLightOverflow.mMaxTileLights);
+			for (uint32_t pass = 0; pass < BENCHMARK_PASS_COUNT; ++pass)
+				fsPrintToStream(&json, ", \"%s\": %.4f", gBenchmarkPassNames[pass], average.mGpuMs[pass] * invCount);
+			fsPrintToStream(&json, " }");
+		}
+
+		fsPrintToStream(&json, "\n\t]\n}\n");
+		fsCloseStream(&json);
+	}
+
+	LOGF(eINFO, "Benchmark finished: %u frames written to TiledDeferredBenchmark.csv / .json", gBenchmarkFrameCount);
+}
+
+/************************************************************************/
+// Tile size auto-tuning ("-autoTuneTileSize" or the UI), see TileSizeTuner.h
+// The light culling pass of the measured frames is timed with its own queries, independent of the benchmark.
+/************************************************************************/
+static const uint32_t gTileSizeTuningFrames = 64; // per tile size, warm-up included
+static TileSizeTuner gTileSizeTuner = {};
+static bool bMeasureTileSize = false; // culling time of the frame being recorded goes to the tuner
+
+QueryPool* pTileSizeQueryPool = NULL;
+Buffer* pTileSizeQueryReadbackBuffer[MAX_FRAMES_IN_FLIGHT] = { NULL };
+double gTileSizeTimestampFrequency = 0.0;
+// tile size measured in each buffer slot, UINT32_MAX when the slot holds no measurement
+uint32_t gTileSizeQueryVariant[MAX_FRAMES_IN_FLIGHT] = {};
+
+void cmdBeginTileSizeQuery(Cmd* pCmd)
+{
+	if (gTileSizeQueryVariant[gFrameIndex] == UINT32_MAX)
+		return;
+
+	QueryDesc queryDesc = { gFrameIndex * 2 };
+	cmdBeginQuery(pCmd, pTileSizeQueryPool, &queryDesc);
+}
+
+void cmdEndTileSizeQuery(Cmd* pCmd)
+{
+	if (gTileSizeQueryVariant[gFrameIndex] == UINT32_MAX)
+		return;
+
+	QueryDesc queryDesc = { gFrameIndex * 2 + 1 };
+	cmdEndQuery(pCmd, pTileSizeQueryPool, &queryDesc);
+}
+
+// Called once the fence of the buffer slot has been waited on
+void readTileSizeQuery(uint32_t frameIndex)
+{
+	if (gTileSizeQueryVariant[frameIndex] == UINT32_MAX)
+		return;
+
+	const uint64_t* pTimestamps = (const uint64_t*)pTileSizeQueryReadbackBuffer[frameIndex]->pCpuMappedAddress;
+	if (gTileSizeTuner.mActive)
+		addTileSizeTuningSample(&gTileSizeTuner, gTileSizeQueryVariant[frameIndex],
+			(float)((double)(pTimestamps[1] - pTimestamps[0]) / gTileSizeTimestampFrequency * 1000.0));
+	gTileSizeQueryVariant[frameIndex] = UINT32_MAX;
+}
+
+void startTileSizeTuning(void* pUserData = NULL)
+{
+	if (bBenchmark || gTileSizeTuner.mActive)
+		return;
+	if (gTileCullMode == NON_TILE)
+	{
+		LOGF(eWARNING, "Tile size auto-tuning needs a tile culling render mode");
+		return;
+	}
+
+	beginTileSizeTuning(&gTileSizeTuner, gTileSizeTuningFrames);
+	LOGF(eINFO, "Tile size auto-tuning: %u frames per tile size, %u lights", gTileSizeTuningFrames, gCurrentLightCount);
+}
+
+/**
+ * @brief Picks the tile size of the frame about to be recorded while tuning, keeps the fastest one once every measured frame is back.
+ */
+void updateTileSizeTuning()
+{
+	bMeasureTileSize = false;
+	if (!gTileSizeTuner.mActive)
+		return;
+
+	if (gTileCullMode == NON_TILE)
+	{
+		gTileSizeTuner.mActive = false;
+		LOGF(eWARNING, "Tile size auto-tuning cancelled, the render mode does not cull tiles");
+		return;
+	}
+
+	gTileSize = nextTileSizeTuningFrame(&gTileSizeTuner, &bMeasureTileSize);
+	if (!isTileSizeTuningRecorded(&gTileSizeTuner))
+		return;
+
+	for (uint32_t i = 0; i < gFramesInFlight; ++i)
+	{
+		if (gTileSizeQueryVariant[i] != UINT32_MAX)
+			return;
+	}
+
+	gTileSize = getTunedTileSize(&gTileSizeTuner, TILE_SIZE_16X16);
+	gTileSizeTuner.mActive = false;
+	for (uint32_t i = 0; i < TILE_SIZE_COUNT; ++i)
+		LOGF(eINFO, "Tile size auto-tuning: %s %.4f ms (%u frames)", gTileSizeNames[i], getTileSizeTuningAverageMs(&gTileSizeTuner, i),
+			gTileSizeTuner.mSampleCount[i]);
+	LOGF(eINFO, "Tile size auto-tuning: keeping %s (%s, %u lights)", gTileSizeNames[gTileSize], gTileCullModeNames[gTileCullMode], gCurrentLightCount);
+}
+
+/**
+ * @brief Reads the overflow counters the culling pass of the slot copied, once its fence has been waited on (no stall).
+ * Must run before readBenchmarkPassTimes(), which releases the benchmark frame of the slot.
+ */
+void readLightOverflowCounters(uint32_t frameIndex)
+{
+	if (!gLightOverflowReadback[frameIndex])
+		return;
+	gLightOverflowReadback[frameIndex] = false;
+
+	const uint32_t* pCounters = (const uint32_t*)pLightOverflowReadbackBuffer[frameIndex]->pCpuMappedAddress;
+	const uint32_t nodes = pCounters[LIGHT_OVERFLOW_NODES];
+	LightOverflowStats& stats = gLightOverflowStats;
+	stats.mOverflowTiles = pCounters[LIGHT_OVERFLOW_TILES];
+	stats.mSpilledLights = min(nodes, (uint32_t)LIGHT_OVERFLOW_CAPACITY);
+	stats.mDroppedLights = pCounters[LIGHT_OVERFLOW_DROPPED] + nodes - stats.mSpilledLights;
+	stats.mMaxTileLights = pCounters[LIGHT_OVERFLOW_MAX_LIGHTS];
+	// the bins and tiles that did not fit were truncated, Draw grows their indices before the next pass
+	const uint32_t binLights = pCounters[LIGHT_OVERFLOW_BIN_LIGHTS];
+	gLightBinRequiredCapacity = max(gLightBinRequiredCapacity, binLights);
+	gLightGridRequiredCapacity = max(gLightGridRequiredCapacity, pCounters[LIGHT_OVERFLOW_GRID_LIGHTS]);
+	gClusterLightRequiredCapacity = max(gClusterLightRequiredCapacity, pCounters[LIGHT_OVERFLOW_CLUSTER_LIGHTS]);
+
+	gLightOverflowPeak.mOverflowTiles = max(gLightOverflowPeak.mOverflowTiles, stats.mOverflowTiles);
+	gLightOverflowPeak.mSpilledLights = max(gLightOverflowPeak.mSpilledLights, stats.mSpilledLights);
+	gLightOverflowPeak.mDroppedLights = max(gLightOverflowPeak.mDroppedLights, stats.mDroppedLights);
+	gLightOverflowPeak.mMaxTileLights = max(gLightOverflowPeak.mMaxTileLights, stats.mMaxTileLights);
+	if (stats.mOverflowTiles)
+		++gLightOverflowFrames;
+
+	snprintf(gLightOverflowText, sizeof(gLightOverflowText),
+		"Overflowed tiles: %u, spilled lights: %u, dropped lights: %u, max lights per tile: %u / %u, light bin indices: %u / %u, "
+		"light grid indices: %u / %u, cluster indices: %u / %u", stats.mOverflowTiles, stats.mSpilledLights, stats.mDroppedLights,
+		stats.mMaxTileLights, (uint32_t)MAX_NUM_LIGHTS_PER_TILE, binLights, gLightBinCapacity, pCounters[LIGHT_OVERFLOW_GRID_LIGHTS],
+		gLightGridCapacity, pCounters[LIGHT_OVERFLOW_CLUSTER_LIGHTS], gClusterLightCapacity);
+
+	if (bBenchmark && gBenchmarkQueryFrame[frameIndex] < gBenchmarkFrameCount)
+		pBenchmarkFrames[gBenchmarkQueryFrame[frameIndex]].mLightOverflow = stats;
+}
+
+// 4K, INITIAL_LIGHT_CAPACITY lights from the default camera, synthetic depth (no GPU needed)
+void runCpuCullBenchmark()
+{
+	TiledCullCpuBenchmarkDesc benchmarkDesc = {};
+	benchmarkDesc.mWidth = 3840;
+	benchmarkDesc.mHeight = 2160;
+	benchmarkDesc.mNumLights = INITIAL_LIGHT_CAPACITY;
+	benchmarkDesc.mIterations = 10;
+	benchmarkDesc.mSeed = 1;
+	benchmarkDesc.mLightSpawnBoxScale = 5.0f;
+	benchmarkDesc.mView = mat4::translation(vec3(0.0f, 0.0f, 25.0f));
+	benchmarkDesc.mProject = mat4::perspectiveLH_ReverseZ(PI / 2.0f, (float)benchmarkDesc.mHeight / (float)benchmarkDesc.mWidth, 0.1f, 1000.0f);
+
+	TiledCullCpuStats stats[TILE_SIZE_COUNT * TILED_CULL_CPU_MODE_COUNT] = {};
+	benchmarkTiledCullCpu(pThreadSystem, &benchmarkDesc, stats);
+	bRunCpuCullBenchmark = false;
+}
+
+// "-lightBvhBenchmark": per frame BVH build cost at the size of a large dynamic light set
+void runLightBVHBenchmark()
+{
+	LightBVHBenchmarkDesc benchmarkDesc = {};
+	benchmarkDesc.mNumLights = 256 * 1024;
+	benchmarkDesc.mIterations = 20;
+	benchmarkDesc.mSeed = 1;
+	benchmarkDesc.mLightSpawnBoxScale = 5.0f;
+	benchmarkDesc.mBudgetMilliseconds = 1.0;
+	benchmarkLightBVH(pThreadSystem, &benchmarkDesc);
+}
 
 // for static light scene to compare improvement on depth discontinuity
 void scenarioLightPosition(void* pUserData)
 {
-	// set to light frame count = 0, and update the light buffer per frame
-	// turn on switch (update light buffer)
-	gLightFrameCount = 0;
 	gCurrentLightCount = 1600;
 	static const vec3 camPos(0.8f, 7.8f, -26.7f);
 	static const vec4 colorAndIntensity = vec4(1.0f, 0.3f, 0.3f, 1.0f);
@@ -293,6 +1465,7 @@ void scenarioLightPosition(void* pUserData)
 	int zAxisCount = int(depth / unitDistance);
 	gCurrentLightCount = xAxisCount * yAxisCount * zAxisCount;
 	gUniformTileCullData.mNumOfLights = gCurrentLightCount;
+	reserveLights(gCurrentLightCount);
 
 	const vec3 offset(-4.0f, 5.0f, 0.0f); // offset
 
@@ -307,6 +1480,12 @@ void scenarioLightPosition(void* pUserData)
 			}
 		}
 	}
+
+	resetLightAnimation(&gLightAnimation, gLightPositionAndRadius, gCurrentLightCount, 0);
+	gLightAnimationTime = 0.0f;
+
+	markDirtyRange(&gLightPositionTracker, 0, gCurrentLightCount);
+	markDirtyRange(&gLightColorTracker, 0, gCurrentLightCount);
 }
 
 class TiledDeferredRendering: public IApp
@@ -323,6 +1502,28 @@ public:
 		fsSetPathForResourceDir(pSystemFileIO, RM_CONTENT, RD_FONTS, "Fonts");
 		fsSetPathForResourceDir(pSystemFileIO, RM_DEBUG, RD_SCREENSHOTS, "Screenshots");
 		fsSetPathForResourceDir(pSystemFileIO, RM_CONTENT, RD_SCRIPTS, "Scripts");
+		fsSetPathForResourceDir(pSystemFileIO, RM_DEBUG, RD_PIPELINE_CACHE, "PipelineCaches");
+
+		initThreadSystem(&pThreadSystem);
+		initLightBVH(pThreadSystem, &gLightBVH);
+		initLightAnimation(pThreadSystem, &gLightAnimation);
+		initDrawCullCpu(pThreadSystem, &gDrawCullCpu);
+
+		if (hasCommandLineArgument("-cpuCullBenchmark") || hasCommandLineArgument("-lightBvhBenchmark") || hasCommandLineArgument("-lightAnimationBenchmark") ||
+			hasCommandLineArgument("-drawCullBenchmark") || hasCommandLineArgument("-gbufferPackingCheck") || hasCommandLineArgument("-lightPackingBenchmark") ||
+			hasCommandLineArgument("-lightLayoutBenchmark") || hasCommandLineArgument("-objectInstanceBenchmark"))
+		{
+			bCpuBenchmarkOnly = true;
+			return true;
+		}
+
+		initObjectInstances(pThreadSystem, &gObjectInstances, OBJECT_INSTANCE_CAPACITY);
+		placeObjectInstances();
+		gObjectInstanceCount = min(getCommandLineUint("-objectInstances", 0), (uint32_t)OBJECT_INSTANCE_CAPACITY);
+
+		// startup timings per phase, in the log
+		HiresTimer startupTimer;
+		initHiresTimer(&startupTimer);
 
 		// window and renderer setup
 		RendererDesc settings;
@@ -335,17 +1536,59 @@ public:
 		if (!pRenderer)
 			return false;
 
+		LOGF(eINFO, "Startup: renderer init %.2f ms", (float)getHiresTimerUSec(&startupTimer, true) / 1000.0f);
+
+		// the cache itself is created by the first Load(), once the shader binaries are hashed
+		readPipelineCacheFile(pRenderer, gPipelineCacheFileName, &gPipelineCacheFile);
+
 		QueueDesc queueDesc = {};
 		queueDesc.mType = QUEUE_TYPE_GRAPHICS;
 		queueDesc.mFlag = QUEUE_FLAG_INIT_MICROPROFILE;
 		addQueue(pRenderer, &queueDesc, &pGraphicsQueue);
 
+		// at least two, the async compute composition of a slot is submitted by the next frame
+		gFramesInFlight = max(2u, min(getCommandLineUint("-framesInFlight", gFramesInFlight), (uint32_t)MAX_FRAMES_IN_FLIGHT));
+		gSwapchainImageCount = max(2u, min(getCommandLineUint("-swapchainImages", gSwapchainImageCount), (uint32_t)MAX_SWAPCHAIN_IMAGES));
+
 		GpuCmdRingDesc cmdRingDesc = {};
 		cmdRingDesc.pQueue = pGraphicsQueue;
-		cmdRingDesc.mPoolCount = gDataBufferCount;
-		cmdRingDesc.mCmdPerPoolCount = 1;
+		cmdRingDesc.mPoolCount = gFramesInFlight;
+		cmdRingDesc.mCmdPerPoolCount = 3; // [0] = up to the Gbuffer clear, [1] = after the Gbuffer draws, [2] = composition (async compute)
 		cmdRingDesc.mAddSyncPrimitives = true;
 		addGpuCmdRing(pRenderer, &cmdRingDesc, &gGraphicsCmdRing);
+
+		// Culling pass of the async compute mode. Its pools cycle with the graphics ring, whose fence covers it through the composition.
+		queueDesc.mType = QUEUE_TYPE_COMPUTE;
+		queueDesc.mFlag = QUEUE_FLAG_INIT_MICROPROFILE;
+		addQueue(pRenderer, &queueDesc, &pComputeQueue);
+
+		cmdRingDesc.pQueue = pComputeQueue;
+		cmdRingDesc.mCmdPerPoolCount = 1;
+		cmdRingDesc.mAddSyncPrimitives = false;
+		addGpuCmdRing(pRenderer, &cmdRingDesc, &gComputeCmdRing);
+
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			addSemaphore(pRenderer, &pGbufferDoneSemaphores[i]);
+			addSemaphore(pRenderer, &pCullDoneSemaphores[i]);
+		}
+		bAsyncCompute = hasCommandLineArgument("-asyncCompute");
+
+		// Per frame command pools of the Gbuffer recording tasks
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			for (uint32_t t = 0; t < GBUFFER_MAX_RECORD_TASKS; ++t)
+			{
+				CmdPoolDesc cmdPoolDesc = {};
+				cmdPoolDesc.pQueue = pGraphicsQueue;
+				cmdPoolDesc.mTransient = true;
+				addCmdPool(pRenderer, &cmdPoolDesc, &pGbufferCmdPools[i][t]);
+
+				CmdDesc cmdDesc = {};
+				cmdDesc.pPool = pGbufferCmdPools[i][t];
+				addCmd(pRenderer, &cmdDesc, &pGbufferCmds[i][t]);
+			}
+		}
 		addSemaphore(pRenderer, &pImageAcquiredSemaphore);
 
 		initScreenshotInterface(pRenderer, pGraphicsQueue);
@@ -376,6 +1619,85 @@ public:
 
 		// Gpu profiler can only be added after initProfile.
 		gGpuProfileToken = addGpuProfiler(pRenderer, pGraphicsQueue, "Graphics");
+		gComputeProfileToken = addGpuProfiler(pRenderer, pComputeQueue, "Compute");
+
+		gBenchmarkFramesPerMode = getCommandLineUint("-benchmarkFrames", 0);
+		gBenchmarkLightCount = min(getCommandLineUint("-benchmarkLights", INITIAL_LIGHT_CAPACITY), gMaxLightCount);
+		if (gBenchmarkFramesPerMode)
+		{
+			bBenchmark = true;
+			gBenchmarkFramesPerMode = max(gBenchmarkFramesPerMode, gBenchmarkWarmupFrames + 1);
+			if (hasCommandLineArgument("-benchmarkLightLists"))
+				gBenchmarkLightListEncodingCount = LIGHT_LIST_ENCODING_COUNT;
+			if (hasCommandLineArgument("-benchmarkDrawBatching"))
+			{
+				gBenchmarkDrawBatchingCount = 2;
+				bGpuDrivenGbuffer = false;
+			}
+			gBenchmarkFrameCount =
+				gBenchmarkFramesPerMode * gBenchmarkDrawBatchingCount * gBenchmarkLightListEncodingCount * gTileCullModeCount * BENCHMARK_LIGHT_SETUP_COUNT;
+			pBenchmarkFrames = (BenchmarkFrame*)tf_calloc(gBenchmarkFrameCount, sizeof(BenchmarkFrame));
+			// frame pacing must not depend on the display
+			mSettings.mVSyncEnabled = false;
+
+			QueryPoolDesc queryPoolDesc = {};
+			queryPoolDesc.mType = QUERY_TYPE_TIMESTAMP;
+			queryPoolDesc.mQueryCount = gFramesInFlight * BENCHMARK_PASS_COUNT * 2;
+			addQueryPool(pRenderer, &queryPoolDesc, &pBenchmarkQueryPool);
+			getTimestampFrequency(pGraphicsQueue, &gBenchmarkTimestampFrequency);
+
+			BufferLoadDesc readbackDesc = {};
+			readbackDesc.mDesc.pName = "benchmarkQueryReadback";
+			readbackDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNDEFINED;
+			readbackDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_TO_CPU;
+			readbackDesc.mDesc.mStartState = RESOURCE_STATE_COPY_DEST;
+			readbackDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+			readbackDesc.mDesc.mSize = BENCHMARK_PASS_COUNT * 2 * sizeof(uint64_t);
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			{
+				gBenchmarkQueryFrame[i] = UINT32_MAX;
+				readbackDesc.ppBuffer = &pBenchmarkQueryReadbackBuffer[i];
+				addResource(&readbackDesc, NULL);
+			}
+		}
+
+		const char* pTileSize = getCommandLineString("-tileSize", gTileSizeNames[gTileSize]);
+		uint32_t tileSize = TILE_SIZE_COUNT;
+		for (uint32_t i = 0; i < TILE_SIZE_COUNT; ++i)
+		{
+			if (strcmp(pTileSize, gTileSizeNames[i]) == 0)
+				tileSize = i;
+		}
+		if (tileSize < TILE_SIZE_COUNT)
+			gTileSize = tileSize;
+		else
+			LOGF(eWARNING, "Unknown -tileSize %s, expected %s|%s|%s|%s, keeping %s", pTileSize, gTileSizeNames[0], gTileSizeNames[1], gTileSizeNames[2],
+				gTileSizeNames[3], gTileSizeNames[gTileSize]);
+
+		// begin / end timestamps of the light culling pass per slot, for the tile size auto-tuning
+		{
+			QueryPoolDesc queryPoolDesc = {};
+			queryPoolDesc.mType = QUERY_TYPE_TIMESTAMP;
+			queryPoolDesc.mQueryCount = gFramesInFlight * 2;
+			addQueryPool(pRenderer, &queryPoolDesc, &pTileSizeQueryPool);
+			getTimestampFrequency(pGraphicsQueue, &gTileSizeTimestampFrequency);
+
+			BufferLoadDesc readbackDesc = {};
+			readbackDesc.mDesc.pName = "tileSizeQueryReadback";
+			readbackDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNDEFINED;
+			readbackDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_TO_CPU;
+			readbackDesc.mDesc.mStartState = RESOURCE_STATE_COPY_DEST;
+			readbackDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+			readbackDesc.mDesc.mSize = 2 * sizeof(uint64_t);
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			{
+				gTileSizeQueryVariant[i] = UINT32_MAX;
+				readbackDesc.ppBuffer = &pTileSizeQueryReadbackBuffer[i];
+				addResource(&readbackDesc, NULL);
+			}
+		}
+		if (hasCommandLineArgument("-autoTuneTileSize"))
+			startTileSizeTuning();
 
 		/************************************************************************/
 		// GUI
@@ -418,29 +1740,7 @@ public:
 		tileBuffDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
 		tileBuffDesc.pData = NULL;
 
-		BufferLoadDesc lightPosBuffDesc = {};
-		lightPosBuffDesc.mDesc.pName = "lightPosBuff";
-		lightPosBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
-		lightPosBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
-		lightPosBuffDesc.mDesc.mStartState = RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
-		lightPosBuffDesc.mDesc.mStructStride = sizeof(float) * 4;
-		lightPosBuffDesc.mDesc.mFirstElement = 0;
-		lightPosBuffDesc.mDesc.mElementCount = MAX_LIGHTS;
-		lightPosBuffDesc.mDesc.mSize = lightPosBuffDesc.mDesc.mStructStride * lightPosBuffDesc.mDesc.mElementCount;
-		lightPosBuffDesc.pData = NULL;
-
-		BufferLoadDesc lightColorBuffDesc = {};
-		lightColorBuffDesc.mDesc.pName = "lightColorBuff";
-		lightColorBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
-		lightColorBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
-		lightColorBuffDesc.mDesc.mStartState = RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
-		lightColorBuffDesc.mDesc.mStructStride = sizeof(float) * 4;
-		lightColorBuffDesc.mDesc.mFirstElement = 0;
-		lightColorBuffDesc.mDesc.mElementCount = MAX_LIGHTS;
-		lightColorBuffDesc.mDesc.mSize = lightColorBuffDesc.mDesc.mStructStride * lightColorBuffDesc.mDesc.mElementCount;
-		lightColorBuffDesc.pData = NULL;
-
-		for (uint32_t i = 0; i < gDataBufferCount; ++i) {
+		for (uint32_t i = 0; i < gFramesInFlight; ++i) {
 
 			camBuffDesc.ppBuffer = &pCameraBuffer[i];
 			addResource(&camBuffDesc, NULL);
@@ -450,14 +1750,11 @@ public:
 
 			tileBuffDesc.ppBuffer = &pTileCullDataBuffer[i];
 			addResource(&tileBuffDesc, NULL);
-
-			lightPosBuffDesc.ppBuffer = &pLightPosAndRadiusBuffer[i];
-			addResource(&lightPosBuffDesc, NULL);
-
-			lightColorBuffDesc.ppBuffer = &pLightColorAndIntensityBuffer[i];
-			addResource(&lightColorBuffDesc, NULL);
 		}
 
+		reserveLights(INITIAL_LIGHT_CAPACITY);
+		addLightBuffers();
+
 		float screenQuadPoints[] = {
 			-1.0f, 3.0f, 0.5f, 0.0f, -1.0f, -1.0f, -1.0f, 0.5f, 0.0f, 1.0f, 3.0f, -1.0f, 0.5f, 2.0f, 1.0f,
 		};
@@ -494,6 +1791,17 @@ public:
 		gVertexLayoutModel.mAttribs[2].mLocation = 2;
 		gVertexLayoutModel.mAttribs[2].mOffset = sizeof(float) * 6;
 
+		// Gbuffer / Forward+ pipelines: draw index stepped per instance from pDrawIdBuffer
+		gVertexLayoutModelDrawId = gVertexLayoutModel;
+		gVertexLayoutModelDrawId.mBindingCount = 2;
+		gVertexLayoutModelDrawId.mAttribCount = 4;
+		gVertexLayoutModelDrawId.mAttribs[3].mSemantic = SEMANTIC_TEXCOORD1;
+		gVertexLayoutModelDrawId.mAttribs[3].mFormat = TinyImageFormat_R32_UINT;
+		gVertexLayoutModelDrawId.mAttribs[3].mBinding = 1;
+		gVertexLayoutModelDrawId.mAttribs[3].mLocation = 3;
+		gVertexLayoutModelDrawId.mAttribs[3].mOffset = 0;
+		gVertexLayoutModelDrawId.mAttribs[3].mRate = VERTEX_ATTRIB_RATE_INSTANCE;
+
 		// Update ObjectData	
 		gObjectInfo[SPONZA_MODEL].mPosition = float3(0.0f, -5.0f, 0.0f);
 		gObjectInfo[SPONZA_MODEL].mRotation = float3(0.0f, -1.5708f, 0.0f);
@@ -502,33 +1810,23 @@ public:
 		gObjectInfo[LION_MODEL].mPosition = float3(0.0f, -5.0f, 5.0f);
 		gObjectInfo[LION_MODEL].mRotation = float3(0.0f, 0.0f, 0.0f);
 		gObjectInfo[LION_MODEL].mScale = 0.2f;
-		gObjectInfo[LION_MODEL].mMaterial = { 81, 83, 6, 6 };
 		
 		// Load Mesh
+		getHiresTimerUSec(&startupTimer, true);
+		SyncToken meshToken = {};
 		for (uint32_t i = 0; i < MODEL_COUNT; ++i) 
 		{
 			GeometryLoadDesc geomLoadDesc = {};
 			geomLoadDesc.pFileName = gModelNames[i];
 			geomLoadDesc.ppGeometry = &gModels[i];
 			geomLoadDesc.pVertexLayout = &gVertexLayoutModel;
-			addResource(&geomLoadDesc, NULL);
-		}
-
-		// Load Texture
-		for (uint32_t i = 0; i < TOTAL_IMGS; ++i) {
-			TextureLoadDesc texLoadDesc = {};
-			texLoadDesc.pFileName = pMaterialImageFileNames[i];
-			texLoadDesc.ppTexture = &pMaterialTextures[i];
-			if (strstr(pMaterialImageFileNames[i], "Albedo") || strstr(pMaterialImageFileNames[i], "diffuse"))
-			{
-				// Textures representing color should be stored in SRGB or HDR format
-				texLoadDesc.mCreationFlag = TEXTURE_CREATION_FLAG_SRGB;
-			}
-
-			addResource(&texLoadDesc, NULL);
+			// Sponza positions and indices stay on the CPU until the per draw bounds are computed
+			geomLoadDesc.mFlags = i == SPONZA_MODEL ? GEOMETRY_LOAD_FLAG_SHADOWED : GEOMETRY_LOAD_FLAG_NONE;
+			addResource(&geomLoadDesc, &meshToken);
 		}
 
-		waitForAllResourceLoads();
+		waitForToken(&meshToken);
+		LOGF(eINFO, "Startup: mesh load %.2f ms", (float)getHiresTimerUSec(&startupTimer, false) / 1000.0f);
 
 		// Widget
 		// light map draw on/off
@@ -538,6 +1836,56 @@ public:
 		// dynamic light on/off
 		boolCheck.pData = &bDynamicLight;
 		luaRegisterWidget( uiCreateComponentWidget(pGuiWindow, "Dynamic Light", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		DropdownWidget ddLightMotion;
+		ddLightMotion.pData = &gLightMotion;
+		ddLightMotion.pNames = gLightMotionNames;
+		ddLightMotion.mCount = LIGHT_MOTION_COUNT;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Light Motion", &ddLightMotion, WIDGET_TYPE_DROPDOWN));
+		// alpha blended materials through the light grid (tile culling modes only)
+		boolCheck.pData = &bForwardPlus;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Forward+ Transparency", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		// light binning walks the CPU built light BVH instead of testing every light
+		boolCheck.pData = &bLightBVH;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Light BVH", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		// Gbuffer draws recorded by the thread system into per task commands
+		boolCheck.pData = &bMultithreadedGbuffer;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Multithreaded Gbuffer Recording", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		// Sponza draws culled on the GPU and issued with one indirect draw
+		boolCheck.pData = &bGpuDrivenGbuffer;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "GPU Driven Gbuffer", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		boolCheck.pData = &bGbufferFrustumCull;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Gbuffer Frustum Culling", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		// CPU recorded Sponza draws culled against the frustum and, optionally, a software rasterized occluder depth buffer
+		boolCheck.pData = &bCpuDrawCull;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "CPU Draw Culling", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		boolCheck.pData = &bCpuOcclusionCull;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "CPU Occlusion Culling", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		// CPU recorded Sponza draws from the render queue, merged by material
+		boolCheck.pData = &bDrawBatching;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Draw Batching", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		// second Gbuffer target format, recreated with the render targets
+		boolCheck.pData = &bThinGbuffer;
+		UIWidget* pThinGbuffer = uiCreateComponentWidget(pGuiWindow, "Thin Gbuffer", &boolCheck, WIDGET_TYPE_CHECKBOX);
+		uiSetWidgetOnEditedCallback(pThinGbuffer, nullptr, [](void* pUserData) {
+			ReloadDesc reloadDesc = { RELOAD_TYPE_RENDERTARGET };
+			requestReload(&reloadDesc);
+			});
+		luaRegisterWidget(pThinGbuffer);
+		// tile culling and shading on the compute queue, overlapping the Gbuffer pass of the next frame
+		boolCheck.pData = &bAsyncCompute;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Async Compute Light Culling", &boolCheck, WIDGET_TYPE_CHECKBOX));
+		// presentation queue depth, independent of the frames in flight, the swapchain is recreated
+		SliderUintWidget swapchainImageSlider;
+		swapchainImageSlider.pData = &gSwapchainImageCount;
+		swapchainImageSlider.mMin = 2;
+		swapchainImageSlider.mMax = MAX_SWAPCHAIN_IMAGES;
+		swapchainImageSlider.mStep = 1;
+		UIWidget* pSwapchainImages = uiCreateComponentWidget(pGuiWindow, "Swapchain Images", &swapchainImageSlider, WIDGET_TYPE_SLIDER_UINT);
+		uiSetWidgetOnEditedCallback(pSwapchainImages, nullptr, [](void* pUserData) {
+			ReloadDesc reloadDesc = { RELOAD_TYPE_RESIZE };
+			requestReload(&reloadDesc);
+			});
+		luaRegisterWidget(pSwapchainImages);
 		
 		// light spawn box scale
 		SliderFloatWidget floatSlider;
@@ -550,7 +1898,7 @@ public:
 		// num of light slider
 		SliderUintWidget numLightSlider;
 		numLightSlider.mMin = 1;
-		numLightSlider.mMax = MAX_LIGHTS;
+		numLightSlider.mMax = gMaxLightCount;
 		numLightSlider.mStep = 1;
 		numLightSlider.pData = &gCurrentLightCount;
 		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Number of Lights", &numLightSlider, WIDGET_TYPE_SLIDER_UINT));
@@ -567,6 +1915,13 @@ public:
 		uiSetWidgetOnEditedCallback(pScenearioButton, nullptr, scenarioLightPosition);
 		luaRegisterWidget(pScenearioButton);
 
+		ButtonWidget cpuCullBenchmarkButton;
+		UIWidget* pCpuCullBenchmarkButton = uiCreateComponentWidget(pGuiWindow, "CPU Tile Cull Benchmark", &cpuCullBenchmarkButton, WIDGET_TYPE_BUTTON);
+		uiSetWidgetOnEditedCallback(pCpuCullBenchmarkButton, nullptr, [](void* pUserData) {
+			bRunCpuCullBenchmark = true;
+			});
+		luaRegisterWidget(pCpuCullBenchmarkButton);
+
 		// lion position
 		SliderFloat3Widget float3Slider;
 		float3Slider.mMin = float3(-10.0f);
@@ -586,13 +1941,48 @@ public:
 		floatSlider.pData = &gObjectInfo[LION_MODEL].mScale;
 		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Lion Scale", &floatSlider, WIDGET_TYPE_SLIDER_FLOAT));
 
-		static const char* enumTileCullModeNames[] = { "Basic Deferred Rendering","Tile Culling Baseline", "Tile Culling Half-Z", "Tile Culling Modified - Z"};
+		// instanced lions in one draw, the first "Moving Lion Instances" of them turn every frame
+		SliderUintWidget instanceSlider;
+		instanceSlider.mMin = 0;
+		instanceSlider.mMax = OBJECT_INSTANCE_CAPACITY;
+		instanceSlider.mStep = 256;
+		instanceSlider.pData = &gObjectInstanceCount;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Lion Instances", &instanceSlider, WIDGET_TYPE_SLIDER_UINT));
+		instanceSlider.pData = &gMovingObjectInstanceCount;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Moving Lion Instances", &instanceSlider, WIDGET_TYPE_SLIDER_UINT));
+
 		DropdownWidget ddCullMode;
 		ddCullMode.pData = &gTileCullMode;
-		ddCullMode.pNames = enumTileCullModeNames;
-		ddCullMode.mCount = sizeof(enumTileCullModeNames) / sizeof(enumTileCullModeNames[0]);
+		ddCullMode.pNames = gTileCullModeNames;
+		ddCullMode.mCount = gTileCullModeCount;
 		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Render Mode", &ddCullMode, WIDGET_TYPE_DROPDOWN));
 
+		DropdownWidget ddLightList;
+		ddLightList.pData = &gLightListEncoding;
+		ddLightList.pNames = gLightListEncodingNames;
+		ddLightList.mCount = LIGHT_LIST_ENCODING_COUNT;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Light List Encoding", &ddLightList, WIDGET_TYPE_DROPDOWN));
+
+		DropdownWidget ddTileSize;
+		ddTileSize.pData = &gTileSize;
+		ddTileSize.pNames = gTileSizeNames;
+		ddTileSize.mCount = TILE_SIZE_COUNT;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Tile Size", &ddTileSize, WIDGET_TYPE_DROPDOWN));
+
+		// times every tile size with the current render mode, resolution and lights, then keeps the fastest
+		ButtonWidget tileSizeTuningButton;
+		UIWidget* pTileSizeTuningButton = uiCreateComponentWidget(pGuiWindow, "Auto-Tune Tile Size", &tileSizeTuningButton, WIDGET_TYPE_BUTTON);
+		uiSetWidgetOnEditedCallback(pTileSizeTuningButton, nullptr, startTileSizeTuning);
+		luaRegisterWidget(pTileSizeTuningButton);
+
+		// overflow counters of the latest culling pass read back
+		static float4 lightOverflowTextColor = float4(1.0f, 1.0f, 1.0f, 1.0f);
+		DynamicTextWidget lightOverflowText;
+		lightOverflowText.pText = gLightOverflowText;
+		lightOverflowText.mLength = sizeof(gLightOverflowText);
+		lightOverflowText.pColor = &lightOverflowTextColor;
+		luaRegisterWidget(uiCreateComponentWidget(pGuiWindow, "Tile Light Overflow", &lightOverflowText, WIDGET_TYPE_DYNAMIC_TEXT));
+
 		// Camera Control & Input setting
 		{
 			CameraMotionParameters cmp{ 16.0f, 60.0f, 20.0f };
@@ -655,7 +2045,37 @@ public:
 			setGlobalInputAction(&globalInputActionDesc);
 		}
 
-		assignSponzaTextures();
+		addMaterials();
+		addDrawBuffers();
+		addLightOverflowBuffers();
+
+		// Load Texture
+		addMaterialPlaceholders();
+		initHiresTimer(&gMaterialTextureTimer);
+		gMaterialTexturesPending = TOTAL_IMGS;
+		for (uint32_t i = TOTAL_IMGS; i < MAX_MATERIAL_TEXTURES; ++i)
+			pMaterialTextures[i] = pMaterialPlaceholders[MATERIAL_PLACEHOLDER_WHITE];
+		for (uint32_t i = 0; i < TOTAL_IMGS; ++i) {
+			pMaterialTextures[i] = pMaterialPlaceholders[getMaterialPlaceholder(pMaterialImageFileNames[i])];
+			TextureLoadDesc texLoadDesc = {};
+			texLoadDesc.pFileName = pMaterialImageFileNames[i];
+			texLoadDesc.ppTexture = &pStreamedMaterialTextures[i];
+			if (strstr(pMaterialImageFileNames[i], "Albedo") || strstr(pMaterialImageFileNames[i], "diffuse"))
+			{
+				// Textures representing color should be stored in SRGB or HDR format
+				texLoadDesc.mCreationFlag = TEXTURE_CREATION_FLAG_SRGB;
+			}
+
+			addResource(&texLoadDesc, &gMaterialTextureTokens[i]);
+		}
+
+		// Requested last: the loader completes in order, so nothing before this waits for the textures. They stream in behind
+		// the placeholders while frames are rendered. The benchmark waits for them so that every run shades the same textures.
+		if (gBenchmarkFramesPerMode)
+		{
+			waitForAllResourceLoads();
+			swapInStreamedMaterialTextures();
+		}
 
 		gFrameIndex = 0; 
 
@@ -664,6 +2084,15 @@ public:
 
 	void Exit()
 	{
+		exitThreadSystem(pThreadSystem);
+		exitLightBVH(&gLightBVH);
+		exitLightAnimation(&gLightAnimation);
+		exitDrawCullCpu(&gDrawCullCpu);
+
+		if (bCpuBenchmarkOnly)
+			return;
+
+		exitObjectInstances(&gObjectInstances);
 		exitInputSystem();
 
 		exitCameraController(pCameraController);
@@ -675,16 +2104,34 @@ public:
 		// Exit profile
 		exitProfiler();
 		
+		if (pBenchmarkQueryPool)
+		{
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
+				removeResource(pBenchmarkQueryReadbackBuffer[i]);
+			removeQueryPool(pRenderer, pBenchmarkQueryPool);
+			tf_free(pBenchmarkFrames);
+		}
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			removeResource(pTileSizeQueryReadbackBuffer[i]);
+		removeQueryPool(pRenderer, pTileSizeQueryPool);
+
 		// Remove Uniform Buffer
-		for(uint32_t i = 0; i < gDataBufferCount; ++i) 
+		for(uint32_t i = 0; i < gFramesInFlight; ++i) 
 		{
 			removeResource(pCameraBuffer[i]);
 			removeResource(pExtCameraBuffer[i]);
 			removeResource(pTileCullDataBuffer[i]);
-			removeResource(pLightPosAndRadiusBuffer[i]);
-			removeResource(pLightColorAndIntensityBuffer[i]);
 		}
 
+		removeLightBuffers();
+		tf_free(gLightPositionAndRadius);
+		tf_free(gLightColorAndIntensity);
+		tf_free(gGbufferDraws);
+		removeDrawBuffers();
+		removeLightOverflowBuffers();
+		LOGF(eINFO, "Tile light overflow: %u frames overflowed, peak %u tile lists / %u spilled / %u dropped lights, at most %u lights per tile (MAX_NUM_LIGHTS_PER_TILE %u)",
+			gLightOverflowFrames, gLightOverflowPeak.mOverflowTiles, gLightOverflowPeak.mSpilledLights, gLightOverflowPeak.mDroppedLights,
+			gLightOverflowPeak.mMaxTileLights, (uint32_t)MAX_NUM_LIGHTS_PER_TILE);
 
 		// Remove Geomtry
 		for (uint32_t i = 0; i < MODEL_COUNT; ++i) 
@@ -694,21 +2141,44 @@ public:
 
 		removeResource(pScreenQuadVertexBuffer);
 
-		// Remove Texture
+		// Remove Texture, the ones still streaming are finished first
+		waitForAllResourceLoads();
 		for (uint32_t i = 0; i < TOTAL_IMGS; ++i) 
 		{
-			if (pMaterialTextures[i])
+			if (pStreamedMaterialTextures[i])
 			{
-				removeResource(pMaterialTextures[i]);
+				removeResource(pStreamedMaterialTextures[i]);
 			}
 		}
+		for (uint32_t i = 0; i < MATERIAL_PLACEHOLDER_COUNT; ++i)
+			removeResource(pMaterialPlaceholders[i]);
 
 		removeSampler(pRenderer, pSamplerBilinear);
 
+		if (pPipelineCache)
+		{
+			writePipelineCacheFile(pRenderer, pPipelineCache, gPipelineCacheFileName, gShaderHash);
+			removePipelineCache(pRenderer, pPipelineCache);
+		}
+		tf_free(gPipelineCacheFile.pData);
+		tf_free(gMaterials);
+
 		exitResourceLoaderInterface(pRenderer);
 		exitScreenshotInterface();
 
 		removeSemaphore(pRenderer, pImageAcquiredSemaphore);
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			for (uint32_t t = 0; t < GBUFFER_MAX_RECORD_TASKS; ++t)
+			{
+				removeCmd(pRenderer, pGbufferCmds[i][t]);
+				removeCmdPool(pRenderer, pGbufferCmdPools[i][t]);
+			}
+			removeSemaphore(pRenderer, pGbufferDoneSemaphores[i]);
+			removeSemaphore(pRenderer, pCullDoneSemaphores[i]);
+		}
+		removeGpuCmdRing(pRenderer, &gComputeCmdRing);
+		removeQueue(pRenderer, pComputeQueue);
 		removeGpuCmdRing(pRenderer, &gGraphicsCmdRing);
 		removeQueue(pRenderer, pGraphicsQueue);
 
@@ -718,15 +2188,28 @@ public:
 
 	bool Load(ReloadDesc* pReloadDesc)
 	{
+		if (bCpuBenchmarkOnly)
+			return true;
+
+		HiresTimer loadTimer;
+		initHiresTimer(&loadTimer);
+		float shadersMs = 0.0f;
+		float targetsMs = 0.0f;
+		float pipelinesMs = 0.0f;
+
 		if (pReloadDesc->mType & RELOAD_TYPE_SHADER)
 		{
 			addShaders();
+			if (!pPipelineCache)
+				addPipelineCacheFromFile(pRenderer, &gPipelineCacheFile, gShaderHash, &pPipelineCache);
 			addRootSignatures();
 			addDescriptorSets();
+			shadersMs = (float)getHiresTimerUSec(&loadTimer, true) / 1000.0f;
 		}
 
 		if (pReloadDesc->mType & (RELOAD_TYPE_RESIZE | RELOAD_TYPE_RENDERTARGET))
 		{
+			getHiresTimerUSec(&loadTimer, true);
 			if (!addSwapChain())
 				return false;
 
@@ -739,13 +2222,20 @@ public:
 			if (!addSceneBuffer())
 				return false;
 
+			addLightGridBuffers();
+			targetsMs = (float)getHiresTimerUSec(&loadTimer, true) / 1000.0f;
 		}
 
 		if (pReloadDesc->mType & (RELOAD_TYPE_SHADER | RELOAD_TYPE_RENDERTARGET))
 		{
+			getHiresTimerUSec(&loadTimer, true);
 			addPipelines();
+			pipelinesMs = (float)getHiresTimerUSec(&loadTimer, true) / 1000.0f;
 		}
 
+		LOGF(eINFO, "Load (reload type 0x%x): shaders %.2f ms, swapchain and targets %.2f ms, pipelines %.2f ms", (uint32_t)pReloadDesc->mType, shadersMs,
+			targetsMs, pipelinesMs);
+
 		prepareDescriptorSets();
 
 		UserInterfaceLoadDesc uiLoad = {};
@@ -767,7 +2257,13 @@ public:
 
 	void Unload(ReloadDesc* pReloadDesc)
 	{
+		if (bCpuBenchmarkOnly)
+			return;
+
+		// the pending composition still holds a swapchain image and the descriptor sets about to be rewritten
+		submitPendingComposite();
 		waitQueueIdle(pGraphicsQueue);
+		waitQueueIdle(pComputeQueue);
 
 		unloadFontSystem(pReloadDesc->mType);
 		unloadUserInterface(pReloadDesc->mType);
@@ -780,13 +2276,14 @@ public:
 		if (pReloadDesc->mType & (RELOAD_TYPE_RESIZE | RELOAD_TYPE_RENDERTARGET))
 		{
 			removeSwapChain(pRenderer, pSwapChain);
-			removeRenderTarget(pRenderer, pDepthBuffer);
-			removeRenderTarget(pRenderer, pSceneBuffer);
-
-			for (uint32_t i = 0; i < DEFERRED_RT_COUNT; ++i)
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
 			{
-				removeRenderTarget(pRenderer, pGbufferRenderTargets[i]);
+				removeRenderTarget(pRenderer, pDepthBuffer[i]);
+				removeRenderTarget(pRenderer, pSceneBuffer[i]);
+				for (uint32_t rt = 0; rt < DEFERRED_RT_COUNT; ++rt)
+					removeRenderTarget(pRenderer, pGbufferRenderTargets[i][rt]);
 			}
+			removeLightGridBuffers();
 		}
 
 		if (pReloadDesc->mType & RELOAD_TYPE_SHADER)
@@ -797,44 +2294,666 @@ public:
 		}
 	}
 
-	void updateLightPosition(float deltaTime)
+	uint32_t getSponzaVertex(const void* pIndices, const IndirectDrawIndexArguments& args, uint32_t index)
 	{
-		static float currentTime = 0.0f;
-		currentTime += deltaTime * 10.0f;
-		
-		// rotate based on initial Light position(gInitLightPos) with speed(10.0f)
-		for (uint32_t i = 0; i < gUniformTileCullData.mNumOfLights; ++i)
-			gLightPositionAndRadius[i].setXYZ(vec3(gInitLightPos[i].x + cos(degToRad(currentTime)) * gInitLightPos[i].y, gInitLightPos[i].y + sin(degToRad(currentTime)) * gInitLightPos[i].x, gInitLightPos[i].z));
+		const Geometry* pSponza = gModels[SPONZA_MODEL];
+		return args.mVertexOffset + (pSponza->mIndexType == INDEX_TYPE_UINT16 ? ((const uint16_t*)pIndices)[index] : ((const uint32_t*)pIndices)[index]);
+	}
+
+	vec3 getSponzaPosition(const float3* pPositions, const void* pIndices, const IndirectDrawIndexArguments& args, uint32_t index)
+	{
+		return f3Tov3(pPositions[getSponzaVertex(pIndices, args, index)]);
+	}
+
+	/**
+	 * @brief Sorts the Sponza submeshes into gDrawQueue and returns their indices in queue order for pBatchedIndexBuffer.
+	 */
+	uint32_t* buildDrawQueue(const void* pIndices, uint32_t* pIndexCount)
+	{
+		const Geometry* pSponza = gModels[SPONZA_MODEL];
+		const uint32_t sponzaDrawCount = pSponza->mDrawArgCount;
+		uint64_t* pKeys = (uint64_t*)tf_malloc(sponzaDrawCount * sizeof(uint64_t));
+		uint32_t indexCount = 0;
+		gDrawQueueOpaqueCount = 0;
+		for (uint32_t i = 0; i < sponzaDrawCount; ++i)
+		{
+			const bool alphaBlended = isAlphaBlendedMaterial(gMaterialIds[i]);
+			pKeys[i] = makeDrawSortKey(alphaBlended ? DRAW_QUEUE_FORWARD_PLUS : DRAW_QUEUE_GBUFFER, gMaterialIds[i], SPONZA_MODEL, i);
+			gDrawQueueOpaqueCount += alphaBlended ? 0 : 1;
+			indexCount += pSponza->pDrawArgs[i].mIndexCount;
+		}
+		qsort(pKeys, sponzaDrawCount, sizeof(uint64_t), compareDrawSortKeys);
+
+		gDrawQueue = (GbufferDraw*)tf_malloc(sponzaDrawCount * sizeof(GbufferDraw));
+		gDrawQueueCount = sponzaDrawCount;
+		uint32_t* pBatchedIndices = (uint32_t*)tf_malloc(max(indexCount, 1u) * sizeof(uint32_t));
+		uint32_t startIndex = 0;
+		for (uint32_t q = 0; q < sponzaDrawCount; ++q)
+		{
+			const uint32_t i = getDrawSortKeySubmesh(pKeys[q]);
+			const IndirectDrawIndexArguments& args = pSponza->pDrawArgs[i];
+			for (uint32_t index = 0; index < args.mIndexCount; ++index)
+				pBatchedIndices[startIndex + index] = getSponzaVertex(pIndices, args, args.mStartIndex + index);
+			gDrawQueue[q] = { i, SPONZA_BATCHED_MODEL, (uint32_t)gMaterialIds[i], args.mIndexCount, startIndex, 0, 1 };
+			startIndex += args.mIndexCount;
+		}
+		tf_free(pKeys);
+
+		*pIndexCount = indexCount;
+		return pBatchedIndices;
+	}
+
+	/**
+	 * @brief Creates the per draw data, bounds and indirect arguments of the Gbuffer draws, the draw index buffer and the per frame object / culling uniforms.
+	 */
+	void addDrawBuffers()
+	{
+		Geometry* pSponza = gModels[SPONZA_MODEL];
+		const uint32_t sponzaDrawCount = pSponza->mDrawArgCount;
+		gDrawCount = sponzaDrawCount + MODEL_COUNT - 1;
+		const uint32_t drawIdCount = gDrawCount + OBJECT_INSTANCE_CAPACITY;
+
+		DrawData* pDrawData = (DrawData*)tf_calloc(drawIdCount, sizeof(DrawData));
+		IndirectDrawIndexArguments* pDrawArgs = (IndirectDrawIndexArguments*)tf_calloc(gDrawCount, sizeof(IndirectDrawIndexArguments));
+		uint32_t* pDrawIds = (uint32_t*)tf_malloc(drawIdCount * sizeof(uint32_t));
+		gDrawBounds = (vec4*)tf_calloc(gDrawCount * 2, sizeof(vec4));
+		float* pSurfaceAreas = (float*)tf_calloc(sponzaDrawCount, sizeof(float));
+
+		const float3* pPositions = (const float3*)pSponza->pShadow->pAttributes[SEMANTIC_POSITION];
+		const void* pIndices = pSponza->pShadow->pIndices;
+		for (uint32_t i = 0; i < gDrawCount; ++i)
+		{
+			pDrawIds[i] = i;
+			if (i >= sponzaDrawCount)
+				continue;
+
+			const int materialID = gMaterialIds[i];
+			pDrawData[i].mObjectIndex = SPONZA_MODEL;
+			pDrawData[i].mFlags = isAlphaBlendedMaterial(materialID) ? DRAW_FLAG_ALPHA_BLENDED : 0;
+			pDrawData[i].mMaterialId = materialID;
+
+			pDrawArgs[i] = pSponza->pDrawArgs[i];
+			pDrawArgs[i].mInstanceCount = 1;
+			pDrawArgs[i].mStartInstance = i;
+
+			// local space box of the submesh, and its surface area to pick the CPU occluders
+			const IndirectDrawIndexArguments& args = pSponza->pDrawArgs[i];
+			vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+			for (uint32_t index = args.mStartIndex; index + 2 < args.mStartIndex + args.mIndexCount; index += 3)
+			{
+				const vec3 triangle[3] = { getSponzaPosition(pPositions, pIndices, args, index + 0), getSponzaPosition(pPositions, pIndices, args, index + 1),
+					getSponzaPosition(pPositions, pIndices, args, index + 2) };
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					boxMin = minPerElem(boxMin, triangle[k]);
+					boxMax = maxPerElem(boxMax, triangle[k]);
+				}
+				pSurfaceAreas[i] += 0.5f * length(cross(triangle[1] - triangle[0], triangle[2] - triangle[0]));
+			}
+			gDrawBounds[i * 2 + 0] = vec4((boxMin + boxMax) * 0.5f, 0.0f);
+			gDrawBounds[i * 2 + 1] = vec4((boxMax - boxMin) * 0.5f, 0.0f);
+		}
+
+		// the opaque submeshes with the largest surface become the software occluders, as long as the triangle budget lasts
+		setDrawCullCpuBounds(&gDrawCullCpu, gDrawBounds, sponzaDrawCount);
+		vec3* pOccluderVertices = (vec3*)tf_malloc(DRAW_CULL_CPU_MAX_OCCLUDER_TRIANGLES * 3 * sizeof(vec3));
+		for (uint32_t o = 0; o < DRAW_CULL_CPU_MAX_OCCLUDERS; ++o)
+		{
+			uint32_t largest = UINT32_MAX;
+			for (uint32_t i = 0; i < sponzaDrawCount; ++i)
+			{
+				if (!isAlphaBlendedMaterial(gMaterialIds[i]) && pSurfaceAreas[i] > 0.0f && (largest == UINT32_MAX || pSurfaceAreas[i] > pSurfaceAreas[largest]))
+					largest = i;
+			}
+			if (largest == UINT32_MAX)
+				break;
+			pSurfaceAreas[largest] = 0.0f;
+
+			const IndirectDrawIndexArguments& args = pSponza->pDrawArgs[largest];
+			const uint32_t triangleCount = args.mIndexCount / 3;
+			if (triangleCount > DRAW_CULL_CPU_MAX_OCCLUDER_TRIANGLES)
+				continue;
+
+			for (uint32_t index = 0; index < triangleCount * 3; ++index)
+				pOccluderVertices[index] = getSponzaPosition(pPositions, pIndices, args, args.mStartIndex + index);
+			addDrawCullCpuOccluder(&gDrawCullCpu, largest, pOccluderVertices, triangleCount);
+		}
+		tf_free(pOccluderVertices);
+		tf_free(pSurfaceAreas);
+
+		uint32_t batchedIndexCount = 0;
+		uint32_t* pBatchedIndices = buildDrawQueue(pIndices, &batchedIndexCount);
+		removeGeometryShadowData(pSponza);
+
+		for (uint32_t i = 1; i < MODEL_COUNT; ++i)
+		{
+			DrawData& drawData = pDrawData[sponzaDrawCount + i - 1];
+			drawData.mObjectIndex = i;
+			drawData.mMaterialId = gObjectInfo[i].mMaterialId;
+		}
+
+		for (uint32_t i = 0; i < OBJECT_INSTANCE_CAPACITY; ++i)
+		{
+			DrawData& drawData = pDrawData[gDrawCount + i];
+			drawData.mObjectIndex = MODEL_COUNT + i;
+			drawData.mMaterialId = gObjectInfo[LION_MODEL].mMaterialId;
+			pDrawIds[gDrawCount + i] = gDrawCount + i;
+		}
+
+		BufferLoadDesc drawBuffDesc = {};
+		drawBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+		drawBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+		drawBuffDesc.mDesc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+		drawBuffDesc.mDesc.mFirstElement = 0;
+
+		drawBuffDesc.mDesc.pName = "Draw Data";
+		drawBuffDesc.mDesc.mElementCount = drawIdCount;
+		drawBuffDesc.mDesc.mStructStride = sizeof(DrawData);
+		drawBuffDesc.mDesc.mSize = drawBuffDesc.mDesc.mElementCount * drawBuffDesc.mDesc.mStructStride;
+		drawBuffDesc.pData = pDrawData;
+		drawBuffDesc.ppBuffer = &pDrawDataBuffer;
+		addResource(&drawBuffDesc, NULL);
+
+		drawBuffDesc.mDesc.pName = "Material Data";
+		drawBuffDesc.mDesc.mElementCount = gMaterialCount;
+		drawBuffDesc.mDesc.mStructStride = sizeof(MaterialData);
+		drawBuffDesc.mDesc.mSize = drawBuffDesc.mDesc.mElementCount * drawBuffDesc.mDesc.mStructStride;
+		drawBuffDesc.pData = gMaterials;
+		drawBuffDesc.ppBuffer = &pMaterialBuffer;
+		addResource(&drawBuffDesc, NULL);
+
+		drawBuffDesc.mDesc.pName = "Draw Bounds";
+		drawBuffDesc.mDesc.mElementCount = gDrawCount * 2;
+		drawBuffDesc.mDesc.mStructStride = sizeof(vec4);
+		drawBuffDesc.mDesc.mSize = drawBuffDesc.mDesc.mElementCount * drawBuffDesc.mDesc.mStructStride;
+		drawBuffDesc.pData = gDrawBounds;
+		drawBuffDesc.ppBuffer = &pDrawBoundsBuffer;
+		addResource(&drawBuffDesc, NULL);
+
+		drawBuffDesc.mDesc.pName = "Draw Args";
+		drawBuffDesc.mDesc.mFormat = TinyImageFormat_R32_UINT;
+		drawBuffDesc.mDesc.mElementCount = gDrawCount * 5;
+		drawBuffDesc.mDesc.mStructStride = sizeof(uint32_t);
+		drawBuffDesc.mDesc.mSize = drawBuffDesc.mDesc.mElementCount * drawBuffDesc.mDesc.mStructStride;
+		drawBuffDesc.pData = pDrawArgs;
+		drawBuffDesc.ppBuffer = &pDrawArgsBuffer;
+		addResource(&drawBuffDesc, NULL);
+
+		drawBuffDesc.mDesc.pName = "Visible Draw Args";
+		drawBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_RW_BUFFER | DESCRIPTOR_TYPE_INDIRECT_BUFFER;
+		drawBuffDesc.mDesc.mStartState = RESOURCE_STATE_INDIRECT_ARGUMENT;
+		drawBuffDesc.mDesc.mElementCount = sponzaDrawCount * 5;
+		drawBuffDesc.mDesc.mSize = drawBuffDesc.mDesc.mElementCount * drawBuffDesc.mDesc.mStructStride;
+		drawBuffDesc.pData = NULL;
+		drawBuffDesc.ppBuffer = &pVisibleDrawArgsBuffer;
+		addResource(&drawBuffDesc, NULL);
+
+		drawBuffDesc.mDesc.pName = "Visible Draw Count";
+		drawBuffDesc.mDesc.mElementCount = 1;
+		drawBuffDesc.mDesc.mSize = sizeof(uint32_t);
+		drawBuffDesc.ppBuffer = &pVisibleDrawCountBuffer;
+		addResource(&drawBuffDesc, NULL);
+
+		// zero copied over the visible draw count before the culling pass
+		static const uint32_t zero = 0;
+		drawBuffDesc.mDesc.pName = "Visible Draw Count Reset";
+		drawBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNDEFINED;
+		drawBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
+		drawBuffDesc.mDesc.mStartState = RESOURCE_STATE_COPY_SOURCE;
+		drawBuffDesc.pData = &zero;
+		drawBuffDesc.ppBuffer = &pVisibleDrawCountResetBuffer;
+		addResource(&drawBuffDesc, NULL);
+
+		drawBuffDesc = {};
+		drawBuffDesc.mDesc.pName = "Batched Sponza Indices";
+		drawBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_INDEX_BUFFER;
+		drawBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+		drawBuffDesc.mDesc.mStartState = RESOURCE_STATE_INDEX_BUFFER;
+		drawBuffDesc.mDesc.mSize = max(batchedIndexCount, 1u) * sizeof(uint32_t);
+		drawBuffDesc.pData = pBatchedIndices;
+		drawBuffDesc.ppBuffer = &pBatchedIndexBuffer;
+		addResource(&drawBuffDesc, NULL);
+
+		drawBuffDesc = {};
+		drawBuffDesc.mDesc.pName = "Draw Ids";
+		drawBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_VERTEX_BUFFER;
+		drawBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+		drawBuffDesc.mDesc.mStartState = RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
+		drawBuffDesc.mDesc.mSize = drawIdCount * sizeof(uint32_t);
+		drawBuffDesc.pData = pDrawIds;
+		drawBuffDesc.ppBuffer = &pDrawIdBuffer;
+		addResource(&drawBuffDesc, NULL);
+
+		BufferLoadDesc objectBuffDesc = {};
+		objectBuffDesc.mDesc.pName = "Object Buffer";
+		objectBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+		objectBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+		objectBuffDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+		objectBuffDesc.mDesc.mFirstElement = 0;
+		objectBuffDesc.mDesc.mElementCount = MODEL_COUNT + OBJECT_INSTANCE_CAPACITY;
+		objectBuffDesc.mDesc.mStructStride = sizeof(mat4);
+		objectBuffDesc.mDesc.mSize = objectBuffDesc.mDesc.mElementCount * objectBuffDesc.mDesc.mStructStride;
+
+		BufferLoadDesc drawCullBuffDesc = {};
+		drawCullBuffDesc.mDesc.pName = "Draw Cull Uniform";
+		drawCullBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		drawCullBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+		drawCullBuffDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+		drawCullBuffDesc.mDesc.mSize = sizeof(UniformDrawCullData);
+
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			objectBuffDesc.ppBuffer = &pObjectBuffer[i];
+			addResource(&objectBuffDesc, NULL);
+			drawCullBuffDesc.ppBuffer = &pDrawCullUniformBuffer[i];
+			addResource(&drawCullBuffDesc, NULL);
+		}
+
+		waitForAllResourceLoads();
+		tf_free(pDrawData);
+		tf_free(pDrawArgs);
+		tf_free(pDrawIds);
+		tf_free(pBatchedIndices);
+	}
+
+	void removeDrawBuffers()
+	{
+		removeResource(pDrawDataBuffer);
+		removeResource(pMaterialBuffer);
+		removeResource(pDrawBoundsBuffer);
+		removeResource(pDrawArgsBuffer);
+		removeResource(pDrawIdBuffer);
+		removeResource(pBatchedIndexBuffer);
+		removeResource(pVisibleDrawArgsBuffer);
+		removeResource(pVisibleDrawCountBuffer);
+		removeResource(pVisibleDrawCountResetBuffer);
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			removeResource(pObjectBuffer[i]);
+			removeResource(pDrawCullUniformBuffer[i]);
+		}
+		tf_free(gDrawBounds);
+		tf_free(gDrawQueue);
+		gDrawQueue = NULL;
+		gDrawQueueCount = 0;
+	}
+
+	void addLightOverflowBuffers()
+	{
+		BufferLoadDesc overflowDesc = {};
+		overflowDesc.mDesc.pName = "Light Overflow";
+		overflowDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_RW_BUFFER | DESCRIPTOR_TYPE_BUFFER;
+		overflowDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+		// read by the Forward+ pass between two culling passes, like the light grid
+		overflowDesc.mDesc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+		overflowDesc.mDesc.mFormat = TinyImageFormat_R32G32_UINT;
+		overflowDesc.mDesc.mElementCount = LIGHT_OVERFLOW_CAPACITY;
+		overflowDesc.mDesc.mStructStride = sizeof(uint2);
+		overflowDesc.mDesc.mSize = overflowDesc.mDesc.mElementCount * overflowDesc.mDesc.mStructStride;
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			overflowDesc.ppBuffer = &pLightOverflowBuffer[i];
+			addResource(&overflowDesc, NULL);
+		}
+
+		overflowDesc.mDesc.pName = "Light Overflow Counters";
+		overflowDesc.mDesc.mStartState = RESOURCE_STATE_UNORDERED_ACCESS;
+		overflowDesc.mDesc.mFormat = TinyImageFormat_R32_UINT;
+		overflowDesc.mDesc.mElementCount = LIGHT_OVERFLOW_COUNTER_COUNT;
+		overflowDesc.mDesc.mStructStride = sizeof(uint32_t);
+		overflowDesc.mDesc.mSize = overflowDesc.mDesc.mElementCount * overflowDesc.mDesc.mStructStride;
+		overflowDesc.ppBuffer = &pLightOverflowCounterBuffer;
+		addResource(&overflowDesc, NULL);
+
+		// zeros copied over the counters before every culling pass
+		static const uint32_t zeros[LIGHT_OVERFLOW_COUNTER_COUNT] = {};
+		overflowDesc.mDesc.pName = "Light Overflow Counters Reset";
+		overflowDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNDEFINED;
+		overflowDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_ONLY;
+		overflowDesc.mDesc.mStartState = RESOURCE_STATE_COPY_SOURCE;
+		overflowDesc.pData = zeros;
+		overflowDesc.ppBuffer = &pLightOverflowCounterResetBuffer;
+		addResource(&overflowDesc, NULL);
+
+		overflowDesc = {};
+		overflowDesc.mDesc.pName = "Light Overflow Counters Readback";
+		overflowDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNDEFINED;
+		overflowDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_TO_CPU;
+		overflowDesc.mDesc.mStartState = RESOURCE_STATE_COPY_DEST;
+		overflowDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+		overflowDesc.mDesc.mSize = LIGHT_OVERFLOW_COUNTER_COUNT * sizeof(uint32_t);
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			overflowDesc.ppBuffer = &pLightOverflowReadbackBuffer[i];
+			addResource(&overflowDesc, NULL);
+		}
+
+		waitForAllResourceLoads();
+	}
+
+	void removeLightOverflowBuffers()
+	{
+		removeResource(pLightOverflowCounterBuffer);
+		removeResource(pLightOverflowCounterResetBuffer);
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			removeResource(pLightOverflowBuffer[i]);
+			removeResource(pLightOverflowReadbackBuffer[i]);
+		}
+	}
+
+	void addLightBuffers()
+	{
+		BufferLoadDesc lightPosBuffDesc = {};
+		lightPosBuffDesc.mDesc.pName = "lightPosBuff";
+		lightPosBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+		lightPosBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+		lightPosBuffDesc.mDesc.mStartState = RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+		lightPosBuffDesc.mDesc.mStructStride = gLightElementSize;
+		lightPosBuffDesc.mDesc.mFirstElement = 0;
+		lightPosBuffDesc.mDesc.mElementCount = gLightCapacity * gLightBufferElementsPerLight[0];
+		lightPosBuffDesc.mDesc.mSize = lightPosBuffDesc.mDesc.mStructStride * lightPosBuffDesc.mDesc.mElementCount;
+		lightPosBuffDesc.pData = NULL;
+
+		BufferLoadDesc lightColorBuffDesc = {};
+		lightColorBuffDesc.mDesc.pName = "lightColorBuff";
+		lightColorBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+		lightColorBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+		lightColorBuffDesc.mDesc.mStartState = RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+		lightColorBuffDesc.mDesc.mStructStride = gLightElementSize;
+		lightColorBuffDesc.mDesc.mFirstElement = 0;
+		lightColorBuffDesc.mDesc.mElementCount = gLightCapacity * gLightBufferElementsPerLight[1];
+		lightColorBuffDesc.mDesc.mSize = lightColorBuffDesc.mDesc.mStructStride * lightColorBuffDesc.mDesc.mElementCount;
+		lightColorBuffDesc.pData = NULL;
+
+		// 32 bytes per node, about one node per light
+		BufferLoadDesc lightBVHNodeBuffDesc = {};
+		lightBVHNodeBuffDesc.mDesc.pName = "lightBVHNodeBuff";
+		lightBVHNodeBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+		lightBVHNodeBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+		lightBVHNodeBuffDesc.mDesc.mStartState = RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+		lightBVHNodeBuffDesc.mDesc.mStructStride = sizeof(float) * 4;
+		lightBVHNodeBuffDesc.mDesc.mFirstElement = 0;
+		lightBVHNodeBuffDesc.mDesc.mElementCount = getLightBVHNodeCapacity(gLightCapacity) * 2;
+		lightBVHNodeBuffDesc.mDesc.mSize = lightBVHNodeBuffDesc.mDesc.mStructStride * lightBVHNodeBuffDesc.mDesc.mElementCount;
+		lightBVHNodeBuffDesc.pData = NULL;
+
+		BufferLoadDesc lightBVHRootBuffDesc = {};
+		lightBVHRootBuffDesc.mDesc.pName = "lightBVHRootBuff";
+		lightBVHRootBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+		lightBVHRootBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+		lightBVHRootBuffDesc.mDesc.mStartState = RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+		lightBVHRootBuffDesc.mDesc.mFormat = TinyImageFormat_R32_UINT;
+		lightBVHRootBuffDesc.mDesc.mStructStride = sizeof(uint32_t);
+		lightBVHRootBuffDesc.mDesc.mFirstElement = 0;
+		lightBVHRootBuffDesc.mDesc.mElementCount = LIGHT_BVH_MAX_ROOTS;
+		lightBVHRootBuffDesc.mDesc.mSize = sizeof(uint32_t) * LIGHT_BVH_MAX_ROOTS;
+		lightBVHRootBuffDesc.pData = NULL;
+
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			lightPosBuffDesc.ppBuffer = &pLightPosAndRadiusBuffer[i];
+			addResource(&lightPosBuffDesc, NULL);
+
+			if (gLightBufferElementsPerLight[1])
+			{
+				lightColorBuffDesc.ppBuffer = &pLightColorAndIntensityBuffer[i];
+				addResource(&lightColorBuffDesc, NULL);
+			}
+
+			lightBVHNodeBuffDesc.ppBuffer = &pLightBVHNodeBuffer[i];
+			addResource(&lightBVHNodeBuffDesc, NULL);
+
+			lightBVHRootBuffDesc.ppBuffer = &pLightBVHRootBuffer[i];
+			addResource(&lightBVHRootBuffDesc, NULL);
+		}
+
+		gLightBufferCapacity = gLightCapacity;
+	}
+
+	void removeLightBuffers()
+	{
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			removeResource(pLightPosAndRadiusBuffer[i]);
+			if (pLightColorAndIntensityBuffer[i])
+				removeResource(pLightColorAndIntensityBuffer[i]);
+			pLightColorAndIntensityBuffer[i] = NULL;
+			removeResource(pLightBVHNodeBuffer[i]);
+			removeResource(pLightBVHRootBuffer[i]);
+		}
+	}
+
+	/**
+	 * @brief Recreates the per-tile buffers for gTileSize and the light index buffers for the capacities read back, between two frames.
+	 */
+	void resizeLightGridBuffers()
+	{
+		submitPendingComposite();
+		waitQueueIdle(pGraphicsQueue);
+		waitQueueIdle(pComputeQueue);
+
+		removeLightGridBuffers();
+		addLightGridBuffers();
+		prepareDescriptorSets();
+	}
+
+	/**
+	 * @brief Reallocates the light buffers after reserveLights() grew the light arrays. Only the descriptor sets are rewritten, no Unload/Load.
+	 */
+	void resizeLightBuffers()
+	{
+		submitPendingComposite();
+		waitQueueIdle(pGraphicsQueue);
+		waitQueueIdle(pComputeQueue);
+
+		removeLightBuffers();
+		addLightBuffers();
+		prepareDescriptorSets();
+
+		// every buffer slot needs the full light data again
+		invalidateDirtyRangeSlots(&gLightPositionTracker);
+		invalidateDirtyRangeSlots(&gLightColorTracker);
+		memset(gLightBVHSlotVersion, 0, sizeof(gLightBVHSlotVersion));
+	}
+
+	/**
+	 * @brief Places the instances on a grid on the floor, seeded random heading, all queued as moved.
+	 */
+	void placeObjectInstances()
+	{
+		std::mt19937 mt(gBenchmarkLightSeed);
+		std::uniform_real_distribution<float> angleDistribution(-PI, PI);
+		const float spacing = 0.2f;
+		const float origin = -0.5f * spacing * (float)(OBJECT_INSTANCE_GRID - 1);
+		for (uint32_t i = 0; i < OBJECT_INSTANCE_CAPACITY; ++i)
+		{
+			const vec3 position(origin + spacing * (float)(i % OBJECT_INSTANCE_GRID), -5.0f, origin + spacing * (float)(i / OBJECT_INSTANCE_GRID));
+			setObjectInstance(&gObjectInstances, i, position, objectInstanceRotationY(angleDistribution(mt)), 0.02f);
+		}
+	}
+
+	/**
+	 * @brief Turns the moving instances and rebuilds the matrices of the instances that moved. The slots copy them in Draw.
+	 */
+	void updateObjectInstances(float deltaTime)
+	{
+		gObjectInstanceCount = min(gObjectInstanceCount, (uint32_t)OBJECT_INSTANCE_CAPACITY);
+		// instances that become visible may be missing in slots that skipped them so far
+		if (gObjectInstanceCount > gLastObjectInstanceCount)
+			markDirtyRange(&gObjectInstanceTracker, gLastObjectInstanceCount, gObjectInstanceCount);
+		gLastObjectInstanceCount = gObjectInstanceCount;
+
+		const uint32_t movingCount = min(gMovingObjectInstanceCount, gObjectInstanceCount);
+		if (movingCount)
+		{
+			gObjectInstanceTime += deltaTime;
+			for (uint32_t i = 0; i < movingCount; ++i)
+				setObjectInstanceRotation(&gObjectInstances, i, objectInstanceRotationY(gObjectInstanceTime + 0.1f * (float)i));
+		}
+
+		uint32_t begin = 0, end = 0;
+		if (updateObjectInstanceMatrices(&gObjectInstances, &begin, &end))
+			markDirtyRange(&gObjectInstanceTracker, begin, end);
+	}
 
-		// update the light buffer until the next 2 frames.
-		gLightFrameCount = 0;
+	/**
+	 * @brief Advances the light animation time. The positions themselves are written by animateLights() in Draw, straight into the slot's buffer.
+	 */
+	void updateLightAnimation(float deltaTime)
+	{
+		if (bDynamicLight)
+		{
+			gLightAnimationTime += deltaTime;
+			// only the positions move, the colors stay uploaded
+			markDirtyRange(&gLightPositionTracker, 0, gUniformTileCullData.mNumOfLights);
+		}
+		else if (bLightsAnimated)
+		{
+			// animation stopped: bring the CPU copy to the last pose so the other slots can catch up through the dirty ranges
+			animateLights(&gLightAnimation, gLightMotion, gLightAnimationTime, gLightPositionAndRadius, NULL);
+			markDirtyRange(&gLightPositionTracker, 0, gUniformTileCullData.mNumOfLights);
+		}
+		bLightsAnimated = bDynamicLight;
 	}
 
 	/**
 	 * @brief Updates light data with randomized value inside a unit cube.
 	 */
-	void randomizeLightPosition()
+	void randomizeLightPosition(uint32_t seed = std::mt19937::default_seed)
 	{
-		std::mt19937 mt;
+		std::mt19937 mt(seed);
 		std::normal_distribution<float> distribution(0.0f, 2.0f);
+		std::uniform_real_distribution<float> radiusDistribution(0.0f, 3.0f);
 		gUniformTileCullData.mNumOfLights = gCurrentLightCount;
+		reserveLights(gCurrentLightCount);
 		
-		// generate N points in unit cube
+		// generate N points in unit cube, as the rest pose of the animation
 		for (uint32_t i = 0; i < gCurrentLightCount; ++i)
 		{
 			float3 v(distribution(mt), distribution(mt), distribution(mt));
-			gInitLightPos[i] = float3(v * gLightSpawnBoxScale);
-			gLightPositionAndRadius[i] = vec4(gInitLightPos[i].x + gInitLightPos[i].y, gInitLightPos[i].y, gInitLightPos[i].z,  randomFloat(0.0f, 3.0f));
+			const float3 restPos = v * gLightSpawnBoxScale;
+			gLightPositionAndRadius[i] = vec4(restPos.x, restPos.y, restPos.z, radiusDistribution(mt));
 			gLightColorAndIntensity[i] = vec4(abs(v[0]), abs(v[1]), abs(v[2]), 1.0f);
 		}
+		resetLightAnimation(&gLightAnimation, gLightPositionAndRadius, gCurrentLightCount, seed);
+		gLightAnimationTime = 0.0f;
+		animateLights(&gLightAnimation, gLightMotion, gLightAnimationTime, gLightPositionAndRadius, NULL);
 
-		// set to light frame count = 0, and update the light buffer per frame
-		gLightFrameCount = 0;
+		markDirtyRange(&gLightPositionTracker, 0, gCurrentLightCount);
+		markDirtyRange(&gLightColorTracker, 0, gCurrentLightCount);
 		bRandomizePosition = false;
 	}
 	
+	/**
+	 * @brief Drives lights, render mode and camera for the current benchmark frame.
+	 * @return false once every frame has been rendered and the results are written.
+	 */
+	bool updateBenchmark()
+	{
+		if (gBenchmarkFrame >= gBenchmarkFrameCount)
+		{
+			// collect the frames still in flight
+			submitPendingComposite();
+			waitQueueIdle(pGraphicsQueue);
+			waitQueueIdle(pComputeQueue);
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			{
+				readLightOverflowCounters(i);
+				readBenchmarkPassTimes(i);
+			}
+
+			writeBenchmarkResults();
+			bBenchmark = false;
+			requestShutdown();
+			return false;
+		}
+
+		const uint32_t segment = gBenchmarkFrame / gBenchmarkFramesPerMode;
+		const uint32_t segmentFrame = gBenchmarkFrame % gBenchmarkFramesPerMode;
+		const uint32_t segmentsPerLightSetup = gTileCullModeCount * gBenchmarkLightListEncodingCount * gBenchmarkDrawBatchingCount;
+		const uint32_t lightSetup = segment / segmentsPerLightSetup;
+
+		if (segment % segmentsPerLightSetup == 0 && segmentFrame == 0)
+		{
+			if (lightSetup == BENCHMARK_LIGHTS_SCENARIO)
+			{
+				scenarioLightPosition(NULL);
+				bDynamicLight = false;
+			}
+			else
+			{
+				gCurrentLightCount = gBenchmarkLightCount;
+				randomizeLightPosition(gBenchmarkLightSeed);
+				bDynamicLight = true;
+			}
+		}
+
+		// every segment replays the same light and instance animation over the same camera path
+		if (segmentFrame == 0)
+		{
+			gLightAnimationTime = 0.0f;
+			gObjectInstanceTime = 0.0f;
+		}
+
+		gTileCullMode = (segment / (gBenchmarkLightListEncodingCount * gBenchmarkDrawBatchingCount)) % gTileCullModeCount;
+		gLightListEncoding = (segment / gBenchmarkDrawBatchingCount) % gBenchmarkLightListEncodingCount;
+		if (gBenchmarkDrawBatchingCount > 1)
+			bDrawBatching = segment % gBenchmarkDrawBatchingCount != 0;
+
+		// same path for every mode: walk down the atrium looking at its far end
+		const float t = (float)segmentFrame / (float)gBenchmarkFramesPerMode;
+		pCameraController->moveTo(vec3(4.0f * sin(2.0f * PI * t), 1.0f, -20.0f + 30.0f * t));
+		pCameraController->lookAt(vec3(0.0f, 2.0f, 30.0f));
+
+		BenchmarkFrame& frame = pBenchmarkFrames[gBenchmarkFrame];
+		frame.mLightSetup = lightSetup;
+		frame.mTileCullMode = gTileCullMode;
+		frame.mLightListEncoding = gLightListEncoding;
+		frame.mLightListBytes = getLightListGroupSharedBytes(gTileCullMode, gLightListEncoding);
+		frame.mNumLights = gCurrentLightCount;
+		frame.mDrawBatching = bDrawBatching ? 1 : 0;
+		return true;
+	}
+
 	void Update(float deltaTime)
 	{
+		if (bCpuBenchmarkOnly)
+		{
+			if (hasCommandLineArgument("-cpuCullBenchmark"))
+				runCpuCullBenchmark();
+			if (hasCommandLineArgument("-lightBvhBenchmark"))
+				runLightBVHBenchmark();
+			if (hasCommandLineArgument("-lightAnimationBenchmark"))
+				benchmarkLightAnimation(pThreadSystem, gMaxLightCount, 60);
+			if (hasCommandLineArgument("-drawCullBenchmark"))
+				benchmarkDrawCullCpu(pThreadSystem, 64 * 1024, 60);
+			if (hasCommandLineArgument("-gbufferPackingCheck"))
+				checkGbufferPacking(1024 * 1024);
+			if (hasCommandLineArgument("-lightPackingBenchmark"))
+				benchmarkLightPacking(pThreadSystem, gMaxLightCount, 60);
+			if (hasCommandLineArgument("-lightLayoutBenchmark"))
+			{
+				const uint32_t lightCounts[] = { 1024, 4096, 16384, 65536 };
+				benchmarkLightLayouts(pThreadSystem, lightCounts, sizeof(lightCounts) / sizeof(lightCounts[0]), 5);
+			}
+			if (hasCommandLineArgument("-objectInstanceBenchmark"))
+				benchmarkObjectInstances(pThreadSystem, OBJECT_INSTANCE_CAPACITY, 60);
+			requestShutdown();
+			return;
+		}
+
+		HiresTimer updateTimer;
+		initHiresTimer(&updateTimer);
+
+		if (bBenchmark)
+		{
+			if (!updateBenchmark())
+				return;
+
+			deltaTime = gBenchmarkDeltaTime;
+		}
+
 		updateInputSystem(deltaTime, mSettings.mWidth, mSettings.mHeight);
 
 		pCameraController->update(deltaTime);
@@ -846,8 +2965,11 @@ public:
 		if (bRandomizePosition)
 			randomizeLightPosition(); // change initial position of lights
 
-		if (bDynamicLight)
-			updateLightPosition(deltaTime); // rotate light based on the initial position of lights
+		updateLightAnimation(deltaTime);
+		updateObjectInstances(deltaTime);
+
+		if (bRunCpuCullBenchmark)
+			runCpuCullBenchmark();
 
 		// update camera 
 		const float aspectInverse = (float)mSettings.mHeight / (float)mSettings.mWidth;
@@ -871,28 +2993,119 @@ public:
 		gUniformExtCamData.mProjectViewInvViewport = gUniformCamData.mProjectViewInv * viewPortMat;
 		gUniformExtCamData.mCamPos = gUniformCamData.mCamPos;
 
-		gUniformTileCullData.mNumTilesX = (mSettings.mWidth + TILE_RES - 1) / TILE_RES;
-		gUniformTileCullData.mNumTilesY = (mSettings.mHeight + TILE_RES - 1) / TILE_RES;
-		gUniformTileCullData.mDebugDraw = bDebugDraw ? 1 : 0;
-		gUniformTileCullData.mResolution = uint2(mSettings.mWidth, mSettings.mHeight);
+		updateTileSizeTuning();
+		gUniformTileCullData.mTileResX = gTileSizes[gTileSize][0];
+		gUniformTileCullData.mTileResY = gTileSizes[gTileSize][1];
+		gUniformTileCullData.mLightBinCapacity = gLightBinCapacity;
+		gUniformTileCullData.mLightGridCapacity = gLightGridCapacity;
+		gUniformTileCullData.mClusterLightCapacity = gClusterLightCapacity;
+		gUniformTileCullData.mNumTilesX = (mSettings.mWidth + gUniformTileCullData.mTileResX - 1) / gUniformTileCullData.mTileResX;
+		gUniformTileCullData.mNumTilesY = (mSettings.mHeight + gUniformTileCullData.mTileResY - 1) / gUniformTileCullData.mTileResY;
+		gUniformTileCullData.mDebugDraw = bDebugDraw ? 1 : 0;
+		gUniformTileCullData.mWriteLightGrid = (bForwardPlus && gTileCullMode != NON_TILE) ? 1 : 0;
+		const uint useLightBVH = (bLightBVH && gTileCullMode != NON_TILE) ? 1 : 0;
+		if (useLightBVH != gUniformTileCullData.mUseLightBVH)
+		{
+			// the BVH buffers of every slot have to be rebuilt
+			gUniformTileCullData.mUseLightBVH = useLightBVH;
+			gLightBVHVersion = 0;
+			memset(gLightBVHSlotVersion, 0, sizeof(gLightBVHSlotVersion));
+		}
+		gUniformTileCullData.mResolution = uint2(mSettings.mWidth, mSettings.mHeight);
+		gUniformTileCullData.mClusterSliceScale = (float)CLUSTER_DEPTH_SLICES / logf(gClusterZFar / gClusterZNear);
+		gUniformTileCullData.mClusterSliceBias = -logf(gClusterZNear) * gUniformTileCullData.mClusterSliceScale;
+
+		if (bBenchmark)
+			pBenchmarkFrames[gBenchmarkFrame].mCpuUpdateMs = (float)getHiresTimerUSec(&updateTimer, false) / 1000.0f;
+	}
+
+	/**
+	 * @brief Blends the alpha materials skipped by the Gbuffer pass on top of the lit scene, reading the light grid written by the culling pass
+	 * (left in the shader resource state by cmdCullPassBarriers).
+	 */
+	void drawForwardPlus(Cmd* cmd, RenderTarget* pRenderTarget, const uint8_t* pDrawCullResults)
+	{
+		RenderTarget* pDepth = pDepthBuffer[gFrameIndex];
+		RenderTargetBarrier rtBarrier = { pDepth, RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_DEPTH_READ };
+		cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, &rtBarrier);
+
+		LoadActionsDesc loadActions = {};
+		loadActions.mLoadActionsColor[0] = LOAD_ACTION_LOAD;
+		loadActions.mLoadActionDepth = LOAD_ACTION_LOAD;
+		cmdBindRenderTargets(cmd, 1, &pRenderTarget, pDepth, &loadActions, NULL, NULL, -1, -1);
+
+		cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Forward+ Transparency");
+		cmdBeginBenchmarkPass(cmd, BENCHMARK_PASS_FORWARD_PLUS);
+
+		cmdBindPipeline(cmd, pForwardPlusPipeline);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetForwardPlus[0]);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetForwardPlus[1]);
+
+		bindModelBuffers(cmd, SPONZA_MODEL);
+		for (uint32_t i = 0; i < gModels[SPONZA_MODEL]->mDrawArgCount; ++i)
+		{
+			if (!isAlphaBlendedMaterial(gMaterialIds[i]))
+				continue;
+			if (pDrawCullResults && pDrawCullResults[i] != DRAW_CULL_CPU_VISIBLE)
+				continue;
+
+			// the draw index selects the material in drawData
+			IndirectDrawIndexArguments& cmdData = gModels[SPONZA_MODEL]->pDrawArgs[i];
+			cmdDrawIndexedInstanced(cmd, cmdData.mIndexCount, cmdData.mStartIndex, 1, cmdData.mVertexOffset, i);
+		}
+
+		cmdEndBenchmarkPass(cmd, BENCHMARK_PASS_FORWARD_PLUS);
+		cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+
+		cmdBindRenderTargets(cmd, 0, NULL, NULL, NULL, NULL, NULL, -1, -1);
+
+		rtBarrier = { pDepth, RESOURCE_STATE_DEPTH_READ, RESOURCE_STATE_SHADER_RESOURCE };
+		cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, &rtBarrier);
+
+		// UI is drawn on the swapchain image only
+		loadActions = {};
+		loadActions.mLoadActionsColor[0] = LOAD_ACTION_LOAD;
+		cmdBindRenderTargets(cmd, 1, &pRenderTarget, NULL, &loadActions, NULL, NULL, -1, -1);
 	}
 
 	void Draw()
 	{
+		if (bCpuBenchmarkOnly || (!bBenchmark && pBenchmarkFrames))
+			return;
+
+		HiresTimer drawTimer;
+		initHiresTimer(&drawTimer);
+
+		if (gLightBufferCapacity < gLightCapacity)
+			resizeLightBuffers();
+		if (gLightGridTileSize != gTileSize || isLightIndexCapacityShort(gLightBinCapacity, gLightBinRequiredCapacity) ||
+			isLightIndexCapacityShort(gLightGridCapacity, gLightGridRequiredCapacity) ||
+			isLightIndexCapacityShort(gClusterLightCapacity, gClusterLightRequiredCapacity))
+			resizeLightGridBuffers();
+
 		if (pSwapChain->mEnableVsync != mSettings.mVSyncEnabled)
 		{
+			submitPendingComposite();
 			waitQueueIdle(pGraphicsQueue);
+			waitQueueIdle(pComputeQueue);
 			::toggleVSync(pRenderer, &pSwapChain);
 		}
 
-		uint32_t swapchainImageIndex;
-		acquireNextImage(pRenderer, pSwapChain, pImageAcquiredSemaphore, NULL, &swapchainImageIndex);
+		// Without culling there is nothing to overlap, those frames (and the ones after switching async compute off) run in order
+		const bool asyncCompute = bAsyncCompute && gTileCullMode != NON_TILE;
+		if (!asyncCompute)
+			submitPendingComposite();
 
-		RenderTarget* pRenderTarget = pSwapChain->ppRenderTargets[swapchainImageIndex];
+		// With async compute, the image is acquired once the Gbuffer and culling passes are submitted
+		uint32_t swapchainImageIndex = 0;
+		if (!asyncCompute)
+			acquireNextImage(pRenderer, pSwapChain, pImageAcquiredSemaphore, NULL, &swapchainImageIndex);
 
-		GpuCmdRingElement elem = getNextGpuCmdRingElement(&gGraphicsCmdRing, true, 1);
+		GpuCmdRingElement elem = getNextGpuCmdRingElement(&gGraphicsCmdRing, true, 3);
+		GpuCmdRingElement computeElem = getNextGpuCmdRingElement(&gComputeCmdRing, true, 1);
 
-		// Stall if CPU is running "gDataBufferCount" frames ahead of GPU
+		// Stall if CPU is running "gFramesInFlight" frames ahead of GPU
+		// (with async compute, the fence is signaled by the composition, which waits for the culling pass of the slot)
 		FenceStatus fenceStatus;
 		getFenceStatus(pRenderer, elem.pFence, &fenceStatus);
 		if (fenceStatus == FENCE_STATUS_INCOMPLETE)
@@ -900,6 +3113,25 @@ public:
 
 		// Reset cmd pool for this frame
 		resetCmdPool(pRenderer, elem.pCmdPool);
+		resetCmdPool(pRenderer, computeElem.pCmdPool);
+		for (uint32_t t = 0; t < GBUFFER_MAX_RECORD_TASKS; ++t)
+			resetCmdPool(pRenderer, pGbufferCmdPools[gFrameIndex][t]);
+
+		// textures that finished streaming, this slot's sets are no longer in use
+		swapInStreamedMaterialTextures();
+		if (gMaterialTextureSlotVersion[gFrameIndex] != gMaterialTextureVersion)
+			updateMaterialTextureSets(gFrameIndex);
+
+		readLightOverflowCounters(gFrameIndex);
+		if (bBenchmark)
+		{
+			readBenchmarkPassTimes(gFrameIndex);
+			gBenchmarkQueryFrame[gFrameIndex] = gBenchmarkFrame;
+			gBenchmarkQueryPassMask[gFrameIndex] = 0;
+		}
+		readTileSizeQuery(gFrameIndex);
+		if (bMeasureTileSize)
+			gTileSizeQueryVariant[gFrameIndex] = gTileSize;
 
 		// Update uniform buffers
 		// camera ubo update
@@ -916,20 +3148,57 @@ public:
 		*(UniformExtCamData*)extCamBuffUpdateDesc.pMappedData = gUniformExtCamData;
 		endUpdateResource(&extCamBuffUpdateDesc, NULL);
 
-		if (bDynamicLight || (gDataBufferCount > gLightFrameCount))
+		gLightUploadBytes = 0;
+		if (bLightsAnimated)
 		{
-			// update light buffer
-			BufferUpdateDesc lightColorBuffUpdateDesc = { pLightColorAndIntensityBuffer[gFrameIndex] };
-			beginUpdateResource(&lightColorBuffUpdateDesc);
-			memcpy_s(lightColorBuffUpdateDesc.pMappedData, sizeof(gLightColorAndIntensity), gLightColorAndIntensity, sizeof(gLightColorAndIntensity));
-			endUpdateResource(&lightColorBuffUpdateDesc, NULL);
-
+			// the animation writes this slot's positions directly, the CPU copy is only kept up to date for the BVH build
+			const uint32_t numLights = gUniformTileCullData.mNumOfLights;
+#if LIGHT_FORMAT_FP16 || LIGHT_LAYOUT != LIGHT_LAYOUT_SPLIT
+			// packed / scattered from the CPU copy
+			animateLights(&gLightAnimation, gLightMotion, gLightAnimationTime, gLightPositionAndRadius, NULL);
+			if (numLights)
+				gLightUploadBytes +=
+					writeLightViews(gLightPositionViews, gLightPositionViewCount, gFrameIndex, gLightPositionAndRadius, 0, numLights, true);
+#else
 			BufferUpdateDesc lightPosBuffUpdateDesc = { pLightPosAndRadiusBuffer[gFrameIndex] };
+			lightPosBuffUpdateDesc.mSize = numLights * gLightElementSize;
 			beginUpdateResource(&lightPosBuffUpdateDesc);
-			memcpy_s(lightPosBuffUpdateDesc.pMappedData, sizeof(gLightPositionAndRadius), gLightPositionAndRadius, sizeof(gLightPositionAndRadius));
+			animateLights(&gLightAnimation, gLightMotion, gLightAnimationTime, (vec4*)lightPosBuffUpdateDesc.pMappedData,
+				gUniformTileCullData.mUseLightBVH ? gLightPositionAndRadius : NULL);
 			endUpdateResource(&lightPosBuffUpdateDesc, NULL);
+			gLightUploadBytes += numLights * gLightElementSize;
+#endif
+			gLightPositionTracker.mSlotVersion[gFrameIndex] = gLightPositionTracker.mVersion;
+		}
+
+		// update light buffers, only the ranges this slot has not seen yet
+		gLightUploadBytes += uploadDirtyLights(&gLightColorTracker, gFrameIndex, gLightColorViews, gLightColorViewCount, gLightColorAndIntensity,
+			gUniformTileCullData.mNumOfLights, false);
+		gLightUploadBytes += uploadDirtyLights(&gLightPositionTracker, gFrameIndex, gLightPositionViews, gLightPositionViewCount,
+			gLightPositionAndRadius, gUniformTileCullData.mNumOfLights, true);
+
+		// the BVH is rebuilt as a whole once per position version and copied to every slot that holds an older one
+		if (gUniformTileCullData.mUseLightBVH && gLightBVHSlotVersion[gFrameIndex] != gLightPositionTracker.mVersion)
+		{
+			if (gLightBVHVersion != gLightPositionTracker.mVersion)
+			{
+				buildLightBVH(&gLightBVH, gLightPositionAndRadius, gUniformTileCullData.mNumOfLights);
+				gUniformTileCullData.mLightBVHRootCount = gLightBVH.mRootCount;
+				gLightBVHVersion = gLightPositionTracker.mVersion;
+			}
+
+			BufferUpdateDesc lightBVHNodeBuffUpdateDesc = { pLightBVHNodeBuffer[gFrameIndex] };
+			beginUpdateResource(&lightBVHNodeBuffUpdateDesc);
+			memcpy(lightBVHNodeBuffUpdateDesc.pMappedData, gLightBVH.pNodes, gLightBVH.mNodeCount * sizeof(LightBVHNode));
+			endUpdateResource(&lightBVHNodeBuffUpdateDesc, NULL);
+
+			BufferUpdateDesc lightBVHRootBuffUpdateDesc = { pLightBVHRootBuffer[gFrameIndex] };
+			beginUpdateResource(&lightBVHRootBuffUpdateDesc);
+			memcpy(lightBVHRootBuffUpdateDesc.pMappedData, gLightBVH.mRoots, gLightBVH.mRootCount * sizeof(uint32_t));
+			endUpdateResource(&lightBVHRootBuffUpdateDesc, NULL);
 
-			++gLightFrameCount;
+			gLightBVHSlotVersion[gFrameIndex] = gLightPositionTracker.mVersion;
+			gLightUploadBytes += gLightBVH.mNodeCount * sizeof(LightBVHNode) + gLightBVH.mRootCount * sizeof(uint32_t);
 		}
 		
 		if (gTileCullMode != NON_TILE)
@@ -942,17 +3211,97 @@ public:
 			endUpdateResource(&tileCullBuffUpdateDesc, NULL);
 		}
 
+		// object world matrices, read through drawData[drawId].objectIndex
+		BufferUpdateDesc objectBuffUpdateDesc = {};
+		objectBuffUpdateDesc.pBuffer = pObjectBuffer[gFrameIndex];
+		objectBuffUpdateDesc.mSize = MODEL_COUNT * sizeof(mat4);
+		beginUpdateResource(&objectBuffUpdateDesc);
+		mat4 objectMatrices[MODEL_COUNT];
+		for (uint32_t i = 0; i < MODEL_COUNT; ++i)
+		{
+			objectMatrices[i] = mat4::translation(f3Tov3(gObjectInfo[i].mPosition)) * mat4::rotationZYX(f3Tov3(gObjectInfo[i].mRotation)) * mat4::scale(vec3(gObjectInfo[i].mScale));
+			((mat4*)objectBuffUpdateDesc.pMappedData)[i] = objectMatrices[i];
+		}
+		endUpdateResource(&objectBuffUpdateDesc, NULL);
+
+		// instance matrices behind them, only the ranges this slot has not seen yet
+		DirtyRange instanceRanges[DIRTY_RANGE_HISTORY];
+		const uint32_t instanceRangeCount = getDirtyRanges(&gObjectInstanceTracker, gFrameIndex, gObjectInstanceCount, instanceRanges);
+		for (uint32_t i = 0; i < instanceRangeCount; ++i)
+		{
+			BufferUpdateDesc instanceUpdateDesc = { pObjectBuffer[gFrameIndex] };
+			instanceUpdateDesc.mDstOffset = (MODEL_COUNT + instanceRanges[i].mBegin) * sizeof(mat4);
+			instanceUpdateDesc.mSize = (instanceRanges[i].mEnd - instanceRanges[i].mBegin) * sizeof(mat4);
+			beginUpdateResource(&instanceUpdateDesc);
+			memcpy(instanceUpdateDesc.pMappedData, gObjectInstances.pWorld + instanceRanges[i].mBegin, instanceUpdateDesc.mSize);
+			endUpdateResource(&instanceUpdateDesc, NULL);
+		}
+
+		if (bGpuDrivenGbuffer)
+		{
+			// frustum planes from the rows of the projection-view matrix (reverse Z: near at z = w, far at z = 0)
+			const mat4& projView = gUniformCamData.mProjectView;
+			UniformDrawCullData drawCullData = {};
+			drawCullData.mFrustumPlanes[0] = projView.getRow(3) + projView.getRow(0);
+			drawCullData.mFrustumPlanes[1] = projView.getRow(3) - projView.getRow(0);
+			drawCullData.mFrustumPlanes[2] = projView.getRow(3) + projView.getRow(1);
+			drawCullData.mFrustumPlanes[3] = projView.getRow(3) - projView.getRow(1);
+			drawCullData.mFrustumPlanes[4] = projView.getRow(3) - projView.getRow(2);
+			drawCullData.mFrustumPlanes[5] = projView.getRow(2);
+			drawCullData.mDrawCount = gModels[SPONZA_MODEL]->mDrawArgCount;
+			drawCullData.mSkipAlphaBlended = gUniformTileCullData.mWriteLightGrid;
+			drawCullData.mFrustumCull = bGbufferFrustumCull ? 1 : 0;
+
+			BufferUpdateDesc drawCullBuffUpdateDesc = {};
+			drawCullBuffUpdateDesc.pBuffer = pDrawCullUniformBuffer[gFrameIndex];
+			beginUpdateResource(&drawCullBuffUpdateDesc);
+			*(UniformDrawCullData*)drawCullBuffUpdateDesc.pMappedData = drawCullData;
+			endUpdateResource(&drawCullBuffUpdateDesc, NULL);
+		}
+
 
 		Cmd* cmd = elem.pCmds[0];
 		beginCmd(cmd);
 
 		cmdBeginGpuFrameProfile(cmd, gGpuProfileToken, true);
 
+		if (bBenchmark)
+			cmdResetQueryPool(cmd, pBenchmarkQueryPool, gFrameIndex * BENCHMARK_PASS_COUNT * 2, BENCHMARK_PASS_COUNT * 2);
+		if (gTileSizeQueryVariant[gFrameIndex] != UINT32_MAX)
+			cmdResetQueryPool(cmd, pTileSizeQueryPool, gFrameIndex * 2, 2);
+
+		if (bGpuDrivenGbuffer)
+		{
+			// Cull the Sponza draws into the indirect argument buffer of the Gbuffer pass
+			cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Gbuffer Draw Culling");
+
+			BufferBarrier bufferBarriers[2] = {
+				{ pVisibleDrawCountBuffer, RESOURCE_STATE_INDIRECT_ARGUMENT, RESOURCE_STATE_COPY_DEST },
+				{ pVisibleDrawArgsBuffer, RESOURCE_STATE_INDIRECT_ARGUMENT, RESOURCE_STATE_UNORDERED_ACCESS }
+			};
+			cmdResourceBarrier(cmd, 2, bufferBarriers, 0, NULL, 0, NULL);
+			cmdUpdateBuffer(cmd, pVisibleDrawCountBuffer, 0, pVisibleDrawCountResetBuffer, 0, sizeof(uint32_t));
+			bufferBarriers[0] = { pVisibleDrawCountBuffer, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_UNORDERED_ACCESS };
+			cmdResourceBarrier(cmd, 1, bufferBarriers, 0, NULL, 0, NULL);
+
+			cmdBindPipeline(cmd, pGbufferDrawCullPipeline);
+			cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetGbufferDrawCull);
+			cmdDispatch(cmd, (gModels[SPONZA_MODEL]->mDrawArgCount + GBUFFER_CULL_THREADS - 1) / GBUFFER_CULL_THREADS, 1, 1);
+
+			bufferBarriers[0] = { pVisibleDrawCountBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_INDIRECT_ARGUMENT };
+			bufferBarriers[1] = { pVisibleDrawArgsBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_INDIRECT_ARGUMENT };
+			cmdResourceBarrier(cmd, 2, bufferBarriers, 0, NULL, 0, NULL);
+
+			cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+		}
+
 		// Transfer G-buffers to render target state
+		RenderTarget** ppGbuffers = pGbufferRenderTargets[gFrameIndex];
+		RenderTarget* pDepth = pDepthBuffer[gFrameIndex];
 		RenderTargetBarrier rtBarriers[DEFERRED_RT_COUNT + 2] = {
-			{ pGbufferRenderTargets[0], RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET },
-			{ pGbufferRenderTargets[1], RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET },
-			{ pDepthBuffer, RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_DEPTH_WRITE }
+			{ ppGbuffers[0], RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET },
+			{ ppGbuffers[1], RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_RENDER_TARGET },
+			{ pDepth, RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_DEPTH_WRITE }
 		};
 		
 		uint32_t rtBarrierCount = DEFERRED_RT_COUNT + 1;
@@ -962,98 +3311,137 @@ public:
 		// Clear G-buffers and Depth buffer
 		LoadActionsDesc loadActions = {};
 		loadActions.mLoadActionsColor[0] = LOAD_ACTION_CLEAR;
-		loadActions.mClearColorValues[0] = pGbufferRenderTargets[0]->mClearValue;
+		loadActions.mClearColorValues[0] = ppGbuffers[0]->mClearValue;
 		loadActions.mLoadActionDepth = LOAD_ACTION_CLEAR;
 		loadActions.mClearDepth.depth = 0.0f;
 		loadActions.mClearDepth.stencil = 0;
-		cmdBindRenderTargets(cmd, DEFERRED_RT_COUNT, pGbufferRenderTargets, pDepthBuffer, &loadActions, NULL, NULL, -1, -1);
-		cmdSetViewport(cmd, 0.0f, 0.0f, (float)pGbufferRenderTargets[0]->mWidth, (float)pGbufferRenderTargets[0]->mHeight, 0.0f, 1.0f);
-		cmdSetScissor(cmd, 0, 0, pGbufferRenderTargets[0]->mWidth, pGbufferRenderTargets[0]->mHeight);
+		cmdBindRenderTargets(cmd, DEFERRED_RT_COUNT, ppGbuffers, pDepth, &loadActions, NULL, NULL, -1, -1);
+		cmdSetViewport(cmd, 0.0f, 0.0f, (float)ppGbuffers[0]->mWidth, (float)ppGbuffers[0]->mHeight, 0.0f, 1.0f);
+		cmdSetScissor(cmd, 0, 0, ppGbuffers[0]->mWidth, ppGbuffers[0]->mHeight);
 
 		cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Fill Gbuffers");
-		cmdBindPipeline(cmd, pGbufferPipeline);
-
-		cmdBindDescriptorSet(cmd, 0, pDescriptorSetGbuffers[0]); // textureMap
-		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetGbuffers[1]); // cameraUBO, objectUBO
+		cmdBeginBenchmarkPass(cmd, BENCHMARK_PASS_FILL_GBUFFERS);
 
 		// Draw Model ([0] = sponza, [1, model_count - 1] = single meshes)
+		HiresTimer gbufferRecordTimer;
+		initHiresTimer(&gbufferRecordTimer);
+		if (bGpuDrivenGbuffer)
 		{
-			static ConstantObjData gConstantObjData = {}; // push constant data per draw call
-			static uint32_t constantSize = sizeof(ConstantObjData);
-			static const uint32_t drawCount = (uint32_t)gModels[0]->mDrawArgCount;
-			gConstantObjData.mWorldMat = mat4::translation(f3Tov3(gObjectInfo[0].mPosition)) * mat4::rotationZYX(f3Tov3(gObjectInfo[0].mRotation)) * mat4::scale(vec3(gObjectInfo[0].mScale));
-			
-			//Draw Sponza
-			cmdBindVertexBuffer(cmd, 1, gModels[0]->pVertexBuffers, gModels[0]->mVertexStrides, NULL);
-			cmdBindIndexBuffer(cmd, gModels[0]->pIndexBuffer, gModels[0]->mIndexType, NULL);
-			for (uint32_t i = 0; i < drawCount; ++i)
-			{
-				int materialID = gMaterialIds[i];
-
-				gConstantObjData.mMaterialId = ((gSponzaTextureIndexForMaterial[materialID][0] & 0xFF) << 0) |
-					((gSponzaTextureIndexForMaterial[materialID][1] & 0xFF) << 8) |
-					((gSponzaTextureIndexForMaterial[materialID][2] & 0xFF) << 16) |
-					((gSponzaTextureIndexForMaterial[materialID][3] & 0xFF) << 24);
-
-				cmdBindPushConstants(cmd, pGbufferRootSignature, gModelIdRootConstantIndex, &gConstantObjData);
-				IndirectDrawIndexArguments& cmdData = gModels[0]->pDrawArgs[i];
-				cmdDrawIndexed(cmd, cmdData.mIndexCount, cmdData.mStartIndex, cmdData.mVertexOffset);
-			}
+			bindGbufferPipeline(cmd);
+			bindModelBuffers(cmd, SPONZA_MODEL);
+			cmdExecuteIndirect(cmd, pGbufferCommandSignature, gModels[SPONZA_MODEL]->mDrawArgCount, pVisibleDrawArgsBuffer, 0, pVisibleDrawCountBuffer, 0);
+		}
 
-			for (uint32_t i = 1; i < MODEL_COUNT; ++i) {
-				gConstantObjData.mWorldMat = mat4::translation(f3Tov3(gObjectInfo[i].mPosition)) * mat4::rotationZYX(f3Tov3(gObjectInfo[i].mRotation)) * mat4::scale(vec3(gObjectInfo[i].mScale));
+		const uint8_t* pDrawCullResults = NULL;
+		if (!bGpuDrivenGbuffer && bCpuDrawCull)
+		{
+			DrawCullCpuDesc drawCullDesc = {};
+			drawCullDesc.mProjectView = gUniformCamData.mProjectView;
+			drawCullDesc.mWorld = objectMatrices[SPONZA_MODEL];
+			drawCullDesc.mOcclusion = bCpuOcclusionCull;
+			cullDrawsCpu(&gDrawCullCpu, &drawCullDesc);
+			pDrawCullResults = gDrawCullCpu.pResults;
+		}
 
-				gConstantObjData.mMaterialId = ((gObjectInfo[i].mMaterial.albedoIndex & 0xFF) << 0) |
-					((gObjectInfo[i].mMaterial.normalIndex & 0xFF) << 8) |
-					((gObjectInfo[i].mMaterial.metallicIndex & 0xFF) << 16) |
-					((gObjectInfo[i].mMaterial.roughnessIndex & 0xFF) << 24);
+		const uint32_t gbufferDrawCount = gatherGbufferDraws(!bGpuDrivenGbuffer, gUniformTileCullData.mWriteLightGrid != 0, bDrawBatching, pDrawCullResults);
+		uint32_t gbufferTaskCount = 1;
+		if (bMultithreadedGbuffer)
+		{
+			gbufferTaskCount = min(getThreadSystemThreadCount(pThreadSystem) + 1, (uint32_t)GBUFFER_MAX_RECORD_TASKS);
+			gbufferTaskCount = max(1u, min(gbufferTaskCount, gbufferDrawCount / GBUFFER_MIN_DRAWS_PER_TASK));
+		}
 
-				cmdBindPushConstants(cmd, pGbufferRootSignature, gModelIdRootConstantIndex, &gConstantObjData);
-				cmdBindVertexBuffer(cmd, 1, &gModels[i]->pVertexBuffers[0], &gModels[i]->mVertexStrides[0], NULL);
-				cmdBindIndexBuffer(cmd, gModels[i]->pIndexBuffer, gModels[i]->mIndexType, 0);
-				cmdDrawIndexed(cmd, gModels[i]->mIndexCount, 0, 0);
-			}
+		Cmd* ppSubmitCmds[GBUFFER_MAX_RECORD_TASKS + 2] = { cmd };
+		uint32_t submitCmdCount = 1;
+		if (gbufferTaskCount == 1)
+		{
+			if (!bGpuDrivenGbuffer)
+				bindGbufferPipeline(cmd);
+			recordGbufferDraws(cmd, gGbufferDraws, 0, gbufferDrawCount);
+		}
+		else
+		{
+			// Close the clear pass, the tasks resume it with load actions and the frame continues in the second ring command
+			cmdBindRenderTargets(cmd, 0, NULL, NULL, NULL, NULL, NULL, -1, -1);
+			endCmd(cmd);
+
+			gGbufferRecordTask.pDraws = gGbufferDraws;
+			gGbufferRecordTask.mDrawCount = gbufferDrawCount;
+			gGbufferRecordTask.mTaskCount = gbufferTaskCount;
+			addThreadSystemRangeTask(pThreadSystem, recordGbufferTask, &gGbufferRecordTask, gbufferTaskCount);
+			waitThreadSystemIdle(pThreadSystem);
+
+			for (uint32_t t = 0; t < gbufferTaskCount; ++t)
+				ppSubmitCmds[submitCmdCount++] = pGbufferCmds[gFrameIndex][t];
+
+			cmd = elem.pCmds[1];
+			ppSubmitCmds[submitCmdCount++] = cmd;
+			beginCmd(cmd);
+		}
+		
+		if (bBenchmark)
+		{
+			pBenchmarkFrames[gBenchmarkFrame].mGbufferRecordMs = (float)getHiresTimerUSec(&gbufferRecordTimer, false) / 1000.0f;
+			pBenchmarkFrames[gBenchmarkFrame].mGbufferDraws = gbufferDrawCount;
+			pBenchmarkFrames[gBenchmarkFrame].mGbufferStateChanges = gGbufferStateChanges;
 		}
 		
+		cmdEndBenchmarkPass(cmd, BENCHMARK_PASS_FILL_GBUFFERS);
 		cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
 		cmdBindRenderTargets(cmd, 0, NULL, NULL, NULL, NULL, NULL, -1, -1);
 
-		if (gTileCullMode != NON_TILE)
+		if (asyncCompute)
 		{
-			rtBarriers[0] = { pGbufferRenderTargets[0], RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_SHADER_RESOURCE };
-			rtBarriers[1] = { pGbufferRenderTargets[1], RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_SHADER_RESOURCE };
-			rtBarriers[2] = { pSceneBuffer, RESOURCE_STATE_SHADER_RESOURCE, RESOURCE_STATE_UNORDERED_ACCESS };
-			rtBarriers[3] = { pDepthBuffer, RESOURCE_STATE_DEPTH_WRITE, RESOURCE_STATE_SHADER_RESOURCE };
-			rtBarrierCount = 4;
-
-			cmdResourceBarrier(cmd, 0, NULL, 0, NULL, rtBarrierCount, rtBarriers);
-
-			// Light Cull 
-			cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Light Culling Compute");
-
-
-			if (gTileCullMode == TILE_BASE)
-			{
-				cmdBindPipeline(cmd, pTiledCullPipeline);
-			}
-			else if (gTileCullMode == TILE_HALFZ)
-			{
-				cmdBindPipeline(cmd, pTiledCullHalfZPipeline);
-			}
-			else //if(gTileCullMode == TILE_MODIFIED_Z)
-			{
-				cmdBindPipeline(cmd, pTiledCullModifiedZPipeline);
-			}
-
-			cmdBindDescriptorSet(cmd, 0, pDescriptorSetCullPass[0]);
-			cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetCullPass[1]);
-			cmdDispatch(cmd, gUniformTileCullData.mNumTilesX, gUniformTileCullData.mNumTilesY, 1);
+			// Hand the Gbuffer over to the compute queue, the graphics queue moves on to the next frame meanwhile
+			cmdCullPassBarriers(cmd, gFrameIndex, true, QUEUE_TRANSFER_RELEASE);
+			endCmd(cmd);
+
+			QueueSubmitDesc submitDesc = {};
+			submitDesc.mCmdCount = submitCmdCount;
+			submitDesc.mSignalSemaphoreCount = 1;
+			submitDesc.ppCmds = ppSubmitCmds;
+			submitDesc.ppSignalSemaphores = &pGbufferDoneSemaphores[gFrameIndex];
+			queueSubmit(pGraphicsQueue, &submitDesc);
+
+			Cmd* computeCmd = computeElem.pCmds[0];
+			beginCmd(computeCmd);
+			cmdBeginGpuFrameProfile(computeCmd, gComputeProfileToken, true);
+			cmdCullPassBarriers(computeCmd, gFrameIndex, true, QUEUE_TRANSFER_ACQUIRE);
+			recordLightCulling(computeCmd, gComputeProfileToken);
+			cmdCullPassBarriers(computeCmd, gFrameIndex, false, QUEUE_TRANSFER_RELEASE);
+			cmdEndGpuFrameProfile(computeCmd, gComputeProfileToken);
+			endCmd(computeCmd);
+
+			submitDesc = {};
+			submitDesc.mCmdCount = 1;
+			submitDesc.mWaitSemaphoreCount = 1;
+			submitDesc.mSignalSemaphoreCount = 1;
+			submitDesc.ppCmds = &computeCmd;
+			submitDesc.ppWaitSemaphores = &pGbufferDoneSemaphores[gFrameIndex];
+			submitDesc.ppSignalSemaphores = &pCullDoneSemaphores[gFrameIndex];
+			queueSubmit(pComputeQueue, &submitDesc);
+
+			// The previous composition goes behind this Gbuffer pass on the graphics queue, so it runs while this frame is culled
+			submitPendingComposite();
+			acquireNextImage(pRenderer, pSwapChain, pImageAcquiredSemaphore, NULL, &swapchainImageIndex);
+
+			cmd = elem.pCmds[2];
+			beginCmd(cmd);
+			cmdCullPassBarriers(cmd, gFrameIndex, false, QUEUE_TRANSFER_ACQUIRE);
+		}
+		else if (gTileCullMode != NON_TILE)
+		{
+			cmdCullPassBarriers(cmd, gFrameIndex, true, QUEUE_TRANSFER_NONE);
+			recordLightCulling(cmd, gGpuProfileToken);
+			cmdCullPassBarriers(cmd, gFrameIndex, false, QUEUE_TRANSFER_NONE);
+		}
 
-			cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+		RenderTarget* pRenderTarget = pSwapChain->ppRenderTargets[swapchainImageIndex];
 
+		if (gTileCullMode != NON_TILE)
+		{
 			rtBarriers[0] = { pRenderTarget, RESOURCE_STATE_PRESENT, RESOURCE_STATE_RENDER_TARGET };
-			rtBarriers[1] = { pSceneBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_SHADER_RESOURCE };
-			rtBarrierCount = 2;
+			rtBarrierCount = 1;
 			cmdResourceBarrier(cmd, 0, NULL, 0, NULL, rtBarrierCount, rtBarriers);
 
 			// Render Quad
@@ -1064,20 +3452,27 @@ public:
 			cmdSetScissor(cmd, 0, 0, pRenderTarget->mWidth, pRenderTarget->mHeight);
 
 			cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Render Quad");
+			cmdBeginBenchmarkPass(cmd, BENCHMARK_PASS_RENDER_QUAD);
 
 			const uint32_t quadStride = sizeof(float) * 5;
 			cmdBindPipeline(cmd, pRenderQuadPipeline);
-			cmdBindDescriptorSet(cmd, 0, pDescritporSetRenderQuad);
+			cmdBindDescriptorSet(cmd, gFrameIndex, pDescritporSetRenderQuad);
 			cmdBindVertexBuffer(cmd, 1, &pScreenQuadVertexBuffer, &quadStride, NULL);
 			cmdDraw(cmd, 3, 0);
 
-			cmdEndGpuFrameProfile(cmd, gGpuProfileToken);
+			cmdEndBenchmarkPass(cmd, BENCHMARK_PASS_RENDER_QUAD);
+			cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
+
+			if (gUniformTileCullData.mWriteLightGrid)
+			{
+				drawForwardPlus(cmd, pRenderTarget, pDrawCullResults);
+			}
 		}
 		else // Deferred Rendering
 		{
-			rtBarriers[0] = { pGbufferRenderTargets[0], RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_SHADER_RESOURCE };
-			rtBarriers[1] = { pGbufferRenderTargets[1], RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_SHADER_RESOURCE };
-			rtBarriers[2] = { pDepthBuffer, RESOURCE_STATE_DEPTH_WRITE, RESOURCE_STATE_SHADER_RESOURCE };
+			rtBarriers[0] = { ppGbuffers[0], RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_SHADER_RESOURCE };
+			rtBarriers[1] = { ppGbuffers[1], RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_SHADER_RESOURCE };
+			rtBarriers[2] = { pDepth, RESOURCE_STATE_DEPTH_WRITE, RESOURCE_STATE_SHADER_RESOURCE };
 			rtBarriers[3] = { pRenderTarget, RESOURCE_STATE_PRESENT, RESOURCE_STATE_RENDER_TARGET };
 			rtBarrierCount = 4;
 
@@ -1086,16 +3481,18 @@ public:
 
 			// Light Pass 
 			cmdBeginGpuTimestampQuery(cmd, gGpuProfileToken, "Deferred Rendering: Light Pass");
+			cmdBeginBenchmarkPass(cmd, BENCHMARK_PASS_DEFERRED_LIGHT);
 
 			const uint32_t quadStride = sizeof(float) * 5;
 			cmdBindPipeline(cmd, pDeferredPipeline);
-			cmdBindDescriptorSet(cmd, 0, pDescriptorSetDeferredLightPass[0]);
+			cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetDeferredLightPass[0]);
 			cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetDeferredLightPass[1]);
 			cmdBindPushConstants(cmd, pDeferredRootSignature, gLightCountRootConstantIndex, &gUniformTileCullData.mNumOfLights);
 			cmdBindVertexBuffer(cmd, 1, &pScreenQuadVertexBuffer, &quadStride, NULL);
 			cmdDraw(cmd, 3, 0);
 
-			cmdEndGpuFrameProfile(cmd, gGpuProfileToken);
+			cmdEndBenchmarkPass(cmd, BENCHMARK_PASS_DEFERRED_LIGHT);
+			cmdEndGpuTimestampQuery(cmd, gGpuProfileToken);
 		}
 
 
@@ -1105,7 +3502,9 @@ public:
 		gFrameTimeDraw.mFontSize = 18.0f;
 		gFrameTimeDraw.mFontID = gFontID;
 		float2 txtSizePx = cmdDrawCpuProfile(cmd, float2(8.f, 15.f), &gFrameTimeDraw);
-		cmdDrawGpuProfile(cmd, float2(8.f, txtSizePx.y + 75.f), gGpuProfileToken, &gFrameTimeDraw);
+		txtSizePx = cmdDrawGpuProfile(cmd, float2(8.f, txtSizePx.y + 75.f), gGpuProfileToken, &gFrameTimeDraw);
+		if (asyncCompute)
+			cmdDrawGpuProfile(cmd, float2(8.f, txtSizePx.y + 100.f), gComputeProfileToken, &gFrameTimeDraw);
 
 		cmdDrawUserInterface(cmd);
 
@@ -1115,23 +3514,137 @@ public:
 		rtBarriers[0] = { pRenderTarget, RESOURCE_STATE_RENDER_TARGET, RESOURCE_STATE_PRESENT };
 		cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, rtBarriers);
 
+		if (bBenchmark)
+			cmdResolveQuery(cmd, pBenchmarkQueryPool, pBenchmarkQueryReadbackBuffer[gFrameIndex], gFrameIndex * BENCHMARK_PASS_COUNT * 2, BENCHMARK_PASS_COUNT * 2);
+		if (gTileSizeQueryVariant[gFrameIndex] != UINT32_MAX)
+			cmdResolveQuery(cmd, pTileSizeQueryPool, pTileSizeQueryReadbackBuffer[gFrameIndex], gFrameIndex * 2, 2);
+
 		cmdEndGpuFrameProfile(cmd, gGpuProfileToken);
 		endCmd(cmd);
 
+		if (asyncCompute)
+		{
+			// Submitted by the next frame, after its Gbuffer pass
+			gPendingComposite = { cmd, elem.pFence, elem.pSemaphore, gFrameIndex, swapchainImageIndex, true };
+		}
+		else
+		{
+			submitAndPresent(ppSubmitCmds, submitCmdCount, &pImageAcquiredSemaphore, 1, elem.pSemaphore, elem.pFence, swapchainImageIndex);
+		}
+
+		flipProfiler();
+
+		if (bBenchmark)
+		{
+			pBenchmarkFrames[gBenchmarkFrame].mCpuDrawMs = (float)getHiresTimerUSec(&drawTimer, false) / 1000.0f;
+			pBenchmarkFrames[gBenchmarkFrame].mLightUploadKB = (float)gLightUploadBytes / 1024.0f;
+			++gBenchmarkFrame;
+		}
+
+		gFrameIndex = (gFrameIndex + 1) % gFramesInFlight;
+	}
+
+	/**
+	 * @brief Depth pyramid, light binning and tile culling of the frame slot, on the graphics queue or on the compute queue (async compute).
+	 */
+	void recordLightCulling(Cmd* cmd, ProfileToken profileToken)
+	{
+		cmdBeginGpuTimestampQuery(cmd, profileToken, "Light Culling Compute");
+		cmdBeginBenchmarkPass(cmd, BENCHMARK_PASS_LIGHT_CULLING);
+		cmdBeginTileSizeQuery(cmd);
+
+		// overflow counters and the spill node cursor start at 0 for every pass
+		BufferBarrier overflowBarrier = { pLightOverflowCounterBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_COPY_DEST };
+		cmdResourceBarrier(cmd, 1, &overflowBarrier, 0, NULL, 0, NULL);
+		cmdUpdateBuffer(cmd, pLightOverflowCounterBuffer, 0, pLightOverflowCounterResetBuffer, 0, LIGHT_OVERFLOW_COUNTER_COUNT * sizeof(uint32_t));
+		overflowBarrier = { pLightOverflowCounterBuffer, RESOURCE_STATE_COPY_DEST, RESOURCE_STATE_UNORDERED_ACCESS };
+		cmdResourceBarrier(cmd, 1, &overflowBarrier, 0, NULL, 0, NULL);
+
+		// Depth pyramid: tile bounds from the depth buffer, then every coarser level from the one below
+		BufferBarrier pyramidBarrier = { pDepthPyramidBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_UNORDERED_ACCESS };
+		cmdBindPipeline(cmd, pDepthPyramidPipeline[gTileSize]);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetCullPass[0]);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetCullPass[1]);
+		cmdDispatch(cmd, gUniformTileCullData.mNumTilesX, gUniformTileCullData.mNumTilesY, 1);
+		cmdResourceBarrier(cmd, 1, &pyramidBarrier, 0, NULL, 0, NULL);
+
+		cmdBindPipeline(cmd, pDepthPyramidDownsamplePipeline);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetCullPass[0]);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetCullPass[1]);
+		uint32_t levelWidth = gUniformTileCullData.mNumTilesX;
+		uint32_t levelHeight = gUniformTileCullData.mNumTilesY;
+		for (uint32_t level = 1; level < gDepthPyramidLevelCount; ++level)
+		{
+			levelWidth = (levelWidth + 1) / 2;
+			levelHeight = (levelHeight + 1) / 2;
+			cmdBindPushConstants(cmd, pTiledCullRootSignature, gDepthPyramidRootConstantIndex, &level);
+			cmdDispatch(cmd, (levelWidth + DEPTH_PYRAMID_DOWNSAMPLE_THREADS - 1) / DEPTH_PYRAMID_DOWNSAMPLE_THREADS,
+				(levelHeight + DEPTH_PYRAMID_DOWNSAMPLE_THREADS - 1) / DEPTH_PYRAMID_DOWNSAMPLE_THREADS, 1);
+			cmdResourceBarrier(cmd, 1, &pyramidBarrier, 0, NULL, 0, NULL);
+		}
+
+		cmdBindPipeline(cmd, pLightBinningPipeline);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetCullPass[0]);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetCullPass[1]);
+		cmdDispatch(cmd, (gUniformTileCullData.mNumTilesX + LIGHT_BIN_TILES - 1) / LIGHT_BIN_TILES, (gUniformTileCullData.mNumTilesY + LIGHT_BIN_TILES - 1) / LIGHT_BIN_TILES, 1);
+
+		BufferBarrier binBarriers[2] = {
+			{ pLightBinBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_UNORDERED_ACCESS },
+			{ pLightBinIndicesBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_UNORDERED_ACCESS },
+		};
+		cmdResourceBarrier(cmd, 2, binBarriers, 0, NULL, 0, NULL);
+
+		if (gTileCullMode == TILE_BASE)
+		{
+			cmdBindPipeline(cmd, pTiledCullPipeline[gTileSize][gLightListEncoding]);
+		}
+		else if (gTileCullMode == TILE_HALFZ)
+		{
+			cmdBindPipeline(cmd, pTiledCullHalfZPipeline[gTileSize][gLightListEncoding]);
+		}
+		else if (gTileCullMode == TILE_MODIFIED_Z)
+		{
+			cmdBindPipeline(cmd, pTiledCullModifiedZPipeline[gTileSize][gLightListEncoding]);
+		}
+		else //if(gTileCullMode == TILE_CLUSTERED)
+		{
+			cmdBindPipeline(cmd, pTiledCullClusteredPipeline[gTileSize]);
+		}
+
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetCullPass[0]);
+		cmdBindDescriptorSet(cmd, gFrameIndex, pDescriptorSetCullPass[1]);
+		cmdDispatch(cmd, gUniformTileCullData.mNumTilesX, gUniformTileCullData.mNumTilesY, 1);
+
+		// read by the CPU once the fence of the slot has been waited on
+		overflowBarrier = { pLightOverflowCounterBuffer, RESOURCE_STATE_UNORDERED_ACCESS, RESOURCE_STATE_COPY_SOURCE };
+		cmdResourceBarrier(cmd, 1, &overflowBarrier, 0, NULL, 0, NULL);
+		cmdUpdateBuffer(cmd, pLightOverflowReadbackBuffer[gFrameIndex], 0, pLightOverflowCounterBuffer, 0, LIGHT_OVERFLOW_COUNTER_COUNT * sizeof(uint32_t));
+		overflowBarrier = { pLightOverflowCounterBuffer, RESOURCE_STATE_COPY_SOURCE, RESOURCE_STATE_UNORDERED_ACCESS };
+		cmdResourceBarrier(cmd, 1, &overflowBarrier, 0, NULL, 0, NULL);
+		gLightOverflowReadback[gFrameIndex] = true;
+
+		cmdEndTileSizeQuery(cmd);
+		cmdEndBenchmarkPass(cmd, BENCHMARK_PASS_LIGHT_CULLING);
+		cmdEndGpuTimestampQuery(cmd, profileToken);
+	}
+
+	void submitAndPresent(Cmd** ppCmds, uint32_t cmdCount, Semaphore** ppWaitSemaphores, uint32_t waitSemaphoreCount, Semaphore* pRenderCompleteSemaphore,
+		Fence* pFence, uint32_t swapchainImageIndex)
+	{
 		QueueSubmitDesc submitDesc = {};
-		submitDesc.mCmdCount = 1;
+		submitDesc.mCmdCount = cmdCount;
 		submitDesc.mSignalSemaphoreCount = 1;
-		submitDesc.mWaitSemaphoreCount = 1;
-		submitDesc.ppCmds = &cmd;
-		submitDesc.ppSignalSemaphores = &elem.pSemaphore;
-		submitDesc.ppWaitSemaphores = &pImageAcquiredSemaphore;
-		submitDesc.pSignalFence = elem.pFence;
+		submitDesc.mWaitSemaphoreCount = waitSemaphoreCount;
+		submitDesc.ppCmds = ppCmds;
+		submitDesc.ppSignalSemaphores = &pRenderCompleteSemaphore;
+		submitDesc.ppWaitSemaphores = ppWaitSemaphores;
+		submitDesc.pSignalFence = pFence;
 		queueSubmit(pGraphicsQueue, &submitDesc);
 		QueuePresentDesc presentDesc = {};
 		presentDesc.mIndex = swapchainImageIndex;
 		presentDesc.mWaitSemaphoreCount = 1;
 		presentDesc.pSwapChain = pSwapChain;
-		presentDesc.ppWaitSemaphores = &elem.pSemaphore;
+		presentDesc.ppWaitSemaphores = &pRenderCompleteSemaphore;
 		presentDesc.mSubmitDone = true;
 
 		// captureScreenshot() must be used before presentation.
@@ -1146,10 +3659,21 @@ public:
 		}
 		
 		queuePresent(pGraphicsQueue, &presentDesc);
+	}
 
-		flipProfiler();
+	/**
+	 * @brief Submits and presents the composition recorded by the last async compute frame, once its culling pass is done.
+	 * Called before anything else touches the swapchain or waits for the queues.
+	 */
+	void submitPendingComposite()
+	{
+		if (!gPendingComposite.mValid)
+			return;
+		gPendingComposite.mValid = false;
 
-		gFrameIndex = (gFrameIndex + 1) % gDataBufferCount;
+		Semaphore* pWaitSemaphores[2] = { pImageAcquiredSemaphore, pCullDoneSemaphores[gPendingComposite.mSlot] };
+		submitAndPresent(&gPendingComposite.pCmd, 1, pWaitSemaphores, 2, gPendingComposite.pRenderCompleteSemaphore, gPendingComposite.pFence,
+			gPendingComposite.mSwapchainImageIndex);
 	}
 
 	const char* GetName() { return "00_Austyn_Park_UnitTest"; }
@@ -1162,7 +3686,7 @@ public:
 		swapChainDesc.ppPresentQueues = &pGraphicsQueue;
 		swapChainDesc.mWidth = mSettings.mWidth;
 		swapChainDesc.mHeight = mSettings.mHeight;
-		swapChainDesc.mImageCount = gDataBufferCount;
+		swapChainDesc.mImageCount = gSwapchainImageCount;
 		swapChainDesc.mColorFormat = getRecommendedSwapchainFormat(true, true);
 		swapChainDesc.mEnableVsync = mSettings.mVSyncEnabled;
         swapChainDesc.mFlags = SWAP_CHAIN_CREATION_FLAG_ENABLE_FOVEATED_RENDERING_VR;
@@ -1188,9 +3712,14 @@ public:
 		depthRT.mWidth = mSettings.mWidth;
 		//depthRT.mFlags = TEXTURE_CREATION_FLAG_ON_TILE | TEXTURE_CREATION_FLAG_VR_MULTIVIEW;
 		depthRT.pName = "Depth Buffer";
-		addRenderTarget(pRenderer, &depthRT, &pDepthBuffer);
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			addRenderTarget(pRenderer, &depthRT, &pDepthBuffer[i]);
+			if (pDepthBuffer[i] == NULL)
+				return false;
+		}
 
-		return pDepthBuffer != NULL;
+		return true;
 	}
 
 	bool addGBuffers()
@@ -1206,20 +3735,26 @@ public:
 		deferredRT.mSampleQuality = 0;
 		deferredRT.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
 		deferredRT.pName = "G-Buffer RTs";
-		deferredRT.mFormat = TinyImageFormat_R8G8B8A8_SRGB;
 
-		for (uint32_t i = 0; i < DEFERRED_RT_COUNT; ++i)
+		for (uint32_t slot = 0; slot < gFramesInFlight; ++slot)
 		{
-			if (i == 1)
-				deferredRT.mFormat = TinyImageFormat_R16G16B16A16_SFLOAT;
+			for (uint32_t i = 0; i < DEFERRED_RT_COUNT; ++i)
+			{
+				deferredRT.mFormat = TinyImageFormat_R8G8B8A8_SRGB;
+				if (i == 1)
+					deferredRT.mFormat = bThinGbuffer ? TinyImageFormat_R10G10B10A2_UNORM : TinyImageFormat_R16G16B16A16_SFLOAT;
 
-			addRenderTarget(pRenderer, &deferredRT, &pGbufferRenderTargets[i]);
+				addRenderTarget(pRenderer, &deferredRT, &pGbufferRenderTargets[slot][i]);
+			}
 		}
 
-		for (uint32_t i = 0; i < DEFERRED_RT_COUNT; ++i)
+		for (uint32_t slot = 0; slot < gFramesInFlight; ++slot)
 		{
-			if (pGbufferRenderTargets[i] == NULL)
-				return false;
+			for (uint32_t i = 0; i < DEFERRED_RT_COUNT; ++i)
+			{
+				if (pGbufferRenderTargets[slot][i] == NULL)
+					return false;
+			}
 		}
 
 		return true;
@@ -1242,29 +3777,154 @@ public:
 		sceneRT.mSampleQuality = 0;
 		sceneRT.pName = "Scene Buffer";
 
-		addRenderTarget(pRenderer, &sceneRT, &pSceneBuffer);
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			addRenderTarget(pRenderer, &sceneRT, &pSceneBuffer[i]);
+			if (pSceneBuffer[i] == NULL)
+				return false;
+		}
+
+		return true;
+	}
+
+	void addLightGridBuffers()
+	{
+		gLightGridTileSize = gTileSize;
+		const uint32_t numTilesX = (mSettings.mWidth + gTileSizes[gTileSize][0] - 1) / gTileSizes[gTileSize][0];
+		const uint32_t numTilesY = (mSettings.mHeight + gTileSizes[gTileSize][1] - 1) / gTileSizes[gTileSize][1];
+		const uint32_t numTiles = numTilesX * numTilesY;
+		const uint32_t numBins = ((numTilesX + LIGHT_BIN_TILES - 1) / LIGHT_BIN_TILES) * ((numTilesY + LIGHT_BIN_TILES - 1) / LIGHT_BIN_TILES);
+
+		BufferLoadDesc clusterBuffDesc = {};
+		clusterBuffDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_RW_BUFFER | DESCRIPTOR_TYPE_BUFFER;
+		clusterBuffDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+		clusterBuffDesc.mDesc.mStartState = RESOURCE_STATE_UNORDERED_ACCESS;
+		clusterBuffDesc.mDesc.mFirstElement = 0;
+
+		clusterBuffDesc.mDesc.pName = "Cluster Light Grid";
+		clusterBuffDesc.mDesc.mFormat = TinyImageFormat_R32G32_UINT;
+		clusterBuffDesc.mDesc.mElementCount = numTiles * CLUSTER_DEPTH_SLICES;
+		clusterBuffDesc.mDesc.mStructStride = sizeof(uint2);
+		clusterBuffDesc.mDesc.mSize = clusterBuffDesc.mDesc.mElementCount * clusterBuffDesc.mDesc.mStructStride;
+		clusterBuffDesc.ppBuffer = &pClusterLightGridBuffer;
+		addResource(&clusterBuffDesc, NULL);
+
+		gLightBinCapacity = growLightIndexCapacity(gLightBinCapacity, gLightBinRequiredCapacity);
+		gLightGridCapacity = growLightIndexCapacity(gLightGridCapacity, gLightGridRequiredCapacity);
+		gClusterLightCapacity = growLightIndexCapacity(gClusterLightCapacity, gClusterLightRequiredCapacity);
+
+		clusterBuffDesc.mDesc.pName = "Cluster Light Indices";
+		clusterBuffDesc.mDesc.mFormat = TinyImageFormat_R32_UINT;
+		clusterBuffDesc.mDesc.mElementCount = gClusterLightCapacity;
+		clusterBuffDesc.mDesc.mStructStride = sizeof(uint);
+		clusterBuffDesc.mDesc.mSize = clusterBuffDesc.mDesc.mElementCount * clusterBuffDesc.mDesc.mStructStride;
+		clusterBuffDesc.ppBuffer = &pClusterLightIndicesBuffer;
+		addResource(&clusterBuffDesc, NULL);
+
+		// read by the Forward+ pass between two culling passes
+		clusterBuffDesc.mDesc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			clusterBuffDesc.mDesc.pName = "Light Grid";
+			clusterBuffDesc.mDesc.mFormat = TinyImageFormat_R32G32B32A32_UINT;
+			clusterBuffDesc.mDesc.mElementCount = numTiles;
+			clusterBuffDesc.mDesc.mStructStride = sizeof(uint32_t) * 4;
+			clusterBuffDesc.mDesc.mSize = clusterBuffDesc.mDesc.mElementCount * clusterBuffDesc.mDesc.mStructStride;
+			clusterBuffDesc.ppBuffer = &pLightGridBuffer[i];
+			addResource(&clusterBuffDesc, NULL);
+
+			clusterBuffDesc.mDesc.pName = "Light Indices";
+			clusterBuffDesc.mDesc.mFormat = TinyImageFormat_R32_UINT;
+			clusterBuffDesc.mDesc.mElementCount = gLightGridCapacity;
+			clusterBuffDesc.mDesc.mStructStride = sizeof(uint);
+			clusterBuffDesc.mDesc.mSize = clusterBuffDesc.mDesc.mElementCount * clusterBuffDesc.mDesc.mStructStride;
+			clusterBuffDesc.ppBuffer = &pLightIndexBuffer[i];
+			addResource(&clusterBuffDesc, NULL);
+		}
+		clusterBuffDesc.mDesc.mStartState = RESOURCE_STATE_UNORDERED_ACCESS;
+
+		clusterBuffDesc.mDesc.pName = "Light Bins";
+		clusterBuffDesc.mDesc.mFormat = TinyImageFormat_R32G32_UINT;
+		clusterBuffDesc.mDesc.mElementCount = numBins;
+		clusterBuffDesc.mDesc.mStructStride = sizeof(uint2);
+		clusterBuffDesc.mDesc.mSize = clusterBuffDesc.mDesc.mElementCount * clusterBuffDesc.mDesc.mStructStride;
+		clusterBuffDesc.ppBuffer = &pLightBinBuffer;
+		addResource(&clusterBuffDesc, NULL);
+
+		clusterBuffDesc.mDesc.pName = "Light Bin Indices";
+		clusterBuffDesc.mDesc.mFormat = TinyImageFormat_R32_UINT;
+		clusterBuffDesc.mDesc.mElementCount = gLightBinCapacity;
+		clusterBuffDesc.mDesc.mStructStride = sizeof(uint);
+		clusterBuffDesc.mDesc.mSize = clusterBuffDesc.mDesc.mElementCount * clusterBuffDesc.mDesc.mStructStride;
+		clusterBuffDesc.ppBuffer = &pLightBinIndicesBuffer;
+		addResource(&clusterBuffDesc, NULL);
+
+		// every level down to 1x1, at least up to the level of a light bin
+		uint32_t pyramidTexelCount = 0;
+		uint32_t levelWidth = numTilesX;
+		uint32_t levelHeight = numTilesY;
+		gDepthPyramidLevelCount = 0;
+		for (;;)
+		{
+			pyramidTexelCount += levelWidth * levelHeight;
+			++gDepthPyramidLevelCount;
+			if (levelWidth == 1 && levelHeight == 1 && gDepthPyramidLevelCount > LIGHT_BIN_PYRAMID_LEVEL)
+				break;
+			levelWidth = (levelWidth + 1) / 2;
+			levelHeight = (levelHeight + 1) / 2;
+		}
+
+		clusterBuffDesc.mDesc.pName = "Depth Pyramid";
+		clusterBuffDesc.mDesc.mFormat = TinyImageFormat_UNDEFINED;
+		clusterBuffDesc.mDesc.mElementCount = pyramidTexelCount;
+		clusterBuffDesc.mDesc.mStructStride = sizeof(float) * 4;
+		clusterBuffDesc.mDesc.mSize = clusterBuffDesc.mDesc.mElementCount * clusterBuffDesc.mDesc.mStructStride;
+		clusterBuffDesc.ppBuffer = &pDepthPyramidBuffer;
+		addResource(&clusterBuffDesc, NULL);
+	}
 
-		return pSceneBuffer != NULL;
+	void removeLightGridBuffers()
+	{
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+		{
+			removeResource(pLightGridBuffer[i]);
+			removeResource(pLightIndexBuffer[i]);
+		}
+		removeResource(pClusterLightGridBuffer);
+		removeResource(pClusterLightIndicesBuffer);
+		removeResource(pLightBinBuffer);
+		removeResource(pLightBinIndicesBuffer);
+		removeResource(pDepthPyramidBuffer);
 	}
 
 	void addDescriptorSets()
 	{
-		DescriptorSetDesc desc = { pGbufferRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+		// textureMaps, one per slot so that streamed textures are swapped in without touching a set in flight
+		DescriptorSetDesc desc = { pGbufferRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, gFramesInFlight };
 		addDescriptorSet(pRenderer, &desc, &pDescriptorSetGbuffers[0]);
-		desc = { pGbufferRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gDataBufferCount };
+		desc = { pGbufferRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gFramesInFlight };
 		addDescriptorSet(pRenderer, &desc, &pDescriptorSetGbuffers[1]);
 
-		desc = { pRenderQuadRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+		desc = { pGbufferDrawCullRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gFramesInFlight };
+		addDescriptorSet(pRenderer, &desc, &pDescriptorSetGbufferDrawCull);
+
+		desc = { pForwardPlusRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, gFramesInFlight };
+		addDescriptorSet(pRenderer, &desc, &pDescriptorSetForwardPlus[0]);
+		desc = { pForwardPlusRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gFramesInFlight };
+		addDescriptorSet(pRenderer, &desc, &pDescriptorSetForwardPlus[1]);
+
+		// one set per slot for the sets that reference the per slot targets
+		desc = { pRenderQuadRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, gFramesInFlight };
 		addDescriptorSet(pRenderer, &desc, &pDescritporSetRenderQuad);
 
-		desc = { pTiledCullRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+		desc = { pTiledCullRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, gFramesInFlight };
 		addDescriptorSet(pRenderer, &desc, &pDescriptorSetCullPass[0]);
-		desc = { pTiledCullRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gDataBufferCount };
+		desc = { pTiledCullRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gFramesInFlight };
 		addDescriptorSet(pRenderer, &desc, &pDescriptorSetCullPass[1]);
 
-		desc = { pDeferredRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1 };
+		desc = { pDeferredRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, gFramesInFlight };
 		addDescriptorSet(pRenderer, &desc, &pDescriptorSetDeferredLightPass[0]);
-		desc = { pDeferredRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gDataBufferCount };
+		desc = { pDeferredRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME, gFramesInFlight };
 		addDescriptorSet(pRenderer, &desc, &pDescriptorSetDeferredLightPass[1]);
 	}
 
@@ -1272,8 +3932,12 @@ public:
 	{
 		removeDescriptorSet(pRenderer, pDescriptorSetGbuffers[0]);
 		removeDescriptorSet(pRenderer, pDescriptorSetGbuffers[1]);
+		removeDescriptorSet(pRenderer, pDescriptorSetGbufferDrawCull);
 		removeDescriptorSet(pRenderer, pDescritporSetRenderQuad);
 
+		removeDescriptorSet(pRenderer, pDescriptorSetForwardPlus[0]);
+		removeDescriptorSet(pRenderer, pDescriptorSetForwardPlus[1]);
+
 		removeDescriptorSet(pRenderer, pDescriptorSetCullPass[0]);
 		removeDescriptorSet(pRenderer, pDescriptorSetCullPass[1]);
 
@@ -1294,10 +3958,41 @@ public:
 			rootDesc.mStaticSamplerCount = 1;
 			rootDesc.ppStaticSamplerNames = pStaticSamplersNames;
 			rootDesc.ppStaticSamplers = pStaticSamplers;
-			rootDesc.mMaxBindlessTextures = TOTAL_IMGS;
+			rootDesc.mMaxBindlessTextures = MAX_MATERIAL_TEXTURES;
 
 			addRootSignature(pRenderer, &rootDesc, &pGbufferRootSignature);
-			gModelIdRootConstantIndex = getDescriptorIndexFromName(pGbufferRootSignature, "cbModelIdRootConstants");
+
+			// one indexed draw per argument, the draw index is the start instance
+			IndirectArgumentDescriptor indirectArg = {};
+			indirectArg.mType = INDIRECT_DRAW_INDEX;
+
+			CommandSignatureDesc cmdSignatureDesc = {};
+			cmdSignatureDesc.pRootSignature = pGbufferRootSignature;
+			cmdSignatureDesc.mIndirectArgCount = 1;
+			cmdSignatureDesc.pArgDescs = &indirectArg;
+			cmdSignatureDesc.mPacked = true;
+			addIndirectCommandSignature(pRenderer, &cmdSignatureDesc, &pGbufferCommandSignature);
+		}
+
+		// Gbuffer draw culling
+		{
+			rootDesc = {};
+			rootDesc.ppShaders = &pGbufferDrawCullShader;
+			rootDesc.mShaderCount = 1;
+			addRootSignature(pRenderer, &rootDesc, &pGbufferDrawCullRootSignature);
+		}
+
+		// Forward+
+		{
+			rootDesc = {};
+			rootDesc.ppShaders = &pForwardPlusShader;
+			rootDesc.mShaderCount = 1;
+			rootDesc.mStaticSamplerCount = 1;
+			rootDesc.ppStaticSamplerNames = pStaticSamplersNames;
+			rootDesc.ppStaticSamplers = pStaticSamplers;
+			rootDesc.mMaxBindlessTextures = MAX_MATERIAL_TEXTURES;
+
+			addRootSignature(pRenderer, &rootDesc, &pForwardPlusRootSignature);
 		}
 
 		// RenderQuad
@@ -1326,62 +4021,127 @@ public:
 
 		// Depth Bound & Light Culling compute shader
 		{
-			Shader* shaders[] = {
-				pTiledCullShader,
-				pTiledCullHalfZShader,
-				pTiledCullModifiedZShader
-			};
+			// every tile size permutation shares the root signature
+			Shader* shaders[TILE_SIZE_COUNT * (3 * LIGHT_LIST_ENCODING_COUNT + 2) + 2] = {};
+			uint32_t shaderCount = 0;
+			for (uint32_t tileSize = 0; tileSize < TILE_SIZE_COUNT; ++tileSize)
+			{
+				for (uint32_t i = 0; i < LIGHT_LIST_ENCODING_COUNT; ++i)
+				{
+					shaders[shaderCount++] = pTiledCullShader[tileSize][i];
+					shaders[shaderCount++] = pTiledCullHalfZShader[tileSize][i];
+					shaders[shaderCount++] = pTiledCullModifiedZShader[tileSize][i];
+				}
+				shaders[shaderCount++] = pTiledCullClusteredShader[tileSize];
+				shaders[shaderCount++] = pDepthPyramidShader[tileSize];
+			}
+			shaders[shaderCount++] = pLightBinningShader;
+			shaders[shaderCount++] = pDepthPyramidDownsampleShader;
 
 			rootDesc = {};
 			rootDesc.ppShaders = shaders;
-			rootDesc.mShaderCount = sizeof(shaders) / sizeof(shaders[0]);
+			rootDesc.mShaderCount = shaderCount;
 			addRootSignature(pRenderer, &rootDesc, &pTiledCullRootSignature);
+			gDepthPyramidRootConstantIndex = getDescriptorIndexFromName(pTiledCullRootSignature, "cbDepthPyramidRootConstants");
 		}
 	}
 
 	void removeRootSignatures()
 	{
+		removeIndirectCommandSignature(pRenderer, pGbufferCommandSignature);
 		removeRootSignature(pRenderer, pGbufferRootSignature);
+		removeRootSignature(pRenderer, pGbufferDrawCullRootSignature);
+		removeRootSignature(pRenderer, pForwardPlusRootSignature);
 		removeRootSignature(pRenderer, pRenderQuadRootSignature);
 		removeRootSignature(pRenderer, pTiledCullRootSignature);
 		removeRootSignature(pRenderer, pDeferredRootSignature);
 	}
 
+	// the pipeline cache file is only reused with the binaries it was built from
+	void addHashedShader(const ShaderLoadDesc* pDesc, Shader** ppShader)
+	{
+		addShader(pRenderer, pDesc, ppShader);
+		gShaderHash = hashShaderBinaries(gShaderHash, pDesc);
+	}
+
 	void addShaders()
 	{
+		gShaderHash = PIPELINE_CACHE_HASH_SEED;
 		ShaderLoadDesc fillGbufferShader = {};
 		fillGbufferShader.mStages[0].pFileName = "fillGbuffer.vert";
 		fillGbufferShader.mStages[1].pFileName = "fillGbuffer.frag";
-		addShader(pRenderer, &fillGbufferShader, &pGbufferShader);
+		addHashedShader(&fillGbufferShader, &pGbufferShader);
+
+		ShaderLoadDesc forwardPlusShader = {};
+		forwardPlusShader.mStages[0].pFileName = "fillGbuffer.vert";
+		forwardPlusShader.mStages[1].pFileName = "forwardPlus.frag";
+		addHashedShader(&forwardPlusShader, &pForwardPlusShader);
+
+		ShaderLoadDesc drawCullShader = {};
+		drawCullShader.mStages[0].pFileName = "GbufferDrawCull.comp";
+		addHashedShader(&drawCullShader, &pGbufferDrawCullShader);
 
 		ShaderLoadDesc renderQuadShader = {};
 		renderQuadShader.mStages[0].pFileName = "renderQuad.vert";
 		renderQuadShader.mStages[1].pFileName = "renderQuad.frag";
-		addShader(pRenderer, &renderQuadShader, &pRenderQuadShader);
+		addHashedShader(&renderQuadShader, &pRenderQuadShader);
 
 		ShaderLoadDesc lightCullingShader = {};
-		lightCullingShader.mStages[0].pFileName = "TiledCullBaseline.comp";
-		addShader(pRenderer, &lightCullingShader, &pTiledCullShader);
+		char fileName[64] = {};
+		lightCullingShader.mStages[0].pFileName = fileName;
+		for (uint32_t tileSize = 0; tileSize < TILE_SIZE_COUNT; ++tileSize)
+		{
+			const char* pTileSizeSuffix = gTileSizeSuffixes[tileSize];
+			for (uint32_t i = 0; i < LIGHT_LIST_ENCODING_COUNT; ++i)
+			{
+				snprintf(fileName, sizeof(fileName), "TiledCullBaseline%s%s.comp", gLightListEncodingSuffixes[i], pTileSizeSuffix);
+				addHashedShader(&lightCullingShader, &pTiledCullShader[tileSize][i]);
 
-		lightCullingShader.mStages[0].pFileName = "TiledCullHalfZ.comp";
-		addShader(pRenderer, &lightCullingShader, &pTiledCullHalfZShader);
-		
-		lightCullingShader.mStages[0].pFileName = "TiledCullModifiedZ.comp";
-		addShader(pRenderer, &lightCullingShader, &pTiledCullModifiedZShader);
+				snprintf(fileName, sizeof(fileName), "TiledCullHalfZ%s%s.comp", gLightListEncodingSuffixes[i], pTileSizeSuffix);
+				addHashedShader(&lightCullingShader, &pTiledCullHalfZShader[tileSize][i]);
+
+				snprintf(fileName, sizeof(fileName), "TiledCullModifiedZ%s%s.comp", gLightListEncodingSuffixes[i], pTileSizeSuffix);
+				addHashedShader(&lightCullingShader, &pTiledCullModifiedZShader[tileSize][i]);
+			}
+
+			snprintf(fileName, sizeof(fileName), "TiledCullClustered%s.comp", pTileSizeSuffix);
+			addHashedShader(&lightCullingShader, &pTiledCullClusteredShader[tileSize]);
+
+			snprintf(fileName, sizeof(fileName), "DepthPyramid%s.comp", pTileSizeSuffix);
+			addHashedShader(&lightCullingShader, &pDepthPyramidShader[tileSize]);
+		}
+
+		lightCullingShader.mStages[0].pFileName = "LightBinning.comp";
+		addHashedShader(&lightCullingShader, &pLightBinningShader);
+
+		lightCullingShader.mStages[0].pFileName = "DepthPyramidDownsample.comp";
+		addHashedShader(&lightCullingShader, &pDepthPyramidDownsampleShader);
 
 		ShaderLoadDesc lightPassShader = {};
 		lightPassShader.mStages[0].pFileName = "deferredLighting.vert";
 		lightPassShader.mStages[1].pFileName = "deferredLighting.frag";
-		addShader(pRenderer, &lightPassShader, &pDeferredShader);
+		addHashedShader(&lightPassShader, &pDeferredShader);
 	}
 
 	void removeShaders()
 	{
 		removeShader(pRenderer, pGbufferShader);
+		removeShader(pRenderer, pForwardPlusShader);
+		removeShader(pRenderer, pGbufferDrawCullShader);
 		removeShader(pRenderer, pRenderQuadShader);
-		removeShader(pRenderer, pTiledCullShader);
-		removeShader(pRenderer, pTiledCullHalfZShader);
-		removeShader(pRenderer, pTiledCullModifiedZShader);
+		for (uint32_t tileSize = 0; tileSize < TILE_SIZE_COUNT; ++tileSize)
+		{
+			for (uint32_t i = 0; i < LIGHT_LIST_ENCODING_COUNT; ++i)
+			{
+				removeShader(pRenderer, pTiledCullShader[tileSize][i]);
+				removeShader(pRenderer, pTiledCullHalfZShader[tileSize][i]);
+				removeShader(pRenderer, pTiledCullModifiedZShader[tileSize][i]);
+			}
+			removeShader(pRenderer, pTiledCullClusteredShader[tileSize]);
+			removeShader(pRenderer, pDepthPyramidShader[tileSize]);
+		}
+		removeShader(pRenderer, pLightBinningShader);
+		removeShader(pRenderer, pDepthPyramidDownsampleShader);
 		removeShader(pRenderer, pDeferredShader);
 	}
 
@@ -1403,12 +4163,13 @@ public:
 		TinyImageFormat deferredFormats[DEFERRED_RT_COUNT] = {};
 		for (uint32_t i = 0; i < DEFERRED_RT_COUNT; ++i)
 		{
-			deferredFormats[i] = pGbufferRenderTargets[i]->mFormat;
+			deferredFormats[i] = pGbufferRenderTargets[0][i]->mFormat;
 		}
 		
 		{
 			// Gbuffer
 			PipelineDesc desc = {};
+			desc.pCache = pPipelineCache;
 			desc.mType = PIPELINE_TYPE_GRAPHICS;
 			GraphicsPipelineDesc& pipelineSettings = desc.mGraphicsDesc;
 			pipelineSettings.mPrimitiveTopo = PRIMITIVE_TOPO_TRI_LIST;
@@ -1416,18 +4177,55 @@ public:
 			pipelineSettings.pDepthState = &depthStateDesc;
 			pipelineSettings.pColorFormats = deferredFormats;
 
-			pipelineSettings.mSampleCount = pGbufferRenderTargets[0]->mSampleCount;
-			pipelineSettings.mSampleQuality = pGbufferRenderTargets[0]->mSampleQuality;
-			pipelineSettings.mDepthStencilFormat = pDepthBuffer->mFormat;
+			pipelineSettings.mSampleCount = pGbufferRenderTargets[0][0]->mSampleCount;
+			pipelineSettings.mSampleQuality = pGbufferRenderTargets[0][0]->mSampleQuality;
+			pipelineSettings.mDepthStencilFormat = pDepthBuffer[0]->mFormat;
 			pipelineSettings.pRootSignature = pGbufferRootSignature;
 			pipelineSettings.pShaderProgram = pGbufferShader;
-			pipelineSettings.pVertexLayout = &gVertexLayoutModel;
+			pipelineSettings.pVertexLayout = &gVertexLayoutModelDrawId;
 			pipelineSettings.pRasterizerState = &rasterizerStateDesc;
 			pipelineSettings.mVRFoveatedRendering = true;
 
 			addPipeline(pRenderer, &desc, &pGbufferPipeline);
 		}
 
+		{
+			// Forward+: depth tested against the Gbuffer depth, alpha blended into the swapchain
+			DepthStateDesc depthReadStateDesc = {};
+			depthReadStateDesc.mDepthTest = true;
+			depthReadStateDesc.mDepthWrite = false;
+			depthReadStateDesc.mDepthFunc = CMP_GEQUAL;
+
+			BlendStateDesc blendStateDesc = {};
+			blendStateDesc.mSrcFactors[0] = BC_SRC_ALPHA;
+			blendStateDesc.mDstFactors[0] = BC_ONE_MINUS_SRC_ALPHA;
+			blendStateDesc.mBlendModes[0] = BM_ADD;
+			blendStateDesc.mSrcAlphaFactors[0] = BC_ONE;
+			blendStateDesc.mDstAlphaFactors[0] = BC_ZERO;
+			blendStateDesc.mBlendAlphaModes[0] = BM_ADD;
+			blendStateDesc.mMasks[0] = ALL;
+			blendStateDesc.mRenderTargetMask = BLEND_STATE_TARGET_0;
+
+			PipelineDesc desc = {};
+			desc.pCache = pPipelineCache;
+			desc.mType = PIPELINE_TYPE_GRAPHICS;
+			GraphicsPipelineDesc& pipelineSettings = desc.mGraphicsDesc;
+			pipelineSettings.mPrimitiveTopo = PRIMITIVE_TOPO_TRI_LIST;
+			pipelineSettings.mRenderTargetCount = 1;
+			pipelineSettings.pDepthState = &depthReadStateDesc;
+			pipelineSettings.pBlendState = &blendStateDesc;
+			pipelineSettings.pColorFormats = &pSwapChain->ppRenderTargets[0]->mFormat;
+			pipelineSettings.mSampleCount = pSwapChain->ppRenderTargets[0]->mSampleCount;
+			pipelineSettings.mSampleQuality = pSwapChain->ppRenderTargets[0]->mSampleQuality;
+			pipelineSettings.mDepthStencilFormat = pDepthBuffer[0]->mFormat;
+			pipelineSettings.pRootSignature = pForwardPlusRootSignature;
+			pipelineSettings.pShaderProgram = pForwardPlusShader;
+			pipelineSettings.pVertexLayout = &gVertexLayoutModelDrawId;
+			pipelineSettings.pRasterizerState = &rasterizerNonStateDesc;
+
+			addPipeline(pRenderer, &desc, &pForwardPlusPipeline);
+		}
+
 		//RenderQuad
 		//Position
 		VertexLayout vertexLayoutScreenQuad = {};
@@ -1449,6 +4247,7 @@ public:
 		
 		{
 			PipelineDesc renderQuadDesc = {};
+			renderQuadDesc.pCache = pPipelineCache;
 			renderQuadDesc.mType = PIPELINE_TYPE_GRAPHICS;
 			GraphicsPipelineDesc& pipelineSettings = renderQuadDesc.mGraphicsDesc;
 
@@ -1474,82 +4273,212 @@ public:
 		// Light Culling (compute shader)
 		{
 			PipelineDesc lightCullingDesc = {};
+			lightCullingDesc.pCache = pPipelineCache;
 			lightCullingDesc.mType = PIPELINE_TYPE_COMPUTE;
 			ComputePipelineDesc& cpipelineSettings = lightCullingDesc.mComputeDesc;
-			cpipelineSettings.pShaderProgram = pTiledCullShader;
 			cpipelineSettings.pRootSignature = pTiledCullRootSignature;
-			addPipeline(pRenderer, &lightCullingDesc, &pTiledCullPipeline);
+			for (uint32_t tileSize = 0; tileSize < TILE_SIZE_COUNT; ++tileSize)
+			{
+				for (uint32_t i = 0; i < LIGHT_LIST_ENCODING_COUNT; ++i)
+				{
+					cpipelineSettings.pShaderProgram = pTiledCullShader[tileSize][i];
+					addPipeline(pRenderer, &lightCullingDesc, &pTiledCullPipeline[tileSize][i]);
+
+					cpipelineSettings.pShaderProgram = pTiledCullHalfZShader[tileSize][i];
+					addPipeline(pRenderer, &lightCullingDesc, &pTiledCullHalfZPipeline[tileSize][i]);
+
+					cpipelineSettings.pShaderProgram = pTiledCullModifiedZShader[tileSize][i];
+					addPipeline(pRenderer, &lightCullingDesc, &pTiledCullModifiedZPipeline[tileSize][i]);
+				}
+
+				cpipelineSettings.pShaderProgram = pTiledCullClusteredShader[tileSize];
+				addPipeline(pRenderer, &lightCullingDesc, &pTiledCullClusteredPipeline[tileSize]);
+
+				cpipelineSettings.pShaderProgram = pDepthPyramidShader[tileSize];
+				addPipeline(pRenderer, &lightCullingDesc, &pDepthPyramidPipeline[tileSize]);
+			}
 
-			cpipelineSettings.pShaderProgram = pTiledCullHalfZShader;
+			cpipelineSettings.pShaderProgram = pLightBinningShader;
 			cpipelineSettings.pRootSignature = pTiledCullRootSignature;
-			addPipeline(pRenderer, &lightCullingDesc, &pTiledCullHalfZPipeline);
+			addPipeline(pRenderer, &lightCullingDesc, &pLightBinningPipeline);
 
-			cpipelineSettings.pShaderProgram = pTiledCullModifiedZShader;
+			cpipelineSettings.pShaderProgram = pDepthPyramidDownsampleShader;
 			cpipelineSettings.pRootSignature = pTiledCullRootSignature;
-			addPipeline(pRenderer, &lightCullingDesc, &pTiledCullModifiedZPipeline);
+			addPipeline(pRenderer, &lightCullingDesc, &pDepthPyramidDownsamplePipeline);
+
+			cpipelineSettings.pShaderProgram = pGbufferDrawCullShader;
+			cpipelineSettings.pRootSignature = pGbufferDrawCullRootSignature;
+			addPipeline(pRenderer, &lightCullingDesc, &pGbufferDrawCullPipeline);
 		}
 	}
 
 	void removePipelines()
 	{
 		removePipeline(pRenderer, pGbufferPipeline);
+		removePipeline(pRenderer, pForwardPlusPipeline);
 		removePipeline(pRenderer, pRenderQuadPipeline);
 
-		removePipeline(pRenderer, pTiledCullPipeline);
-		removePipeline(pRenderer, pTiledCullHalfZPipeline);
-		removePipeline(pRenderer, pTiledCullModifiedZPipeline);
+		for (uint32_t tileSize = 0; tileSize < TILE_SIZE_COUNT; ++tileSize)
+		{
+			for (uint32_t i = 0; i < LIGHT_LIST_ENCODING_COUNT; ++i)
+			{
+				removePipeline(pRenderer, pTiledCullPipeline[tileSize][i]);
+				removePipeline(pRenderer, pTiledCullHalfZPipeline[tileSize][i]);
+				removePipeline(pRenderer, pTiledCullModifiedZPipeline[tileSize][i]);
+			}
+			removePipeline(pRenderer, pTiledCullClusteredPipeline[tileSize]);
+			removePipeline(pRenderer, pDepthPyramidPipeline[tileSize]);
+		}
+		removePipeline(pRenderer, pLightBinningPipeline);
+		removePipeline(pRenderer, pDepthPyramidDownsamplePipeline);
+		removePipeline(pRenderer, pGbufferDrawCullPipeline);
 
 		removePipeline(pRenderer, pDeferredPipeline);
 	}
 
+	// All material slots of both textureMaps sets of a frame slot in one update each
+	void updateMaterialTextureSets(uint32_t slot)
+	{
+		DescriptorData param = {};
+		param.pName = "textureMaps";
+		param.ppTextures = pMaterialTextures;
+		param.mCount = MAX_MATERIAL_TEXTURES;
+		updateDescriptorSet(pRenderer, slot, pDescriptorSetGbuffers[0], 1, &param);
+		updateDescriptorSet(pRenderer, slot, pDescriptorSetForwardPlus[0], 1, &param);
+		gMaterialTextureSlotVersion[slot] = gMaterialTextureVersion;
+	}
+
 	void prepareDescriptorSets()
 	{
+		for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			updateMaterialTextureSets(i);
+
 		// Gbuffer
 		{
-			DescriptorData param = {};
-			param.pName = "textureMaps";
-			param.ppTextures = pMaterialTextures;
-			param.mCount = TOTAL_IMGS;
-			updateDescriptorSet(pRenderer, 0, pDescriptorSetGbuffers[0], 1, &param);
-
-			param = {};
-			param.pName = "uniformBlockCamera";
-			for (uint32_t i = 0; i < gDataBufferCount; ++i)
+			DescriptorData params[4] = {};
+			params[0].pName = "uniformBlockCamera";
+			params[1].pName = "drawData";
+			params[1].ppBuffers = &pDrawDataBuffer;
+			params[2].pName = "objectData";
+			params[3].pName = "materialData";
+			params[3].ppBuffers = &pMaterialBuffer;
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			{
+				params[0].ppBuffers = &pCameraBuffer[i];
+				params[2].ppBuffers = &pObjectBuffer[i];
+				updateDescriptorSet(pRenderer, i, pDescriptorSetGbuffers[1], 4, params);
+			}
+		}
+
+		// Gbuffer draw culling
+		{
+			DescriptorData params[7] = {};
+			params[0].pName = "uniformBlockDrawCull";
+			params[1].pName = "drawData";
+			params[1].ppBuffers = &pDrawDataBuffer;
+			params[2].pName = "objectData";
+			params[3].pName = "drawBounds";
+			params[3].ppBuffers = &pDrawBoundsBuffer;
+			params[4].pName = "drawArgs";
+			params[4].ppBuffers = &pDrawArgsBuffer;
+			params[5].pName = "visibleDrawArgs";
+			params[5].ppBuffers = &pVisibleDrawArgsBuffer;
+			params[6].pName = "visibleDrawCount";
+			params[6].ppBuffers = &pVisibleDrawCountBuffer;
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
 			{
-				param.ppBuffers = &pCameraBuffer[i];
-				updateDescriptorSet(pRenderer, i, pDescriptorSetGbuffers[1], 1, &param);
+				params[0].ppBuffers = &pDrawCullUniformBuffer[i];
+				params[2].ppBuffers = &pObjectBuffer[i];
+				updateDescriptorSet(pRenderer, i, pDescriptorSetGbufferDrawCull, 7, params);
 			}
 		}
 		
 		// Light culling Pass
 		{
-			DescriptorData params[4] = {};
+			DescriptorData params[13] = {};
 			params[0].pName = "albedoTexture";
-			params[0].ppTextures = &pGbufferRenderTargets[0]->pTexture;
 			params[1].pName = "normalTexture";
-			params[1].ppTextures = &pGbufferRenderTargets[1]->pTexture;
 			//params[2].pName = "roughnessTexture";
 			//params[2].ppTextures = &pGbufferRenderTargets[2]->pTexture;
 			params[2].pName = "depthTexture";
-			params[2].ppTextures = &pDepthBuffer->pTexture;
 			params[3].pName = "sceneTexture";
-			params[3].ppTextures = &pSceneBuffer->pTexture;
-
-			updateDescriptorSet(pRenderer, 0, pDescriptorSetCullPass[0], 4, params);
+			params[4].pName = "clusterLightGrid";
+			params[4].ppBuffers = &pClusterLightGridBuffer;
+			params[5].pName = "clusterLightIndices";
+			params[5].ppBuffers = &pClusterLightIndicesBuffer;
+			params[6].pName = "lightGrid";
+			params[7].pName = "lightIndices";
+			params[8].pName = "lightBins";
+			params[8].ppBuffers = &pLightBinBuffer;
+			params[9].pName = "lightBinIndices";
+			params[9].ppBuffers = &pLightBinIndicesBuffer;
+			params[10].pName = "depthPyramid";
+			params[10].ppBuffers = &pDepthPyramidBuffer;
+			params[11].pName = "lightOverflow";
+			params[12].pName = "lightOverflowCounters";
+			params[12].ppBuffers = &pLightOverflowCounterBuffer;
+
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			{
+				params[0].ppTextures = &pGbufferRenderTargets[i][0]->pTexture;
+				params[1].ppTextures = &pGbufferRenderTargets[i][1]->pTexture;
+				params[2].ppTextures = &pDepthBuffer[i]->pTexture;
+				params[3].ppTextures = &pSceneBuffer[i]->pTexture;
+				params[6].ppBuffers = &pLightGridBuffer[i];
+				params[7].ppBuffers = &pLightIndexBuffer[i];
+				params[11].ppBuffers = &pLightOverflowBuffer[i];
+
+				updateDescriptorSet(pRenderer, i, pDescriptorSetCullPass[0], 13, params);
+			}
 
 			params[0].pName = "uniformBlockExtCamera";
 			params[1].pName = "uniformBlockLightCull";
 			params[2].pName = "lightPosAndRadius";
 			params[3].pName = "lightColorAndIntensity";
+			params[4].pName = "lightBVHNodes";
+			params[5].pName = "lightBVHRoots";
 
-			for (uint32_t i = 0; i < gDataBufferCount; ++i)
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
 			{
 				params[0].ppBuffers = &pExtCameraBuffer[i];
 				params[1].ppBuffers = &pTileCullDataBuffer[i];
 				params[2].ppBuffers = &pLightPosAndRadiusBuffer[i];
-				params[3].ppBuffers = &pLightColorAndIntensityBuffer[i];
+				params[3].ppBuffers = getLightColorBinding(i);
+				params[4].ppBuffers = &pLightBVHNodeBuffer[i];
+				params[5].ppBuffers = &pLightBVHRootBuffer[i];
+
+				updateDescriptorSet(pRenderer, i, pDescriptorSetCullPass[1], 6, params);
+			}
+		}
 
-				updateDescriptorSet(pRenderer, i, pDescriptorSetCullPass[1], 4, params);
+		// Forward+
+		{
+			DescriptorData params[10] = {};
+			params[0].pName = "uniformBlockCamera";
+			params[1].pName = "lightPosAndRadius";
+			params[2].pName = "lightColorAndIntensity";
+			params[3].pName = "uniformBlockLightCull";
+			params[4].pName = "lightGrid";
+			params[5].pName = "lightIndices";
+			params[6].pName = "drawData";
+			params[6].ppBuffers = &pDrawDataBuffer;
+			params[7].pName = "objectData";
+			params[8].pName = "materialData";
+			params[8].ppBuffers = &pMaterialBuffer;
+			params[9].pName = "lightOverflow";
+
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			{
+				params[0].ppBuffers = &pCameraBuffer[i];
+				params[1].ppBuffers = &pLightPosAndRadiusBuffer[i];
+				params[2].ppBuffers = getLightColorBinding(i);
+				params[3].ppBuffers = &pTileCullDataBuffer[i];
+				params[4].ppBuffers = &pLightGridBuffer[i];
+				params[5].ppBuffers = &pLightIndexBuffer[i];
+				params[7].ppBuffers = &pObjectBuffer[i];
+				params[9].ppBuffers = &pLightOverflowBuffer[i];
+
+				updateDescriptorSet(pRenderer, i, pDescriptorSetForwardPlus[1], 10, params);
 			}
 		}
 
@@ -1557,226 +4486,129 @@ public:
 		{
 			DescriptorData param = {};
 			param.pName = "sceneTexture";
-			param.ppTextures = &pSceneBuffer->pTexture;
-			
-			updateDescriptorSet(pRenderer, 0, pDescritporSetRenderQuad, 1, &param);
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			{
+				param.ppTextures = &pSceneBuffer[i]->pTexture;
+				updateDescriptorSet(pRenderer, i, pDescritporSetRenderQuad, 1, &param);
+			}
 		}
 
 		{
 			DescriptorData params[3] = {};
 			params[0].pName = "albedoTexture";
-			params[0].ppTextures = &pGbufferRenderTargets[0]->pTexture;
 			params[1].pName = "normalTexture";
-			params[1].ppTextures = &pGbufferRenderTargets[1]->pTexture;
 			//params[2].pName = "roughnessTexture";
 			//params[2].ppTextures = &pGbufferRenderTargets[2]->pTexture;
 			params[2].pName = "depthTexture";
-			params[2].ppTextures = &pDepthBuffer->pTexture;
-
-			updateDescriptorSet(pRenderer, 0, pDescriptorSetDeferredLightPass[0], 3, params);
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
+			{
+				params[0].ppTextures = &pGbufferRenderTargets[i][0]->pTexture;
+				params[1].ppTextures = &pGbufferRenderTargets[i][1]->pTexture;
+				params[2].ppTextures = &pDepthBuffer[i]->pTexture;
+				updateDescriptorSet(pRenderer, i, pDescriptorSetDeferredLightPass[0], 3, params);
+			}
 
 			params[0].pName = "uniformBlockCamera";
 			params[1].pName = "lightPosAndRadius";
 			params[2].pName = "lightColorAndIntensity";
 
-			for (uint32_t i = 0; i < gDataBufferCount; ++i)
+			for (uint32_t i = 0; i < gFramesInFlight; ++i)
 			{
 				params[0].ppBuffers = &pCameraBuffer[i];
 				params[1].ppBuffers = &pLightPosAndRadiusBuffer[i];
-				params[2].ppBuffers = &pLightColorAndIntensityBuffer[i];
+				params[2].ppBuffers = getLightColorBinding(i);
 
 				updateDescriptorSet(pRenderer, i, pDescriptorSetDeferredLightPass[1], 3, params);
 			}
 		}
 	}
 
-	/* Sponza Model Texture Index Setting */
-	void assignSponzaTextures()
+	/* Material table: the Sponza materials take IDs 0 - 25 in gMaterialIds order, then one material per single mesh */
+	void addMaterials()
 	{
-		int AO = 5;
-		int NoMetallic = 6;
+		const uint32_t AO = 5;
+		const uint32_t NoMetallic = 6;
 
 		//00 : leaf
-		gSponzaTextureIndexForMaterial[0][0] = 66;
-		gSponzaTextureIndexForMaterial[0][1] = 67;
-		gSponzaTextureIndexForMaterial[0][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[0][3] = 68;
-		gSponzaTextureIndexForMaterial[0][4] = AO;
+		addMaterial(66, 67, NoMetallic, 68, AO);
 
 		//01 : vase_round
-		gSponzaTextureIndexForMaterial[1][0] = 78;
-		gSponzaTextureIndexForMaterial[1][1] = 79;
-		gSponzaTextureIndexForMaterial[1][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[1][3] = 80;
-		gSponzaTextureIndexForMaterial[1][4] = AO;
+		addMaterial(78, 79, NoMetallic, 80, AO);
 
 		// 02 : 16___Default (gi_flag)
-		gSponzaTextureIndexForMaterial[2][0] = 8;
-		gSponzaTextureIndexForMaterial[2][1] = 8;    // !!!!!!
-		gSponzaTextureIndexForMaterial[2][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[2][3] = 8;    // !!!!!
-		gSponzaTextureIndexForMaterial[2][4] = AO;
+		addMaterial(8, 8, NoMetallic, 8, AO);
 
 		//03 : Material__57 (Plant)
-		gSponzaTextureIndexForMaterial[3][0] = 75;
-		gSponzaTextureIndexForMaterial[3][1] = 76;
-		gSponzaTextureIndexForMaterial[3][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[3][3] = 77;
-		gSponzaTextureIndexForMaterial[3][4] = AO;
+		addMaterial(75, 76, NoMetallic, 77, AO);
 
 		// 04 : Material__298
-		gSponzaTextureIndexForMaterial[4][0] = 9;
-		gSponzaTextureIndexForMaterial[4][1] = 10;
-		gSponzaTextureIndexForMaterial[4][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[4][3] = 11;
-		gSponzaTextureIndexForMaterial[4][4] = AO;
+		addMaterial(9, 10, NoMetallic, 11, AO);
 
 		// 05 : bricks
-		gSponzaTextureIndexForMaterial[5][0] = 22;
-		gSponzaTextureIndexForMaterial[5][1] = 23;
-		gSponzaTextureIndexForMaterial[5][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[5][3] = 24;
-		gSponzaTextureIndexForMaterial[5][4] = AO;
+		addMaterial(22, 23, NoMetallic, 24, AO);
 
 		// 06 :  arch
-		gSponzaTextureIndexForMaterial[6][0] = 19;
-		gSponzaTextureIndexForMaterial[6][1] = 20;
-		gSponzaTextureIndexForMaterial[6][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[6][3] = 21;
-		gSponzaTextureIndexForMaterial[6][4] = AO;
+		addMaterial(19, 20, NoMetallic, 21, AO);
 
 		// 07 : ceiling
-		gSponzaTextureIndexForMaterial[7][0] = 25;
-		gSponzaTextureIndexForMaterial[7][1] = 26;
-		gSponzaTextureIndexForMaterial[7][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[7][3] = 27;
-		gSponzaTextureIndexForMaterial[7][4] = AO;
+		addMaterial(25, 26, NoMetallic, 27, AO);
 
 		// 08 : column_a
-		gSponzaTextureIndexForMaterial[8][0] = 28;
-		gSponzaTextureIndexForMaterial[8][1] = 29;
-		gSponzaTextureIndexForMaterial[8][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[8][3] = 30;
-		gSponzaTextureIndexForMaterial[8][4] = AO;
+		addMaterial(28, 29, NoMetallic, 30, AO);
 
 		// 09 : Floor
-		gSponzaTextureIndexForMaterial[9][0] = 60;
-		gSponzaTextureIndexForMaterial[9][1] = 61;
-		gSponzaTextureIndexForMaterial[9][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[9][3] = 6;
-		gSponzaTextureIndexForMaterial[9][4] = AO;
+		addMaterial(60, 61, NoMetallic, 6, AO);
 
 		// 10 : column_c
-		gSponzaTextureIndexForMaterial[10][0] = 34;
-		gSponzaTextureIndexForMaterial[10][1] = 35;
-		gSponzaTextureIndexForMaterial[10][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[10][3] = 36;
-		gSponzaTextureIndexForMaterial[10][4] = AO;
+		addMaterial(34, 35, NoMetallic, 36, AO);
 
 		// 11 : details
-		gSponzaTextureIndexForMaterial[11][0] = 45;
-		gSponzaTextureIndexForMaterial[11][1] = 47;
-		gSponzaTextureIndexForMaterial[11][2] = 46;
-		gSponzaTextureIndexForMaterial[11][3] = 48;
-		gSponzaTextureIndexForMaterial[11][4] = AO;
+		addMaterial(45, 47, 46, 48, AO);
 
 		// 12 : column_b
-		gSponzaTextureIndexForMaterial[12][0] = 31;
-		gSponzaTextureIndexForMaterial[12][1] = 32;
-		gSponzaTextureIndexForMaterial[12][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[12][3] = 33;
-		gSponzaTextureIndexForMaterial[12][4] = AO;
+		addMaterial(31, 32, NoMetallic, 33, AO);
 
 		// 13 : flagpole
-		gSponzaTextureIndexForMaterial[13][0] = 57;
-		gSponzaTextureIndexForMaterial[13][1] = 58;
-		gSponzaTextureIndexForMaterial[13][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[13][3] = 59;
-		gSponzaTextureIndexForMaterial[13][4] = AO;
+		addMaterial(57, 58, NoMetallic, 59, AO);
 
 		// 14 : fabric_e (green)
-		gSponzaTextureIndexForMaterial[14][0] = 51;
-		gSponzaTextureIndexForMaterial[14][1] = 52;
-		gSponzaTextureIndexForMaterial[14][2] = 53;
-		gSponzaTextureIndexForMaterial[14][3] = 54;
-		gSponzaTextureIndexForMaterial[14][4] = AO;
+		addMaterial(51, 52, 53, 54, AO);
 
 		// 15 : fabric_d (blue)
-		gSponzaTextureIndexForMaterial[15][0] = 49;
-		gSponzaTextureIndexForMaterial[15][1] = 50;
-		gSponzaTextureIndexForMaterial[15][2] = 53;
-		gSponzaTextureIndexForMaterial[15][3] = 54;
-		gSponzaTextureIndexForMaterial[15][4] = AO;
+		addMaterial(49, 50, 53, 54, AO);
 
 		// 16 : fabric_a (red)
-		gSponzaTextureIndexForMaterial[16][0] = 55;
-		gSponzaTextureIndexForMaterial[16][1] = 56;
-		gSponzaTextureIndexForMaterial[16][2] = 53;
-		gSponzaTextureIndexForMaterial[16][3] = 54;
-		gSponzaTextureIndexForMaterial[16][4] = AO;
+		addMaterial(55, 56, 53, 54, AO);
 
 		// 17 : fabric_g (curtain_blue)
-		gSponzaTextureIndexForMaterial[17][0] = 37;
-		gSponzaTextureIndexForMaterial[17][1] = 38;
-		gSponzaTextureIndexForMaterial[17][2] = 43;
-		gSponzaTextureIndexForMaterial[17][3] = 44;
-		gSponzaTextureIndexForMaterial[17][4] = AO;
+		addMaterial(37, 38, 43, 44, AO);
 
 		// 18 : fabric_c (curtain_red)
-		gSponzaTextureIndexForMaterial[18][0] = 41;
-		gSponzaTextureIndexForMaterial[18][1] = 42;
-		gSponzaTextureIndexForMaterial[18][2] = 43;
-		gSponzaTextureIndexForMaterial[18][3] = 44;
-		gSponzaTextureIndexForMaterial[18][4] = AO;
+		addMaterial(41, 42, 43, 44, AO);
 
 		// 19 : fabric_f (curtain_green)
-		gSponzaTextureIndexForMaterial[19][0] = 39;
-		gSponzaTextureIndexForMaterial[19][1] = 40;
-		gSponzaTextureIndexForMaterial[19][2] = 43;
-		gSponzaTextureIndexForMaterial[19][3] = 44;
-		gSponzaTextureIndexForMaterial[19][4] = AO;
+		addMaterial(39, 40, 43, 44, AO);
 
 		// 20 : chain
-		gSponzaTextureIndexForMaterial[20][0] = 12;
-		gSponzaTextureIndexForMaterial[20][1] = 14;
-		gSponzaTextureIndexForMaterial[20][2] = 13;
-		gSponzaTextureIndexForMaterial[20][3] = 15;
-		gSponzaTextureIndexForMaterial[20][4] = AO;
+		addMaterial(12, 14, 13, 15, AO);
 
 		// 21 : vase_hanging
-		gSponzaTextureIndexForMaterial[21][0] = 72;
-		gSponzaTextureIndexForMaterial[21][1] = 73;
-		gSponzaTextureIndexForMaterial[21][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[21][3] = 74;
-		gSponzaTextureIndexForMaterial[21][4] = AO;
+		addMaterial(72, 73, NoMetallic, 74, AO);
 
 		// 22 : vase
-		gSponzaTextureIndexForMaterial[22][0] = 69;
-		gSponzaTextureIndexForMaterial[22][1] = 70;
-		gSponzaTextureIndexForMaterial[22][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[22][3] = 71;
-		gSponzaTextureIndexForMaterial[22][4] = AO;
+		addMaterial(69, 70, NoMetallic, 71, AO);
 
 		// 23 : Material__25 (lion)
-		gSponzaTextureIndexForMaterial[23][0] = 16;
-		gSponzaTextureIndexForMaterial[23][1] = 17;
-		gSponzaTextureIndexForMaterial[23][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[23][3] = 18;
-		gSponzaTextureIndexForMaterial[23][4] = AO;
+		addMaterial(16, 17, NoMetallic, 18, AO);
 
 		// 24 : roof
-		gSponzaTextureIndexForMaterial[24][0] = 63;
-		gSponzaTextureIndexForMaterial[24][1] = 64;
-		gSponzaTextureIndexForMaterial[24][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[24][3] = 65;
-		gSponzaTextureIndexForMaterial[24][4] = AO;
+		addMaterial(63, 64, NoMetallic, 65, AO);
 
 		// 25 : Material__47 - it seems missing
-		gSponzaTextureIndexForMaterial[25][0] = 19;
-		gSponzaTextureIndexForMaterial[25][1] = 20;
-		gSponzaTextureIndexForMaterial[25][2] = NoMetallic;
-		gSponzaTextureIndexForMaterial[25][3] = 21;
-		gSponzaTextureIndexForMaterial[25][4] = AO;
+		addMaterial(19, 20, NoMetallic, 21, AO);
+
+		// single meshes
+		gObjectInfo[LION_MODEL].mMaterialId = addMaterial(81, 83, NoMetallic, NoMetallic, AO);
 	}
 };
 
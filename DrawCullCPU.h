@@ -0,0 +1,533 @@
+#ifndef DRAWCULLCPU_H
+#define DRAWCULLCPU_H
+
+// CPU culling of the Sponza submeshes before the Gbuffer draws are gathered. The load time boxes stay in object space
+// and are tested against the frustum planes of projection-view * world in SIMD batches (AVX2: 8 boxes, SSE: 4 boxes).
+// Optionally the largest opaque submeshes are rasterized into a small reverse Z depth buffer (only fully covered pixels,
+// at the farthest depth of each triangle) and the surviving boxes are rejected when their screen rect lies behind it.
+// Works on plain arrays, so it can be checked and benchmarked without a renderer.
+#include <float.h>
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+#include "../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../Common_3/Utilities/Interfaces/ITime.h"
+#include "../../../../Common_3/Utilities/Threading/ThreadSystem.h"
+#include "../../../../Common_3/Utilities/Math/MathTypes.h"
+#include "../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+// box arrays are padded to this so every SIMD path can use aligned full-width loads
+#define DRAW_CULL_CPU_ALIGN 8
+#define DRAW_CULL_CPU_CHUNK 256
+#define DRAW_CULL_CPU_DEPTH_WIDTH 128
+#define DRAW_CULL_CPU_DEPTH_HEIGHT 64
+#define DRAW_CULL_CPU_MAX_OCCLUDERS 16
+#define DRAW_CULL_CPU_MAX_OCCLUDER_TRIANGLES 16384
+#define DRAW_CULL_CPU_MIN_W 1e-3f // clip w below which a box counts as crossing the near plane
+
+enum DrawCullCpuResult
+{
+	DRAW_CULL_CPU_VISIBLE = 0,
+	DRAW_CULL_CPU_FRUSTUM_CULLED,
+	DRAW_CULL_CPU_OCCLUDED,
+};
+
+struct DrawCullCpuDesc
+{
+	mat4 mProjectView; // UniformCamData::mProjectView (reverse Z)
+	mat4 mWorld;       // object matrix of the boxes and occluders
+	bool mOcclusion;   // software occlusion after the frustum test
+	bool mScalar;      // skip the SIMD kernel (used to cross-check it)
+};
+
+struct DrawCullCpuOccluder
+{
+	uint32_t mDraw;
+	uint32_t mFirstVertex; // 3 vertices per triangle in pOccluderVertices
+	uint32_t mTriangleCount;
+};
+
+struct DrawCullCpu
+{
+	ThreadSystem*       pThreadSystem;
+	uint32_t            mCount;
+	uint32_t            mCapacity; // multiple of DRAW_CULL_CPU_ALIGN
+
+	// object space boxes (SoA)
+	float*              pCenterX;
+	float*              pCenterY;
+	float*              pCenterZ;
+	float*              pExtentX;
+	float*              pExtentY;
+	float*              pExtentZ;
+
+	// DrawCullCpuResult per box, valid until the next cullDrawsCpu()
+	uint8_t*            pResults;
+
+	// object space occluder triangles
+	DrawCullCpuOccluder mOccluders[DRAW_CULL_CPU_MAX_OCCLUDERS];
+	uint32_t            mOccluderCount;
+	vec3*               pOccluderVertices;
+	uint32_t            mOccluderVertexCount;
+
+	// nearest occluder depth per pixel, 0 = nothing rasterized
+	float*              pDepth;
+
+	// current cullDrawsCpu() call
+	DrawCullCpuDesc     mDesc;
+	mat4                mClip;      // projection-view * world
+	vec4                mPlanes[6]; // object space frustum planes
+
+	// last cullDrawsCpu() call
+	uint32_t            mFrustumCulledCount;
+	uint32_t            mOccludedCount;
+	double              mLastMilliseconds;
+};
+
+static float* drawCullCpuAlloc(uint32_t capacity) { return (float*)tf_memalign(32, capacity * sizeof(float)); }
+
+// box against the object space planes, visible when it is on the inner side of all of them
+static inline bool drawCullCpuFrustumBox(const DrawCullCpu* pCull, uint32_t i)
+{
+	for (uint32_t p = 0; p < 6; ++p)
+	{
+		const vec4& plane = pCull->mPlanes[p];
+		const float distance = plane.getX() * pCull->pCenterX[i] + plane.getY() * pCull->pCenterY[i] + plane.getZ() * pCull->pCenterZ[i] + plane.getW();
+		const float radius = fabsf(plane.getX()) * pCull->pExtentX[i] + fabsf(plane.getY()) * pCull->pExtentY[i] + fabsf(plane.getZ()) * pCull->pExtentZ[i];
+		if (distance + radius < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+static void drawCullCpuFrustumChunk(void* pUserData, uint64_t chunk)
+{
+	DrawCullCpu* pCull = (DrawCullCpu*)pUserData;
+	const uint32_t begin = (uint32_t)chunk * DRAW_CULL_CPU_CHUNK;
+	const uint32_t end = min(begin + DRAW_CULL_CPU_CHUNK, pCull->mCount);
+	uint32_t i = begin;
+
+	if (!pCull->mDesc.mScalar)
+	{
+#if defined(__AVX2__)
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+		for (; i + 8 <= end; i += 8)
+		{
+			const __m256 cx = _mm256_load_ps(pCull->pCenterX + i);
+			const __m256 cy = _mm256_load_ps(pCull->pCenterY + i);
+			const __m256 cz = _mm256_load_ps(pCull->pCenterZ + i);
+			const __m256 ex = _mm256_load_ps(pCull->pExtentX + i);
+			const __m256 ey = _mm256_load_ps(pCull->pExtentY + i);
+			const __m256 ez = _mm256_load_ps(pCull->pExtentZ + i);
+
+			__m256 outside = _mm256_setzero_ps();
+			for (uint32_t p = 0; p < 6; ++p)
+			{
+				const vec4& plane = pCull->mPlanes[p];
+				const __m256 a = _mm256_set1_ps(plane.getX());
+				const __m256 b = _mm256_set1_ps(plane.getY());
+				const __m256 c = _mm256_set1_ps(plane.getZ());
+				__m256 distance = _mm256_add_ps(_mm256_mul_ps(a, cx), _mm256_mul_ps(b, cy));
+				distance = _mm256_add_ps(distance, _mm256_add_ps(_mm256_mul_ps(c, cz), _mm256_set1_ps(plane.getW())));
+				__m256 radius = _mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, a), ex), _mm256_mul_ps(_mm256_andnot_ps(signMask, b), ey));
+				radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_andnot_ps(signMask, c), ez));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_LT_OQ));
+			}
+
+			const int mask = _mm256_movemask_ps(outside);
+			for (uint32_t lane = 0; lane < 8; ++lane)
+				pCull->pResults[i + lane] = ((mask >> lane) & 1) ? DRAW_CULL_CPU_FRUSTUM_CULLED : DRAW_CULL_CPU_VISIBLE;
+		}
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		for (; i + 4 <= end; i += 4)
+		{
+			const __m128 cx = _mm_load_ps(pCull->pCenterX + i);
+			const __m128 cy = _mm_load_ps(pCull->pCenterY + i);
+			const __m128 cz = _mm_load_ps(pCull->pCenterZ + i);
+			const __m128 ex = _mm_load_ps(pCull->pExtentX + i);
+			const __m128 ey = _mm_load_ps(pCull->pExtentY + i);
+			const __m128 ez = _mm_load_ps(pCull->pExtentZ + i);
+
+			__m128 outside = _mm_setzero_ps();
+			for (uint32_t p = 0; p < 6; ++p)
+			{
+				const vec4& plane = pCull->mPlanes[p];
+				const __m128 a = _mm_set1_ps(plane.getX());
+				const __m128 b = _mm_set1_ps(plane.getY());
+				const __m128 c = _mm_set1_ps(plane.getZ());
+				__m128 distance = _mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy));
+				distance = _mm_add_ps(distance, _mm_add_ps(_mm_mul_ps(c, cz), _mm_set1_ps(plane.getW())));
+				__m128 radius = _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, a), ex), _mm_mul_ps(_mm_andnot_ps(signMask, b), ey));
+				radius = _mm_add_ps(radius, _mm_mul_ps(_mm_andnot_ps(signMask, c), ez));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+			}
+
+			const int mask = _mm_movemask_ps(outside);
+			for (uint32_t lane = 0; lane < 4; ++lane)
+				pCull->pResults[i + lane] = ((mask >> lane) & 1) ? DRAW_CULL_CPU_FRUSTUM_CULLED : DRAW_CULL_CPU_VISIBLE;
+		}
+#endif
+	}
+
+	// scalar path, also the last boxes of the final chunk
+	for (; i < end; ++i)
+		pCull->pResults[i] = drawCullCpuFrustumBox(pCull, i) ? DRAW_CULL_CPU_VISIBLE : DRAW_CULL_CPU_FRUSTUM_CULLED;
+}
+
+// object space position to (pixel x, pixel y, device depth), false when it is behind the near plane
+static inline bool drawCullCpuProject(const DrawCullCpu* pCull, const vec3& position, vec3* pOut)
+{
+	const vec4 clip = pCull->mClip * vec4(position, 1.0f);
+	if (clip.getW() < DRAW_CULL_CPU_MIN_W)
+		return false;
+
+	const float invW = 1.0f / clip.getW();
+	*pOut = vec3((clip.getX() * invW * 0.5f + 0.5f) * (float)DRAW_CULL_CPU_DEPTH_WIDTH, (0.5f - clip.getY() * invW * 0.5f) * (float)DRAW_CULL_CPU_DEPTH_HEIGHT,
+		clip.getZ() * invW);
+	return true;
+}
+
+// Writes the farthest depth of the triangle into the pixels it covers completely, so the buffer never claims more than the occluders hide.
+// Triangles crossing the near plane are skipped for the same reason.
+static void drawCullCpuRasterizeTriangle(DrawCullCpu* pCull, const vec3* pVertices)
+{
+	vec3 v[3];
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		if (!drawCullCpuProject(pCull, pVertices[k], &v[k]))
+			return;
+	}
+
+	float area = (v[1].getX() - v[0].getX()) * (v[2].getY() - v[0].getY()) - (v[1].getY() - v[0].getY()) * (v[2].getX() - v[0].getX());
+	if (area == 0.0f)
+		return;
+	if (area < 0.0f)
+	{
+		const vec3 t = v[1];
+		v[1] = v[2];
+		v[2] = t;
+	}
+
+	const int x0 = max(0, (int)floorf(min(v[0].getX(), min(v[1].getX(), v[2].getX()))));
+	const int y0 = max(0, (int)floorf(min(v[0].getY(), min(v[1].getY(), v[2].getY()))));
+	const int x1 = min(DRAW_CULL_CPU_DEPTH_WIDTH - 1, (int)ceilf(max(v[0].getX(), max(v[1].getX(), v[2].getX()))));
+	const int y1 = min(DRAW_CULL_CPU_DEPTH_HEIGHT - 1, (int)ceilf(max(v[0].getY(), max(v[1].getY(), v[2].getY()))));
+	if (x0 > x1 || y0 > y1)
+		return;
+
+	// edge a -> b: e(p) = A * p.x + B * p.y + C, >= 0 inside. Shifting by half the pixel footprint tests the worst corner.
+	float edgeA[3], edgeB[3], edgeC[3];
+	for (uint32_t k = 0; k < 3; ++k)
+	{
+		const vec3& a = v[k];
+		const vec3& b = v[(k + 1) % 3];
+		edgeA[k] = a.getY() - b.getY();
+		edgeB[k] = b.getX() - a.getX();
+		edgeC[k] = -(edgeA[k] * a.getX() + edgeB[k] * a.getY()) - 0.5f * (fabsf(edgeA[k]) + fabsf(edgeB[k]));
+	}
+
+	const float depth = min(v[0].getZ(), min(v[1].getZ(), v[2].getZ()));
+	for (int y = y0; y <= y1; ++y)
+	{
+		const float py = (float)y + 0.5f;
+		float* pRow = pCull->pDepth + y * DRAW_CULL_CPU_DEPTH_WIDTH;
+		for (int x = x0; x <= x1; ++x)
+		{
+			const float px = (float)x + 0.5f;
+			if (edgeA[0] * px + edgeB[0] * py + edgeC[0] >= 0.0f && edgeA[1] * px + edgeB[1] * py + edgeC[1] >= 0.0f &&
+				edgeA[2] * px + edgeB[2] * py + edgeC[2] >= 0.0f)
+				pRow[x] = max(pRow[x], depth);
+		}
+	}
+}
+
+// Box behind the depth buffer in every pixel of its screen rect
+static bool drawCullCpuOccludedBox(const DrawCullCpu* pCull, uint32_t i)
+{
+	const vec3 center(pCull->pCenterX[i], pCull->pCenterY[i], pCull->pCenterZ[i]);
+	const vec3 extent(pCull->pExtentX[i], pCull->pExtentY[i], pCull->pExtentZ[i]);
+
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearestDepth = 0.0f;
+	for (uint32_t corner = 0; corner < 8; ++corner)
+	{
+		const vec3 offset((corner & 1) ? extent.getX() : -extent.getX(), (corner & 2) ? extent.getY() : -extent.getY(), (corner & 4) ? extent.getZ() : -extent.getZ());
+		vec3 p;
+		if (!drawCullCpuProject(pCull, center + offset, &p))
+			return false;
+
+		minX = min(minX, p.getX());
+		minY = min(minY, p.getY());
+		maxX = max(maxX, p.getX());
+		maxY = max(maxY, p.getY());
+		nearestDepth = max(nearestDepth, p.getZ());
+	}
+
+	const int x0 = max(0, (int)floorf(minX));
+	const int y0 = max(0, (int)floorf(minY));
+	const int x1 = min(DRAW_CULL_CPU_DEPTH_WIDTH - 1, (int)floorf(maxX));
+	const int y1 = min(DRAW_CULL_CPU_DEPTH_HEIGHT - 1, (int)floorf(maxY));
+	if (x0 > x1 || y0 > y1)
+		return false;
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		const float* pRow = pCull->pDepth + y * DRAW_CULL_CPU_DEPTH_WIDTH;
+		for (int x = x0; x <= x1; ++x)
+		{
+			if (pRow[x] <= nearestDepth)
+				return false;
+		}
+	}
+	return true;
+}
+
+static void drawCullCpuOcclusionChunk(void* pUserData, uint64_t chunk)
+{
+	DrawCullCpu* pCull = (DrawCullCpu*)pUserData;
+	const uint32_t begin = (uint32_t)chunk * DRAW_CULL_CPU_CHUNK;
+	const uint32_t end = min(begin + DRAW_CULL_CPU_CHUNK, pCull->mCount);
+
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		if (pCull->pResults[i] == DRAW_CULL_CPU_VISIBLE && drawCullCpuOccludedBox(pCull, i))
+			pCull->pResults[i] = DRAW_CULL_CPU_OCCLUDED;
+	}
+}
+
+static void drawCullCpuDispatch(DrawCullCpu* pCull, TaskFunc pTask, uint32_t count)
+{
+	if (pCull->pThreadSystem && count > 1)
+	{
+		addThreadSystemRangeTask(pCull->pThreadSystem, pTask, pCull, count);
+		waitThreadSystemIdle(pCull->pThreadSystem);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < count; ++i)
+			pTask(pCull, i);
+	}
+}
+
+void initDrawCullCpu(ThreadSystem* pThreadSystem, DrawCullCpu* pCull)
+{
+	*pCull = {};
+	pCull->pThreadSystem = pThreadSystem;
+	pCull->pDepth = (float*)tf_malloc(DRAW_CULL_CPU_DEPTH_WIDTH * DRAW_CULL_CPU_DEPTH_HEIGHT * sizeof(float));
+}
+
+void exitDrawCullCpu(DrawCullCpu* pCull)
+{
+	tf_free(pCull->pCenterX);
+	tf_free(pCull->pCenterY);
+	tf_free(pCull->pCenterZ);
+	tf_free(pCull->pExtentX);
+	tf_free(pCull->pExtentY);
+	tf_free(pCull->pExtentZ);
+	tf_free(pCull->pResults);
+	tf_free(pCull->pOccluderVertices);
+	tf_free(pCull->pDepth);
+	*pCull = {};
+}
+
+/**
+ * @brief Copies count object space boxes, stored as (center, extents) vec4 pairs like gDrawBounds, and drops the occluders.
+ */
+void setDrawCullCpuBounds(DrawCullCpu* pCull, const vec4* pBounds, uint32_t count)
+{
+	const uint32_t capacity = (count + DRAW_CULL_CPU_ALIGN - 1) & ~(DRAW_CULL_CPU_ALIGN - 1);
+	if (capacity > pCull->mCapacity)
+	{
+		tf_free(pCull->pCenterX);
+		tf_free(pCull->pCenterY);
+		tf_free(pCull->pCenterZ);
+		tf_free(pCull->pExtentX);
+		tf_free(pCull->pExtentY);
+		tf_free(pCull->pExtentZ);
+		tf_free(pCull->pResults);
+
+		pCull->pCenterX = drawCullCpuAlloc(capacity);
+		pCull->pCenterY = drawCullCpuAlloc(capacity);
+		pCull->pCenterZ = drawCullCpuAlloc(capacity);
+		pCull->pExtentX = drawCullCpuAlloc(capacity);
+		pCull->pExtentY = drawCullCpuAlloc(capacity);
+		pCull->pExtentZ = drawCullCpuAlloc(capacity);
+		pCull->pResults = (uint8_t*)tf_malloc(capacity);
+		pCull->mCapacity = capacity;
+	}
+
+	pCull->mCount = count;
+	for (uint32_t i = 0; i < capacity; ++i)
+	{
+		const vec4 center = i < count ? pBounds[i * 2 + 0] : vec4(0.0f);
+		const vec4 extent = i < count ? pBounds[i * 2 + 1] : vec4(0.0f);
+		pCull->pCenterX[i] = center.getX();
+		pCull->pCenterY[i] = center.getY();
+		pCull->pCenterZ[i] = center.getZ();
+		pCull->pExtentX[i] = extent.getX();
+		pCull->pExtentY[i] = extent.getY();
+		pCull->pExtentZ[i] = extent.getZ();
+	}
+
+	pCull->mOccluderCount = 0;
+	pCull->mOccluderVertexCount = 0;
+}
+
+/**
+ * @brief Adds the object space triangles (3 vertices each) of box draw as an occluder. Returns false when the occluder or triangle budget is used up.
+ * The occluder is only rasterized when its own box survives the frustum test.
+ */
+bool addDrawCullCpuOccluder(DrawCullCpu* pCull, uint32_t draw, const vec3* pVertices, uint32_t triangleCount)
+{
+	if (pCull->mOccluderCount == DRAW_CULL_CPU_MAX_OCCLUDERS || pCull->mOccluderVertexCount / 3 + triangleCount > DRAW_CULL_CPU_MAX_OCCLUDER_TRIANGLES)
+		return false;
+
+	if (!pCull->pOccluderVertices)
+		pCull->pOccluderVertices = (vec3*)tf_memalign(16, DRAW_CULL_CPU_MAX_OCCLUDER_TRIANGLES * 3 * sizeof(vec3));
+
+	DrawCullCpuOccluder& occluder = pCull->mOccluders[pCull->mOccluderCount++];
+	occluder.mDraw = draw;
+	occluder.mFirstVertex = pCull->mOccluderVertexCount;
+	occluder.mTriangleCount = triangleCount;
+	memcpy(pCull->pOccluderVertices + pCull->mOccluderVertexCount, pVertices, triangleCount * 3 * sizeof(vec3));
+	pCull->mOccluderVertexCount += triangleCount * 3;
+	return true;
+}
+
+/**
+ * @brief Culls every box, blocking. pResults holds a DrawCullCpuResult per box until the next call.
+ */
+void cullDrawsCpu(DrawCullCpu* pCull, const DrawCullCpuDesc* pDesc)
+{
+	HiresTimer timer;
+	initHiresTimer(&timer);
+
+	// planes from the rows of the clip matrix (reverse Z: near at z = w, far at z = 0), in object space since the matrix includes world
+	pCull->mDesc = *pDesc;
+	pCull->mClip = pDesc->mProjectView * pDesc->mWorld;
+	const mat4& clip = pCull->mClip;
+	pCull->mPlanes[0] = clip.getRow(3) + clip.getRow(0);
+	pCull->mPlanes[1] = clip.getRow(3) - clip.getRow(0);
+	pCull->mPlanes[2] = clip.getRow(3) + clip.getRow(1);
+	pCull->mPlanes[3] = clip.getRow(3) - clip.getRow(1);
+	pCull->mPlanes[4] = clip.getRow(3) - clip.getRow(2);
+	pCull->mPlanes[5] = clip.getRow(2);
+
+	const uint32_t chunkCount = (pCull->mCount + DRAW_CULL_CPU_CHUNK - 1) / DRAW_CULL_CPU_CHUNK;
+	drawCullCpuDispatch(pCull, drawCullCpuFrustumChunk, chunkCount);
+
+	if (pDesc->mOcclusion && pCull->mOccluderCount)
+	{
+		memset(pCull->pDepth, 0, DRAW_CULL_CPU_DEPTH_WIDTH * DRAW_CULL_CPU_DEPTH_HEIGHT * sizeof(float));
+		for (uint32_t o = 0; o < pCull->mOccluderCount; ++o)
+		{
+			const DrawCullCpuOccluder& occluder = pCull->mOccluders[o];
+			if (pCull->pResults[occluder.mDraw] != DRAW_CULL_CPU_VISIBLE)
+				continue;
+
+			for (uint32_t t = 0; t < occluder.mTriangleCount; ++t)
+				drawCullCpuRasterizeTriangle(pCull, pCull->pOccluderVertices + occluder.mFirstVertex + t * 3);
+		}
+
+		drawCullCpuDispatch(pCull, drawCullCpuOcclusionChunk, chunkCount);
+	}
+
+	pCull->mFrustumCulledCount = 0;
+	pCull->mOccludedCount = 0;
+	for (uint32_t i = 0; i < pCull->mCount; ++i)
+	{
+		pCull->mFrustumCulledCount += pCull->pResults[i] == DRAW_CULL_CPU_FRUSTUM_CULLED;
+		pCull->mOccludedCount += pCull->pResults[i] == DRAW_CULL_CPU_OCCLUDED;
+	}
+
+	pCull->mLastMilliseconds = (double)getHiresTimerUSec(&timer, false) / 1000.0;
+}
+
+/************************************************************************/
+// Benchmark
+/************************************************************************/
+// Seeded random boxes around a camera looking down +Z, with a row of walls in front of it as occluders.
+// Logs the average time of the scalar, SIMD and SIMD + occlusion runs and whether SIMD matches scalar.
+void benchmarkDrawCullCpu(ThreadSystem* pThreadSystem, uint32_t numDraws, uint32_t iterations)
+{
+	static const uint32_t wallCount = 6;
+	const uint32_t count = numDraws + wallCount;
+
+	vec4* pBounds = (vec4*)tf_malloc(count * 2 * sizeof(vec4));
+	std::mt19937 mt(1);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> height(0.0f, 20.0f);
+	std::uniform_real_distribution<float> extent(0.1f, 2.0f);
+	for (uint32_t i = 0; i < numDraws; ++i)
+	{
+		pBounds[i * 2 + 0] = vec4(position(mt), height(mt), position(mt), 0.0f);
+		pBounds[i * 2 + 1] = vec4(extent(mt), extent(mt), extent(mt), 0.0f);
+	}
+
+	// walls 20 units ahead, 8 wide and 30 high, side by side across x = [-24, 24]
+	vec3 wallVertices[wallCount * 6];
+	for (uint32_t w = 0; w < wallCount; ++w)
+	{
+		const float x0 = -24.0f + 8.0f * (float)w;
+		const float x1 = x0 + 8.0f;
+		pBounds[(numDraws + w) * 2 + 0] = vec4((x0 + x1) * 0.5f, 15.0f, 20.0f, 0.0f);
+		pBounds[(numDraws + w) * 2 + 1] = vec4(4.0f, 15.0f, 0.0f, 0.0f);
+
+		vec3* pQuad = wallVertices + w * 6;
+		pQuad[0] = vec3(x0, 0.0f, 20.0f);
+		pQuad[1] = vec3(x1, 0.0f, 20.0f);
+		pQuad[2] = vec3(x1, 30.0f, 20.0f);
+		pQuad[3] = vec3(x0, 0.0f, 20.0f);
+		pQuad[4] = vec3(x1, 30.0f, 20.0f);
+		pQuad[5] = vec3(x0, 30.0f, 20.0f);
+	}
+
+	DrawCullCpu cull;
+	initDrawCullCpu(pThreadSystem, &cull);
+	setDrawCullCpuBounds(&cull, pBounds, count);
+	for (uint32_t w = 0; w < wallCount; ++w)
+		addDrawCullCpuOccluder(&cull, numDraws + w, wallVertices + w * 6, 2);
+
+	DrawCullCpuDesc desc = {};
+	desc.mProjectView = mat4::perspectiveLH_ReverseZ(PI / 2.0f, 9.0f / 16.0f, 0.1f, 1000.0f) * mat4::translation(vec3(0.0f, -5.0f, 0.0f));
+	desc.mWorld = mat4::identity();
+
+	// the SIMD path has to match the scalar test
+	uint8_t* pReference = (uint8_t*)tf_malloc(count);
+	desc.mScalar = true;
+	cullDrawsCpu(&cull, &desc);
+	memcpy(pReference, cull.pResults, count);
+	desc.mScalar = false;
+	cullDrawsCpu(&cull, &desc);
+	const bool matchesScalar = memcmp(pReference, cull.pResults, count) == 0;
+
+	static const char* runNames[3] = { "scalar frustum", "SIMD frustum", "SIMD frustum + occlusion" };
+	const uint32_t threadCount = pThreadSystem ? getThreadSystemThreadCount(pThreadSystem) : 1;
+	for (uint32_t run = 0; run < 3; ++run)
+	{
+		desc.mScalar = run == 0;
+		desc.mOcclusion = run == 2;
+
+		double totalMilliseconds = 0.0;
+		for (uint32_t i = 0; i < iterations; ++i)
+		{
+			cullDrawsCpu(&cull, &desc);
+			totalMilliseconds += cull.mLastMilliseconds;
+		}
+
+		LOGF(eINFO, "CPU draw cull %-24s: %u boxes, %u threads, avg %.3f ms, %u frustum culled, %u occluded", runNames[run], count, threadCount,
+			totalMilliseconds / (double)max(iterations, 1u), cull.mFrustumCulledCount, cull.mOccludedCount);
+	}
+	LOGF(eINFO, "CPU draw cull: SIMD %s scalar", matchesScalar ? "matches" : "DIFFERS from");
+
+	exitDrawCullCpu(&cull);
+	tf_free(pReference);
+	tf_free(pBounds);
+}
+
+#endif // !DRAWCULLCPU_H
@@ -0,0 +1,138 @@
+#ifndef GBUFFERPACKING_H
+#define GBUFFERPACKING_H
+
+// CPU mirror of the Gbuffer normal / material packing (fillGbuffer.frag OctEncode, pbrFunction.h OctDecode).
+// The second Gbuffer target holds (octahedral normal, roughness, ao): R16G16B16A16_SFLOAT in the wide layout,
+// R10G10B10A2_UNORM in the thin one. Metallic is the 8-bit alpha of the albedo target in both. checkGbufferPacking()
+// round trips seeded random normals and material values through the thin layout quantization and logs the worst errors.
+#include <math.h>
+#include <random>
+
+#include "../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../Common_3/Utilities/Math/MathTypes.h"
+
+#define GBUFFER_THIN_NORMAL_BITS 10
+#define GBUFFER_THIN_ROUGHNESS_BITS 10
+#define GBUFFER_THIN_METALLIC_BITS 8 // albedo target alpha
+#define GBUFFER_THIN_AO_BITS 2       // only scales the ambient term
+// round trip limits of checkGbufferPacking()
+#define GBUFFER_THIN_MAX_NORMAL_DEGREES 0.25f
+#define GBUFFER_THIN_MAX_ROUGHNESS_ERROR (0.5f / 1023.0f + 1e-6f)
+#define GBUFFER_THIN_MAX_METALLIC_ERROR (0.5f / 255.0f + 1e-6f)
+
+// n must be normalized, returns [0, 1]^2
+static inline float2 octEncode(const vec3& n)
+{
+	const float invL1 = 1.0f / (fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]));
+	const float x = n[0] * invL1;
+	const float y = n[1] * invL1;
+
+	float2 f(x, y);
+	if (n[2] < 0.0f)
+	{
+		f.x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		f.y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return float2(f.x * 0.5f + 0.5f, f.y * 0.5f + 0.5f);
+}
+
+static inline vec3 octDecode(const float2& f)
+{
+	float x = f.x * 2.0f - 1.0f;
+	float y = f.y * 2.0f - 1.0f;
+	const float z = 1.0f - fabsf(x) - fabsf(y);
+	const float t = fmaxf(-z, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+	return normalize(vec3(x, y, z));
+}
+
+// what a UNORM render target channel of the given width stores for v
+static inline float quantizeUnorm(float v, uint32_t bits)
+{
+	const float scale = (float)((1u << bits) - 1u);
+	return floorf(fminf(fmaxf(v, 0.0f), 1.0f) * scale + 0.5f) / scale;
+}
+
+struct GbufferPackingError
+{
+	float mMaxNormalDegrees;
+	float mAvgNormalDegrees;
+	float mMaxRoughnessError;
+	float mMaxMetallicError;
+	float mMaxAoError;
+};
+
+static inline float gbufferNormalErrorDegrees(const vec3& n, uint32_t bits)
+{
+	const float2 f = octEncode(n);
+	const vec3 d = octDecode(float2(quantizeUnorm(f.x, bits), quantizeUnorm(f.y, bits)));
+	// atan2 of |n x d| and n . d stays precise for tiny angles, acos does not
+	const float cx = n[1] * d[2] - n[2] * d[1];
+	const float cy = n[2] * d[0] - n[0] * d[2];
+	const float cz = n[0] * d[1] - n[1] * d[0];
+	return atan2f(sqrtf(cx * cx + cy * cy + cz * cz), dot(n, d)) * (180.0f / PI);
+}
+
+GbufferPackingError measureGbufferPacking(uint32_t normalBits, uint32_t sampleCount, uint32_t seed)
+{
+	GbufferPackingError error = {};
+	double sum = 0.0;
+	uint32_t count = 0;
+
+	// the axes and the seams of the octahedron fold are the worst cases
+	const float s = 0.70710678f;
+	const vec3 edgeCases[] = { vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1),
+		vec3(s, s, 0), vec3(-s, s, 0), vec3(s, -s, 0), vec3(-s, -s, 0), vec3(s, 0, -s), vec3(0, -s, -s) };
+	for (const vec3& n : edgeCases)
+	{
+		const float e = gbufferNormalErrorDegrees(n, normalBits);
+		error.mMaxNormalDegrees = fmaxf(error.mMaxNormalDegrees, e);
+		sum += e;
+		++count;
+	}
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (uint32_t i = 0; i < sampleCount; ++i, ++count)
+	{
+		// uniform on the sphere
+		const float z = unit(rng) * 2.0f - 1.0f;
+		const float phi = unit(rng) * 2.0f * PI;
+		const float r = sqrtf(fmaxf(1.0f - z * z, 0.0f));
+		const float e = gbufferNormalErrorDegrees(vec3(r * cosf(phi), r * sinf(phi), z), normalBits);
+		error.mMaxNormalDegrees = fmaxf(error.mMaxNormalDegrees, e);
+		sum += e;
+
+		const float roughness = unit(rng);
+		error.mMaxRoughnessError = fmaxf(error.mMaxRoughnessError, fabsf(quantizeUnorm(roughness, GBUFFER_THIN_ROUGHNESS_BITS) - roughness));
+		const float metallic = unit(rng);
+		error.mMaxMetallicError = fmaxf(error.mMaxMetallicError, fabsf(quantizeUnorm(metallic, GBUFFER_THIN_METALLIC_BITS) - metallic));
+		const float ao = unit(rng);
+		error.mMaxAoError = fmaxf(error.mMaxAoError, fabsf(quantizeUnorm(ao, GBUFFER_THIN_AO_BITS) - ao));
+	}
+
+	error.mAvgNormalDegrees = (float)(sum / (double)count);
+	return error;
+}
+
+// Returns false (and logs an error) if the thin layout misses its limits
+bool checkGbufferPacking(uint32_t sampleCount)
+{
+	const GbufferPackingError thin = measureGbufferPacking(GBUFFER_THIN_NORMAL_BITS, sampleCount, 1234);
+	// the wide layout stores fp16, which keeps 11 significant bits in [0.5, 1]
+	const GbufferPackingError wide = measureGbufferPacking(11, sampleCount, 1234);
+
+	LOGF(eINFO, "Gbuffer packing: thin normal max %.4f deg avg %.4f deg, roughness max %.6f, metallic max %.6f, ao max %.4f (%u samples)",
+		thin.mMaxNormalDegrees, thin.mAvgNormalDegrees, thin.mMaxRoughnessError, thin.mMaxMetallicError, thin.mMaxAoError, sampleCount);
+	LOGF(eINFO, "Gbuffer packing: wide normal max %.4f deg avg %.4f deg", wide.mMaxNormalDegrees, wide.mAvgNormalDegrees);
+
+	const bool passed = thin.mMaxNormalDegrees <= GBUFFER_THIN_MAX_NORMAL_DEGREES && thin.mMaxRoughnessError <= GBUFFER_THIN_MAX_ROUGHNESS_ERROR &&
+						thin.mMaxMetallicError <= GBUFFER_THIN_MAX_METALLIC_ERROR;
+	if (!passed)
+		LOGF(eERROR, "Gbuffer packing round trip exceeds its limits (%.2f deg normal, %.6f roughness, %.6f metallic)", GBUFFER_THIN_MAX_NORMAL_DEGREES,
+			GBUFFER_THIN_MAX_ROUGHNESS_ERROR, GBUFFER_THIN_MAX_METALLIC_ERROR);
+	return passed;
+}
+
+#endif
@@ -0,0 +1,383 @@
+#ifndef LIGHTANIMATION_H
+#define LIGHTANIMATION_H
+
+// Light animation on SoA storage: every light keeps its rest position, radius, a velocity (linear motion)
+// and per axis phases (noise motion). animateLights() evaluates the motion at a time for all lights
+// (AVX2: 8 lights per iteration) in parallel chunks and writes the vec4 (position, radius) array the GPU reads,
+// usually straight into the mapped upload buffer. The motion only depends on the time, so no state is advanced.
+#include <float.h>
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../Common_3/Utilities/Interfaces/ITime.h"
+#include "../../../../Common_3/Utilities/Threading/ThreadSystem.h"
+#include "../../../../Common_3/Utilities/Math/MathTypes.h"
+#include "../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+#define LIGHT_ANIMATION_CHUNK 16384
+#define LIGHT_ANIMATION_ORBIT_SPEED 10.0f  // degrees per second
+#define LIGHT_ANIMATION_LINEAR_SPEED 2.0f  // max units per second
+#define LIGHT_ANIMATION_NOISE_AMPLITUDE 1.0f
+#define LIGHT_ANIMATION_NOISE_FREQUENCY 1.5f
+
+enum LightMotion
+{
+	LIGHT_MOTION_ORBIT = 0, // rotation of the rest position, same for every light
+	LIGHT_MOTION_LINEAR,    // constant velocity, bouncing inside the bounds of the rest positions
+	LIGHT_MOTION_NOISE,     // smooth per light wobble around the rest position
+	LIGHT_MOTION_COUNT
+};
+
+static const char* gLightMotionNames[LIGHT_MOTION_COUNT] = { "Orbit", "Linear", "Noise" };
+
+struct LightAnimation
+{
+	ThreadSystem* pThreadSystem;
+	uint32_t      mNumLights;
+	uint32_t      mCapacity; // multiple of 8
+
+	float*        pRestX;
+	float*        pRestY;
+	float*        pRestZ;
+	float*        pRadius;
+	float*        pVelocityX;
+	float*        pVelocityY;
+	float*        pVelocityZ;
+	float*        pPhaseX;
+	float*        pPhaseY;
+	float*        pPhaseZ;
+
+	float         mBoxMin[3]; // linear motion bounds
+	float         mBoxSize[3];
+
+	// current animateLights() call
+	uint32_t      mMotion;
+	float         mTime;
+	float         mCos;
+	float         mSin;
+	vec4*         pDst;
+	vec4*         pCopy;
+	bool          mStream; // pDst is 32 byte aligned write-combined memory
+
+	double        mLastMilliseconds;
+};
+
+static float* lightAnimationAlloc(uint32_t capacity) { return (float*)tf_memalign(32, capacity * sizeof(float)); }
+
+// Parabolic sine approximation (max error ~0.001), the same formula in the scalar and the SIMD path
+static inline float lightAnimationSin(float x)
+{
+	x -= 2.0f * PI * floorf(x * (0.5f / PI) + 0.5f); // [-PI, PI)
+	float y = (4.0f / PI) * x - (4.0f / (PI * PI)) * x * fabsf(x);
+	return 0.225f * (y * fabsf(y) - y) + y;
+}
+
+// Triangle wave folding of p into [boxMin, boxMin + boxSize]
+static inline float lightAnimationBounce(float p, float boxMin, float boxSize)
+{
+	const float u = p - boxMin;
+	const float period = 2.0f * boxSize;
+	const float m = u - period * floorf(u / period);
+	return boxMin + boxSize - fabsf(m - boxSize);
+}
+
+// Scalar motion of light i for the current animateLights() call
+static inline vec4 lightAnimationEvaluate(const LightAnimation* pAnim, uint32_t i)
+{
+	const float t = pAnim->mTime;
+	const float restX = pAnim->pRestX[i], restY = pAnim->pRestY[i], restZ = pAnim->pRestZ[i];
+	float x, y, z;
+
+	switch (pAnim->mMotion)
+	{
+	case LIGHT_MOTION_ORBIT:
+		x = restX + pAnim->mCos * restY;
+		y = restY + pAnim->mSin * restX;
+		z = restZ;
+		break;
+	case LIGHT_MOTION_LINEAR:
+		x = lightAnimationBounce(restX + pAnim->pVelocityX[i] * t, pAnim->mBoxMin[0], pAnim->mBoxSize[0]);
+		y = lightAnimationBounce(restY + pAnim->pVelocityY[i] * t, pAnim->mBoxMin[1], pAnim->mBoxSize[1]);
+		z = lightAnimationBounce(restZ + pAnim->pVelocityZ[i] * t, pAnim->mBoxMin[2], pAnim->mBoxSize[2]);
+		break;
+	default:
+		x = restX + LIGHT_ANIMATION_NOISE_AMPLITUDE * lightAnimationSin(LIGHT_ANIMATION_NOISE_FREQUENCY * t + pAnim->pPhaseX[i]);
+		y = restY + LIGHT_ANIMATION_NOISE_AMPLITUDE * lightAnimationSin(LIGHT_ANIMATION_NOISE_FREQUENCY * 1.31f * t + pAnim->pPhaseY[i]);
+		z = restZ + LIGHT_ANIMATION_NOISE_AMPLITUDE * lightAnimationSin(LIGHT_ANIMATION_NOISE_FREQUENCY * 0.77f * t + pAnim->pPhaseZ[i]);
+		break;
+	}
+
+	return vec4(x, y, z, pAnim->pRadius[i]);
+}
+
+#if defined(__AVX2__)
+static inline __m256 lightAnimationAbs8(__m256 x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x); }
+
+static inline __m256 lightAnimationSin8(__m256 x)
+{
+	x = _mm256_sub_ps(x, _mm256_mul_ps(_mm256_set1_ps(2.0f * PI), _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.5f / PI)), _mm256_set1_ps(0.5f)))));
+	__m256 y = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(4.0f / PI), x), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(4.0f / (PI * PI)), x), lightAnimationAbs8(x)));
+	return _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.225f), _mm256_sub_ps(_mm256_mul_ps(y, lightAnimationAbs8(y)), y)), y);
+}
+
+static inline __m256 lightAnimationBounce8(__m256 p, __m256 boxMin, __m256 boxSize)
+{
+	const __m256 u = _mm256_sub_ps(p, boxMin);
+	const __m256 period = _mm256_add_ps(boxSize, boxSize);
+	const __m256 m = _mm256_sub_ps(u, _mm256_mul_ps(period, _mm256_floor_ps(_mm256_div_ps(u, period))));
+	return _mm256_sub_ps(_mm256_add_ps(boxMin, boxSize), lightAnimationAbs8(_mm256_sub_ps(m, boxSize)));
+}
+
+// 8 lights SoA -> 8 vec4 (x, y, z, radius)
+static inline void lightAnimationStore8(float* pDst, float* pCopy, bool stream, __m256 x, __m256 y, __m256 z, __m256 r)
+{
+	const __m256 t0 = _mm256_unpacklo_ps(x, y); // x0 y0 x1 y1 | x4 y4 x5 y5
+	const __m256 t1 = _mm256_unpackhi_ps(x, y); // x2 y2 x3 y3 | x6 y6 x7 y7
+	const __m256 t2 = _mm256_unpacklo_ps(z, r);
+	const __m256 t3 = _mm256_unpackhi_ps(z, r);
+	const __m256 l04 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	const __m256 l15 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	const __m256 l26 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	const __m256 l37 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	const __m256 out[4] = {
+		_mm256_permute2f128_ps(l04, l15, 0x20), _mm256_permute2f128_ps(l26, l37, 0x20),
+		_mm256_permute2f128_ps(l04, l15, 0x31), _mm256_permute2f128_ps(l26, l37, 0x31),
+	};
+
+	for (uint32_t k = 0; k < 4; ++k)
+	{
+		if (stream)
+			_mm256_stream_ps(pDst + k * 8, out[k]);
+		else
+			_mm256_storeu_ps(pDst + k * 8, out[k]);
+		if (pCopy)
+			_mm256_storeu_ps(pCopy + k * 8, out[k]);
+	}
+}
+#endif
+
+static void lightAnimationChunk(void* pUserData, uint64_t chunk)
+{
+	LightAnimation* pAnim = (LightAnimation*)pUserData;
+	const uint32_t begin = (uint32_t)chunk * LIGHT_ANIMATION_CHUNK;
+	const uint32_t end = min(begin + LIGHT_ANIMATION_CHUNK, pAnim->mNumLights);
+	uint32_t i = begin;
+
+#if defined(__AVX2__)
+	{
+		const float t = pAnim->mTime;
+		const __m256 time = _mm256_set1_ps(t);
+		const __m256 c = _mm256_set1_ps(pAnim->mCos);
+		const __m256 s = _mm256_set1_ps(pAnim->mSin);
+		const __m256 boxMinX = _mm256_set1_ps(pAnim->mBoxMin[0]), boxSizeX = _mm256_set1_ps(pAnim->mBoxSize[0]);
+		const __m256 boxMinY = _mm256_set1_ps(pAnim->mBoxMin[1]), boxSizeY = _mm256_set1_ps(pAnim->mBoxSize[1]);
+		const __m256 boxMinZ = _mm256_set1_ps(pAnim->mBoxMin[2]), boxSizeZ = _mm256_set1_ps(pAnim->mBoxSize[2]);
+		const __m256 amplitude = _mm256_set1_ps(LIGHT_ANIMATION_NOISE_AMPLITUDE);
+		const __m256 frequencyX = _mm256_set1_ps(LIGHT_ANIMATION_NOISE_FREQUENCY * t);
+		const __m256 frequencyY = _mm256_set1_ps(LIGHT_ANIMATION_NOISE_FREQUENCY * 1.31f * t);
+		const __m256 frequencyZ = _mm256_set1_ps(LIGHT_ANIMATION_NOISE_FREQUENCY * 0.77f * t);
+
+		for (; i + 8 <= end; i += 8)
+		{
+			const __m256 restX = _mm256_load_ps(pAnim->pRestX + i);
+			const __m256 restY = _mm256_load_ps(pAnim->pRestY + i);
+			const __m256 restZ = _mm256_load_ps(pAnim->pRestZ + i);
+			__m256 x, y, z;
+
+			switch (pAnim->mMotion)
+			{
+			case LIGHT_MOTION_ORBIT:
+				x = _mm256_add_ps(restX, _mm256_mul_ps(c, restY));
+				y = _mm256_add_ps(restY, _mm256_mul_ps(s, restX));
+				z = restZ;
+				break;
+			case LIGHT_MOTION_LINEAR:
+				x = lightAnimationBounce8(_mm256_add_ps(restX, _mm256_mul_ps(_mm256_load_ps(pAnim->pVelocityX + i), time)), boxMinX, boxSizeX);
+				y = lightAnimationBounce8(_mm256_add_ps(restY, _mm256_mul_ps(_mm256_load_ps(pAnim->pVelocityY + i), time)), boxMinY, boxSizeY);
+				z = lightAnimationBounce8(_mm256_add_ps(restZ, _mm256_mul_ps(_mm256_load_ps(pAnim->pVelocityZ + i), time)), boxMinZ, boxSizeZ);
+				break;
+			default:
+				x = _mm256_add_ps(restX, _mm256_mul_ps(amplitude, lightAnimationSin8(_mm256_add_ps(frequencyX, _mm256_load_ps(pAnim->pPhaseX + i)))));
+				y = _mm256_add_ps(restY, _mm256_mul_ps(amplitude, lightAnimationSin8(_mm256_add_ps(frequencyY, _mm256_load_ps(pAnim->pPhaseY + i)))));
+				z = _mm256_add_ps(restZ, _mm256_mul_ps(amplitude, lightAnimationSin8(_mm256_add_ps(frequencyZ, _mm256_load_ps(pAnim->pPhaseZ + i)))));
+				break;
+			}
+
+			lightAnimationStore8((float*)(pAnim->pDst + i), pAnim->pCopy ? (float*)(pAnim->pCopy + i) : NULL, pAnim->mStream, x, y, z,
+				_mm256_load_ps(pAnim->pRadius + i));
+		}
+
+		if (pAnim->mStream)
+			_mm_sfence();
+	}
+#endif
+
+	// scalar path, also the last lights of the final chunk
+	for (; i < end; ++i)
+	{
+		const vec4 light = lightAnimationEvaluate(pAnim, i);
+		pAnim->pDst[i] = light;
+		if (pAnim->pCopy)
+			pAnim->pCopy[i] = light;
+	}
+}
+
+void initLightAnimation(ThreadSystem* pThreadSystem, LightAnimation* pAnim)
+{
+	memset((void*)pAnim, 0, sizeof(LightAnimation));
+	pAnim->pThreadSystem = pThreadSystem;
+}
+
+void exitLightAnimation(LightAnimation* pAnim)
+{
+	float** arrays[] = { &pAnim->pRestX, &pAnim->pRestY, &pAnim->pRestZ, &pAnim->pRadius, &pAnim->pVelocityX, &pAnim->pVelocityY,
+		&pAnim->pVelocityZ, &pAnim->pPhaseX, &pAnim->pPhaseY, &pAnim->pPhaseZ };
+	for (float** ppArray : arrays)
+		tf_free(*ppArray);
+	memset((void*)pAnim, 0, sizeof(LightAnimation));
+}
+
+// Grows the SoA arrays (contents are not kept, resetLightAnimation() refills them)
+void reserveLightAnimation(LightAnimation* pAnim, uint32_t numLights)
+{
+	const uint32_t capacity = (numLights + 7) & ~7u;
+	if (capacity <= pAnim->mCapacity)
+		return;
+
+	float** arrays[] = { &pAnim->pRestX, &pAnim->pRestY, &pAnim->pRestZ, &pAnim->pRadius, &pAnim->pVelocityX, &pAnim->pVelocityY,
+		&pAnim->pVelocityZ, &pAnim->pPhaseX, &pAnim->pPhaseY, &pAnim->pPhaseZ };
+	for (float** ppArray : arrays)
+	{
+		tf_free(*ppArray);
+		*ppArray = lightAnimationAlloc(capacity);
+	}
+	pAnim->mCapacity = capacity;
+}
+
+/**
+ * @brief Takes pRest (position, radius) as the rest pose of numLights lights and draws their velocities and noise phases from seed.
+ */
+void resetLightAnimation(LightAnimation* pAnim, const vec4* pRest, uint32_t numLights, uint32_t seed)
+{
+	reserveLightAnimation(pAnim, numLights);
+	pAnim->mNumLights = numLights;
+
+	std::mt19937 mt(seed);
+	std::uniform_real_distribution<float> velocityDistribution(-LIGHT_ANIMATION_LINEAR_SPEED, LIGHT_ANIMATION_LINEAR_SPEED);
+	std::uniform_real_distribution<float> phaseDistribution(0.0f, 2.0f * PI);
+
+	float boxMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boxMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t i = 0; i < numLights; ++i)
+	{
+		const float p[3] = { pRest[i].getX(), pRest[i].getY(), pRest[i].getZ() };
+		pAnim->pRestX[i] = p[0];
+		pAnim->pRestY[i] = p[1];
+		pAnim->pRestZ[i] = p[2];
+		pAnim->pRadius[i] = pRest[i].getW();
+		pAnim->pVelocityX[i] = velocityDistribution(mt);
+		pAnim->pVelocityY[i] = velocityDistribution(mt);
+		pAnim->pVelocityZ[i] = velocityDistribution(mt);
+		pAnim->pPhaseX[i] = phaseDistribution(mt);
+		pAnim->pPhaseY[i] = phaseDistribution(mt);
+		pAnim->pPhaseZ[i] = phaseDistribution(mt);
+
+		for (uint32_t axis = 0; axis < 3; ++axis)
+		{
+			boxMin[axis] = min(boxMin[axis], p[axis]);
+			boxMax[axis] = max(boxMax[axis], p[axis]);
+		}
+	}
+
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		pAnim->mBoxMin[axis] = numLights ? boxMin[axis] : 0.0f;
+		pAnim->mBoxSize[axis] = numLights ? max(boxMax[axis] - boxMin[axis], 1e-3f) : 1.0f;
+	}
+}
+
+/**
+ * @brief Writes the lights at time (seconds) into pDst, and into pCopy when it is not NULL. Blocking.
+ * pDst may be write-combined memory (mapped upload buffer), it is only written, never read.
+ */
+void animateLights(LightAnimation* pAnim, uint32_t motion, float time, vec4* pDst, vec4* pCopy)
+{
+	HiresTimer timer;
+	initHiresTimer(&timer);
+
+	const float angle = degToRad(time * LIGHT_ANIMATION_ORBIT_SPEED);
+	pAnim->mMotion = motion;
+	pAnim->mTime = time;
+	pAnim->mCos = cosf(angle);
+	pAnim->mSin = sinf(angle);
+	pAnim->pDst = pDst;
+	pAnim->pCopy = pCopy;
+	pAnim->mStream = ((uintptr_t)pDst & 31) == 0;
+
+	const uint32_t chunkCount = (pAnim->mNumLights + LIGHT_ANIMATION_CHUNK - 1) / LIGHT_ANIMATION_CHUNK;
+	if (pAnim->pThreadSystem && chunkCount > 1)
+	{
+		addThreadSystemRangeTask(pAnim->pThreadSystem, lightAnimationChunk, pAnim, chunkCount);
+		waitThreadSystemIdle(pAnim->pThreadSystem);
+	}
+	else
+	{
+		for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+			lightAnimationChunk(pAnim, chunk);
+	}
+
+	pAnim->mLastMilliseconds = (double)getHiresTimerUSec(&timer, false) / 1000.0;
+}
+
+/************************************************************************/
+// Benchmark
+/************************************************************************/
+// Animates seeded random lights with every motion and logs the average time per call
+void benchmarkLightAnimation(ThreadSystem* pThreadSystem, uint32_t numLights, uint32_t iterations)
+{
+	vec4* pRest = (vec4*)tf_memalign(32, numLights * sizeof(vec4));
+	vec4* pDst = (vec4*)tf_memalign(32, numLights * sizeof(vec4));
+	std::mt19937 mt(1);
+	std::normal_distribution<float> distribution(0.0f, 10.0f);
+	std::uniform_real_distribution<float> radiusDistribution(0.0f, 3.0f);
+	for (uint32_t i = 0; i < numLights; ++i)
+		pRest[i] = vec4(distribution(mt), distribution(mt), distribution(mt), radiusDistribution(mt));
+
+	LightAnimation anim;
+	initLightAnimation(pThreadSystem, &anim);
+	resetLightAnimation(&anim, pRest, numLights, 1);
+
+	const uint32_t threadCount = pThreadSystem ? getThreadSystemThreadCount(pThreadSystem) : 1;
+	for (uint32_t motion = 0; motion < LIGHT_MOTION_COUNT; ++motion)
+	{
+		// the SIMD path has to match the scalar formulas
+		animateLights(&anim, motion, 12.345f, pDst, NULL);
+		float maxError = 0.0f;
+		for (uint32_t i = 0; i < min(numLights, 1024u); ++i)
+		{
+			const vec4 reference = lightAnimationEvaluate(&anim, i);
+			maxError = max(maxError, fabsf(pDst[i].getX() - reference.getX()));
+			maxError = max(maxError, max(fabsf(pDst[i].getY() - reference.getY()), fabsf(pDst[i].getZ() - reference.getZ())));
+		}
+
+		double totalMilliseconds = 0.0;
+		for (uint32_t i = 0; i < iterations; ++i)
+		{
+			animateLights(&anim, motion, (float)i / 60.0f, pDst, NULL);
+			totalMilliseconds += anim.mLastMilliseconds;
+		}
+
+		LOGF(eINFO, "Light animation %-6s: %u lights, %u threads, avg %.3f ms, SIMD vs scalar max error %g", gLightMotionNames[motion], numLights,
+			threadCount, totalMilliseconds / (double)max(iterations, 1u), maxError);
+	}
+
+	exitLightAnimation(&anim);
+	tf_free(pDst);
+	tf_free(pRest);
+}
+
+#endif // !LIGHTANIMATION_H
@@ -0,0 +1,512 @@
+#ifndef LIGHTBVH_H
+#define LIGHTBVH_H
+
+// Linear BVH over the light bounding spheres, rebuilt on the thread system whenever the lights move:
+// Morton codes of the light centers -> parallel LSD radix sort -> neighbours in Morton order merged pairwise, level by level.
+// Every LIGHT_BVH_CHUNK sorted lights build their subtree on one worker, only the few levels above the chunks are serial.
+// Children with LIGHT_BVH_LEAF_BIT set are light indices, otherwise node indices. Traversal starts from mRoots,
+// the first level with at most LIGHT_BVH_MAX_ROOTS entries, so nothing above it is built.
+#include <float.h>
+#include <emmintrin.h>
+#include <random>
+
+#include "../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../Common_3/Utilities/Interfaces/ITime.h"
+#include "../../../../Common_3/Utilities/Threading/ThreadSystem.h"
+#include "../../../../Common_3/Utilities/Math/MathTypes.h"
+#include "../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+#include "Shaders/Shared.h"
+
+#define LIGHT_BVH_CHUNK_LEVELS 14
+#define LIGHT_BVH_CHUNK (1 << LIGHT_BVH_CHUNK_LEVELS) // power of two so chunk subtrees line up with the global pairing
+#define LIGHT_BVH_MORTON_BITS 8 // per axis
+#define LIGHT_BVH_RADIX_BITS 12
+#define LIGHT_BVH_RADIX_BUCKETS (1 << LIGHT_BVH_RADIX_BITS)
+#define LIGHT_BVH_RADIX_PASSES 2 // 24 bit Morton codes
+#define LIGHT_BVH_MAX_LEVELS 32
+
+// Matches the two float4 per node read by LightBinning.comp
+struct LightBVHNode
+{
+	float    mMin[3];
+	uint32_t mLeft;
+	float    mMax[3];
+	uint32_t mRight;
+};
+
+enum LightBVHPhase
+{
+	LIGHT_BVH_PHASE_MORTON = 0, // scene bounds + Morton codes
+	LIGHT_BVH_PHASE_SORT,
+	LIGHT_BVH_PHASE_BUILD,      // nodes and bounds
+	LIGHT_BVH_PHASE_COUNT
+};
+
+struct LightBVH
+{
+	ThreadSystem*  pThreadSystem;
+	const vec4*    pLights;
+	uint32_t       mNumLights;
+	uint32_t       mChunkCount;
+	uint32_t       mCapacity;
+
+	float          mSceneMin[3];
+	float          mSceneScale[3]; // 255 / extent
+	float*         pChunkBounds;   // 6 floats per chunk
+	uint32_t*      pHistograms;    // LIGHT_BVH_RADIX_BUCKETS per chunk
+	uint32_t       mRadixShift;
+
+	uint32_t*      pKeys;
+	uint32_t*      pValues;
+	uint32_t*      pKeysTmp;
+	uint32_t*      pValuesTmp;
+
+	// entries of a level: bounds + light or node reference in mLeft, ping-ponged per level.
+	// Chunk tasks keep their entries at the start of their own LIGHT_BVH_CHUNK range.
+	LightBVHNode*  pLevel[2];
+	uint32_t       mLevelCount;      // levels built above the lights
+	uint32_t       mChunkLevels;     // of those, built inside the chunk tasks
+	uint32_t       mLevelSize[LIGHT_BVH_MAX_LEVELS];
+	uint32_t       mLevelBase[LIGHT_BVH_MAX_LEVELS]; // first node of each level
+
+	LightBVHNode*  pNodes;
+	uint32_t       mNodeCount;
+
+	uint32_t       mRoots[LIGHT_BVH_MAX_ROOTS];
+	uint32_t       mRootCount;
+
+	double         mPhaseMilliseconds[LIGHT_BVH_PHASE_COUNT]; // last build
+};
+
+// Upper bound of the node count, used to size the GPU node buffers
+static inline uint32_t getLightBVHNodeCapacity(uint32_t numLights) { return numLights + LIGHT_BVH_MAX_LEVELS; }
+
+// 8 bits per axis interleaved
+static inline uint32_t lightBVHExpandBits(uint32_t v)
+{
+	v = (v | (v << 8)) & 0x0000F00Fu;
+	v = (v | (v << 4)) & 0x000C30C3u;
+	v = (v | (v << 2)) & 0x00249249u;
+	return v;
+}
+
+static void lightBVHDispatch(LightBVH* pBVH, TaskFunc pTask, uint32_t count)
+{
+	if (pBVH->pThreadSystem && count > 1)
+	{
+		addThreadSystemRangeTask(pBVH->pThreadSystem, pTask, pBVH, count);
+		waitThreadSystemIdle(pBVH->pThreadSystem);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < count; ++i)
+			pTask(pBVH, i);
+	}
+}
+
+static void lightBVHChunkBounds(void* pUserData, uint64_t chunk)
+{
+	LightBVH* pBVH = (LightBVH*)pUserData;
+	const uint32_t begin = (uint32_t)chunk * LIGHT_BVH_CHUNK;
+	const uint32_t end = min(begin + LIGHT_BVH_CHUNK, pBVH->mNumLights);
+
+	__m128 boundsMin = _mm_set1_ps(FLT_MAX);
+	__m128 boundsMax = _mm_set1_ps(-FLT_MAX);
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const __m128 p = _mm_loadu_ps((const float*)&pBVH->pLights[i]);
+		boundsMin = _mm_min_ps(boundsMin, p);
+		boundsMax = _mm_max_ps(boundsMax, p);
+	}
+
+	float boundsMinArray[4], boundsMaxArray[4];
+	_mm_storeu_ps(boundsMinArray, boundsMin);
+	_mm_storeu_ps(boundsMaxArray, boundsMax);
+	memcpy(pBVH->pChunkBounds + chunk * 6, boundsMinArray, sizeof(float) * 3);
+	memcpy(pBVH->pChunkBounds + chunk * 6 + 3, boundsMaxArray, sizeof(float) * 3);
+}
+
+static void lightBVHMortonCodes(void* pUserData, uint64_t chunk)
+{
+	LightBVH* pBVH = (LightBVH*)pUserData;
+	const uint32_t begin = (uint32_t)chunk * LIGHT_BVH_CHUNK;
+	const uint32_t end = min(begin + LIGHT_BVH_CHUNK, pBVH->mNumLights);
+
+	const __m128 sceneMin = _mm_setr_ps(pBVH->mSceneMin[0], pBVH->mSceneMin[1], pBVH->mSceneMin[2], 0.0f);
+	const __m128 sceneScale = _mm_setr_ps(pBVH->mSceneScale[0], pBVH->mSceneScale[1], pBVH->mSceneScale[2], 0.0f);
+	const __m128 cellMax = _mm_set1_ps((float)((1 << LIGHT_BVH_MORTON_BITS) - 1));
+
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const __m128 p = _mm_loadu_ps((const float*)&pBVH->pLights[i]);
+		const __m128i cell = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(p, sceneMin), sceneScale), _mm_setzero_ps()), cellMax));
+
+		uint32_t xyz[4];
+		_mm_storeu_si128((__m128i*)xyz, cell);
+		pBVH->pKeys[i] = (lightBVHExpandBits(xyz[0]) << 2) | (lightBVHExpandBits(xyz[1]) << 1) | lightBVHExpandBits(xyz[2]);
+		pBVH->pValues[i] = i;
+	}
+}
+
+static void lightBVHRadixHistogram(void* pUserData, uint64_t chunk)
+{
+	LightBVH* pBVH = (LightBVH*)pUserData;
+	const uint32_t begin = (uint32_t)chunk * LIGHT_BVH_CHUNK;
+	const uint32_t end = min(begin + LIGHT_BVH_CHUNK, pBVH->mNumLights);
+
+	uint32_t* pHistogram = pBVH->pHistograms + chunk * LIGHT_BVH_RADIX_BUCKETS;
+	memset(pHistogram, 0, LIGHT_BVH_RADIX_BUCKETS * sizeof(uint32_t));
+	for (uint32_t i = begin; i < end; ++i)
+		++pHistogram[(pBVH->pKeys[i] >> pBVH->mRadixShift) & (LIGHT_BVH_RADIX_BUCKETS - 1)];
+}
+
+// pHistograms holds the chunk's output offset per bucket at this point; chunks scatter in order so the sort stays stable
+static void lightBVHRadixScatter(void* pUserData, uint64_t chunk)
+{
+	LightBVH* pBVH = (LightBVH*)pUserData;
+	const uint32_t begin = (uint32_t)chunk * LIGHT_BVH_CHUNK;
+	const uint32_t end = min(begin + LIGHT_BVH_CHUNK, pBVH->mNumLights);
+
+	uint32_t* pOffsets = pBVH->pHistograms + chunk * LIGHT_BVH_RADIX_BUCKETS;
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const uint32_t key = pBVH->pKeys[i];
+		const uint32_t dst = pOffsets[(key >> pBVH->mRadixShift) & (LIGHT_BVH_RADIX_BUCKETS - 1)]++;
+		pBVH->pKeysTmp[dst] = key;
+		pBVH->pValuesTmp[dst] = pBVH->pValues[i];
+	}
+}
+
+// Merges level entries [2 * begin, 2 * end) into [begin, end), pSrc / pDst point at the entries 2 * begin / begin.
+// Pairs become nodes, a single trailing entry moves up as is.
+static void lightBVHMergeLevel(LightBVH* pBVH, uint32_t level, const LightBVHNode* pSrc, LightBVHNode* pDst, uint32_t begin, uint32_t end)
+{
+	const uint32_t srcSize = level ? pBVH->mLevelSize[level - 1] : pBVH->mNumLights;
+	for (uint32_t k = begin; k < end; ++k, pSrc += 2, ++pDst)
+	{
+		if (2 * k + 1 >= srcSize)
+		{
+			*pDst = pSrc[0];
+			continue;
+		}
+
+		const uint32_t nodeIndex = pBVH->mLevelBase[level] + k;
+		LightBVHNode& node = pBVH->pNodes[nodeIndex];
+
+		// the reference lanes are rewritten after the stores
+		const __m128 boundsMin = _mm_min_ps(_mm_loadu_ps(pSrc[0].mMin), _mm_loadu_ps(pSrc[1].mMin));
+		const __m128 boundsMax = _mm_max_ps(_mm_loadu_ps(pSrc[0].mMax), _mm_loadu_ps(pSrc[1].mMax));
+		const uint32_t left = pSrc[0].mLeft;
+		const uint32_t right = pSrc[1].mLeft;
+		_mm_storeu_ps(node.mMin, boundsMin);
+		_mm_storeu_ps(node.mMax, boundsMax);
+		node.mLeft = left;
+		node.mRight = right;
+
+		_mm_storeu_ps(pDst->mMin, boundsMin);
+		_mm_storeu_ps(pDst->mMax, boundsMax);
+		pDst->mLeft = nodeIndex;
+	}
+}
+
+// Leaves of one chunk of sorted lights, then the chunk's subtree up to mChunkLevels
+static void lightBVHBuildChunk(void* pUserData, uint64_t chunk)
+{
+	LightBVH* pBVH = (LightBVH*)pUserData;
+	const uint32_t chunkBegin = (uint32_t)chunk * LIGHT_BVH_CHUNK;
+	uint32_t begin = chunkBegin;
+	uint32_t end = min(begin + LIGHT_BVH_CHUNK, pBVH->mNumLights);
+
+	LightBVHNode* pLeaves = pBVH->pLevel[0] + chunkBegin;
+	for (uint32_t i = begin; i < end; ++i, ++pLeaves)
+	{
+		const uint32_t light = pBVH->pValues[i];
+		const __m128 p = _mm_loadu_ps((const float*)&pBVH->pLights[light]);
+		const __m128 r = _mm_max_ps(_mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3)), _mm_setzero_ps());
+		_mm_storeu_ps(pLeaves->mMin, _mm_sub_ps(p, r));
+		_mm_storeu_ps(pLeaves->mMax, _mm_add_ps(p, r));
+		pLeaves->mLeft = LIGHT_BVH_LEAF_BIT | light;
+	}
+
+	for (uint32_t level = 0; level < pBVH->mChunkLevels; ++level)
+	{
+		begin /= 2;
+		end = (end + 1) / 2;
+		lightBVHMergeLevel(pBVH, level, pBVH->pLevel[level & 1] + chunkBegin, pBVH->pLevel[(level + 1) & 1] + chunkBegin, begin, end);
+	}
+}
+
+static void lightBVHReserve(LightBVH* pBVH, uint32_t numLights)
+{
+	if (numLights <= pBVH->mCapacity)
+		return;
+
+	const uint32_t capacity = max(numLights, pBVH->mCapacity * 2);
+	const uint32_t chunkCapacity = (capacity + LIGHT_BVH_CHUNK - 1) / LIGHT_BVH_CHUNK;
+
+	tf_free(pBVH->pChunkBounds);
+	tf_free(pBVH->pHistograms);
+	tf_free(pBVH->pKeys);
+	tf_free(pBVH->pValues);
+	tf_free(pBVH->pKeysTmp);
+	tf_free(pBVH->pValuesTmp);
+	tf_free(pBVH->pLevel[0]);
+	tf_free(pBVH->pLevel[1]);
+	tf_free(pBVH->pNodes);
+
+	pBVH->pChunkBounds = (float*)tf_malloc(chunkCapacity * 6 * sizeof(float));
+	pBVH->pHistograms = (uint32_t*)tf_malloc(chunkCapacity * LIGHT_BVH_RADIX_BUCKETS * sizeof(uint32_t));
+	pBVH->pKeys = (uint32_t*)tf_malloc(capacity * sizeof(uint32_t));
+	pBVH->pValues = (uint32_t*)tf_malloc(capacity * sizeof(uint32_t));
+	pBVH->pKeysTmp = (uint32_t*)tf_malloc(capacity * sizeof(uint32_t));
+	pBVH->pValuesTmp = (uint32_t*)tf_malloc(capacity * sizeof(uint32_t));
+	pBVH->pLevel[0] = (LightBVHNode*)tf_malloc(capacity * sizeof(LightBVHNode));
+	pBVH->pLevel[1] = (LightBVHNode*)tf_malloc(capacity * sizeof(LightBVHNode));
+	pBVH->pNodes = (LightBVHNode*)tf_malloc(getLightBVHNodeCapacity(capacity) * sizeof(LightBVHNode));
+	pBVH->mCapacity = capacity;
+}
+
+void initLightBVH(ThreadSystem* pThreadSystem, LightBVH* pBVH)
+{
+	memset((void*)pBVH, 0, sizeof(LightBVH));
+	pBVH->pThreadSystem = pThreadSystem;
+}
+
+void exitLightBVH(LightBVH* pBVH)
+{
+	tf_free(pBVH->pChunkBounds);
+	tf_free(pBVH->pHistograms);
+	tf_free(pBVH->pKeys);
+	tf_free(pBVH->pValues);
+	tf_free(pBVH->pKeysTmp);
+	tf_free(pBVH->pValuesTmp);
+	tf_free(pBVH->pLevel[0]);
+	tf_free(pBVH->pLevel[1]);
+	tf_free(pBVH->pNodes);
+	memset((void*)pBVH, 0, sizeof(LightBVH));
+}
+
+// Blocking. Nodes are pBVH->pNodes[0, mNodeCount), pLights is only read during the build.
+void buildLightBVH(LightBVH* pBVH, const vec4* pLights, uint32_t numLights)
+{
+	lightBVHReserve(pBVH, numLights);
+	pBVH->pLights = pLights;
+	pBVH->mNumLights = numLights;
+	pBVH->mChunkCount = (numLights + LIGHT_BVH_CHUNK - 1) / LIGHT_BVH_CHUNK;
+	pBVH->mNodeCount = 0;
+	pBVH->mRootCount = 0;
+	memset(pBVH->mPhaseMilliseconds, 0, sizeof(pBVH->mPhaseMilliseconds));
+
+	if (numLights == 0)
+		return;
+
+	HiresTimer timer;
+	initHiresTimer(&timer);
+
+	// Morton codes relative to the bounds of the light centers
+	lightBVHDispatch(pBVH, lightBVHChunkBounds, pBVH->mChunkCount);
+	float sceneMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float sceneMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t chunk = 0; chunk < pBVH->mChunkCount; ++chunk)
+	{
+		for (uint32_t axis = 0; axis < 3; ++axis)
+		{
+			sceneMin[axis] = min(sceneMin[axis], pBVH->pChunkBounds[chunk * 6 + axis]);
+			sceneMax[axis] = max(sceneMax[axis], pBVH->pChunkBounds[chunk * 6 + axis + 3]);
+		}
+	}
+	for (uint32_t axis = 0; axis < 3; ++axis)
+	{
+		pBVH->mSceneMin[axis] = sceneMin[axis];
+		pBVH->mSceneScale[axis] = (float)((1 << LIGHT_BVH_MORTON_BITS) - 1) / max(sceneMax[axis] - sceneMin[axis], 1e-6f);
+	}
+	lightBVHDispatch(pBVH, lightBVHMortonCodes, pBVH->mChunkCount);
+	pBVH->mPhaseMilliseconds[LIGHT_BVH_PHASE_MORTON] = (double)getHiresTimerUSec(&timer, true) / 1000.0;
+
+	// LSD radix sort of (key, light index)
+	for (uint32_t pass = 0; pass < LIGHT_BVH_RADIX_PASSES; ++pass)
+	{
+		pBVH->mRadixShift = pass * LIGHT_BVH_RADIX_BITS;
+		lightBVHDispatch(pBVH, lightBVHRadixHistogram, pBVH->mChunkCount);
+
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < LIGHT_BVH_RADIX_BUCKETS; ++bucket)
+		{
+			for (uint32_t chunk = 0; chunk < pBVH->mChunkCount; ++chunk)
+			{
+				uint32_t& count = pBVH->pHistograms[chunk * LIGHT_BVH_RADIX_BUCKETS + bucket];
+				const uint32_t chunkCount = count;
+				count = offset;
+				offset += chunkCount;
+			}
+		}
+
+		lightBVHDispatch(pBVH, lightBVHRadixScatter, pBVH->mChunkCount);
+		std::swap(pBVH->pKeys, pBVH->pKeysTmp);
+		std::swap(pBVH->pValues, pBVH->pValuesTmp);
+	}
+	pBVH->mPhaseMilliseconds[LIGHT_BVH_PHASE_SORT] = (double)getHiresTimerUSec(&timer, true) / 1000.0;
+
+	// level sizes up to the first one that fits LIGHT_BVH_MAX_ROOTS
+	uint32_t levelSize = numLights;
+	pBVH->mLevelCount = 0;
+	while (levelSize > LIGHT_BVH_MAX_ROOTS)
+	{
+		levelSize = (levelSize + 1) / 2;
+		pBVH->mLevelSize[pBVH->mLevelCount] = levelSize;
+		pBVH->mLevelBase[pBVH->mLevelCount] = pBVH->mNodeCount;
+		pBVH->mNodeCount += levelSize;
+		++pBVH->mLevelCount;
+	}
+	pBVH->mChunkLevels = min(pBVH->mLevelCount, (uint32_t)LIGHT_BVH_CHUNK_LEVELS);
+
+	lightBVHDispatch(pBVH, lightBVHBuildChunk, pBVH->mChunkCount);
+
+	// pack the chunk results (chunk c starts at c * LIGHT_BVH_CHUNK) into one contiguous level
+	LightBVHNode* pChunkLevel = pBVH->pLevel[pBVH->mChunkLevels & 1];
+	const uint32_t chunkStride = LIGHT_BVH_CHUNK >> pBVH->mChunkLevels;
+	const uint32_t chunkLevelSize = pBVH->mChunkLevels ? pBVH->mLevelSize[pBVH->mChunkLevels - 1] : numLights;
+	for (uint32_t chunk = 1; chunk < pBVH->mChunkCount; ++chunk)
+	{
+		const uint32_t count = min(chunkStride, chunkLevelSize - chunk * chunkStride);
+		memmove(pChunkLevel + chunk * chunkStride, pChunkLevel + chunk * LIGHT_BVH_CHUNK, count * sizeof(LightBVHNode));
+	}
+
+	for (uint32_t level = pBVH->mChunkLevels; level < pBVH->mLevelCount; ++level)
+		lightBVHMergeLevel(pBVH, level, pBVH->pLevel[level & 1], pBVH->pLevel[(level + 1) & 1], 0, pBVH->mLevelSize[level]);
+
+	const LightBVHNode* pRootLevel = pBVH->pLevel[pBVH->mLevelCount & 1];
+	pBVH->mRootCount = levelSize;
+	for (uint32_t i = 0; i < levelSize; ++i)
+		pBVH->mRoots[i] = pRootLevel[i].mLeft;
+	pBVH->mPhaseMilliseconds[LIGHT_BVH_PHASE_BUILD] = (double)getHiresTimerUSec(&timer, true) / 1000.0;
+}
+
+/************************************************************************/
+// Benchmark
+/************************************************************************/
+struct LightBVHBenchmarkDesc
+{
+	uint32_t mNumLights;
+	uint32_t mIterations;
+	uint32_t mSeed;
+	float    mLightSpawnBoxScale;
+	double   mBudgetMilliseconds;
+};
+
+static inline void lightBVHEntryBounds(const LightBVH* pBVH, uint32_t entry, float* pMin, float* pMax)
+{
+	if (entry & LIGHT_BVH_LEAF_BIT)
+	{
+		const vec4& light = pBVH->pLights[entry & ~LIGHT_BVH_LEAF_BIT];
+		const float r = max(light.getW(), 0.0f);
+		pMin[0] = light.getX() - r; pMin[1] = light.getY() - r; pMin[2] = light.getZ() - r;
+		pMax[0] = light.getX() + r; pMax[1] = light.getY() + r; pMax[2] = light.getZ() + r;
+	}
+	else
+	{
+		memcpy(pMin, pBVH->pNodes[entry].mMin, sizeof(float) * 3);
+		memcpy(pMax, pBVH->pNodes[entry].mMax, sizeof(float) * 3);
+	}
+}
+
+// Every light must be reached exactly once and every node must contain its children
+static bool lightBVHValidate(const LightBVH* pBVH)
+{
+	uint8_t* pReached = (uint8_t*)tf_calloc(pBVH->mNumLights + 1, 1);
+	uint32_t* pStack = (uint32_t*)tf_malloc((pBVH->mNumLights + LIGHT_BVH_MAX_ROOTS) * sizeof(uint32_t));
+	uint32_t stackSize = 0;
+	bool valid = true;
+
+	for (uint32_t i = 0; i < pBVH->mRootCount; ++i)
+		pStack[stackSize++] = pBVH->mRoots[i];
+
+	while (stackSize && valid)
+	{
+		const uint32_t entry = pStack[--stackSize];
+		if (entry & LIGHT_BVH_LEAF_BIT)
+		{
+			const uint32_t light = entry & ~LIGHT_BVH_LEAF_BIT;
+			valid = light < pBVH->mNumLights && !pReached[light];
+			if (valid)
+				pReached[light] = 1;
+			continue;
+		}
+
+		valid = entry < pBVH->mNodeCount;
+		if (!valid)
+			break;
+
+		const LightBVHNode& node = pBVH->pNodes[entry];
+		const uint32_t children[2] = { node.mLeft, node.mRight };
+		for (uint32_t c = 0; c < 2; ++c)
+		{
+			float childMin[3], childMax[3];
+			lightBVHEntryBounds(pBVH, children[c], childMin, childMax);
+			for (uint32_t axis = 0; axis < 3; ++axis)
+				valid = valid && childMin[axis] >= node.mMin[axis] && childMax[axis] <= node.mMax[axis];
+			pStack[stackSize++] = children[c];
+		}
+	}
+
+	for (uint32_t i = 0; i < pBVH->mNumLights && valid; ++i)
+		valid = pReached[i] != 0;
+
+	tf_free(pStack);
+	tf_free(pReached);
+	return valid;
+}
+
+// Builds the BVH over seeded random lights (randomizeLightPosition distribution) and logs the time per phase
+void benchmarkLightBVH(ThreadSystem* pThreadSystem, const LightBVHBenchmarkDesc* pDesc)
+{
+	static const char* phaseNames[LIGHT_BVH_PHASE_COUNT] = { "morton", "sort", "build" };
+
+	vec4* pLights = (vec4*)tf_memalign(16, pDesc->mNumLights * sizeof(vec4));
+	std::mt19937 mt(pDesc->mSeed);
+	std::normal_distribution<float> distribution(0.0f, 2.0f);
+	std::uniform_real_distribution<float> radiusDistribution(0.0f, 3.0f);
+	for (uint32_t i = 0; i < pDesc->mNumLights; ++i)
+	{
+		const float x = distribution(mt), y = distribution(mt), z = distribution(mt);
+		pLights[i] = vec4(x * pDesc->mLightSpawnBoxScale, y * pDesc->mLightSpawnBoxScale, z * pDesc->mLightSpawnBoxScale, radiusDistribution(mt));
+	}
+
+	LightBVH bvh;
+	initLightBVH(pThreadSystem, &bvh);
+
+	// warm up allocations and caches, then validate once
+	buildLightBVH(&bvh, pLights, pDesc->mNumLights);
+	const bool valid = lightBVHValidate(&bvh);
+
+	double phaseTotal[LIGHT_BVH_PHASE_COUNT] = {};
+	double bestMilliseconds = DBL_MAX;
+	double totalMilliseconds = 0.0;
+	for (uint32_t i = 0; i < pDesc->mIterations; ++i)
+	{
+		HiresTimer timer;
+		initHiresTimer(&timer);
+		buildLightBVH(&bvh, pLights, pDesc->mNumLights);
+		const double milliseconds = (double)getHiresTimerUSec(&timer, false) / 1000.0;
+
+		bestMilliseconds = min(bestMilliseconds, milliseconds);
+		totalMilliseconds += milliseconds;
+		for (uint32_t phase = 0; phase < LIGHT_BVH_PHASE_COUNT; ++phase)
+			phaseTotal[phase] += bvh.mPhaseMilliseconds[phase];
+	}
+
+	const double invIterations = 1.0 / (double)max(pDesc->mIterations, 1u);
+	const double averageMilliseconds = totalMilliseconds * invIterations;
+	const uint32_t threadCount = pThreadSystem ? getThreadSystemThreadCount(pThreadSystem) : 1;
+	LOGF(eINFO, "Light BVH: %u lights, %u threads, avg %.3f ms, best %.3f ms (budget %.1f ms: %s), %u nodes, %u roots, tree %s",
+		pDesc->mNumLights, threadCount, averageMilliseconds, bestMilliseconds, pDesc->mBudgetMilliseconds,
+		averageMilliseconds <= pDesc->mBudgetMilliseconds ? "met" : "MISSED", bvh.mNodeCount, bvh.mRootCount, valid ? "valid" : "INVALID");
+	for (uint32_t phase = 0; phase < LIGHT_BVH_PHASE_COUNT; ++phase)
+		LOGF(eINFO, "Light BVH   %-6s %.3f ms", phaseNames[phase], phaseTotal[phase] * invIterations);
+
+	exitLightBVH(&bvh);
+	tf_free(pLights);
+}
+
+#endif // !LIGHTBVH_H
@@ -0,0 +1,275 @@
+#ifndef LIGHTLAYOUT_H
+#define LIGHTLAYOUT_H
+
+// GPU light storage layouts (LIGHT_LAYOUT in Shared.h, read through the LoadLight* accessors of lightFormat.h.fsl):
+//  Split:       spheres (position, radius) and colors (color, intensity) in two buffers (SoA)
+//  Interleaved: one buffer of Light (AoS), the culling passes read every other element
+//  Compact:     a sphere array for the binning / culling passes and a Light buffer for shading (positions uploaded twice)
+// The CPU arrays stay split, since the animation and the light BVH read the positions. The LightBufferViews of the layout
+// say where the upload writes each of them. benchmarkLightLayouts() runs the same access patterns for every layout on the CPU.
+#include <random>
+
+#include "../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../Common_3/Utilities/Interfaces/ITime.h"
+#include "../../../../Common_3/Utilities/Threading/ThreadSystem.h"
+#include "../../../../Common_3/Utilities/Math/MathTypes.h"
+#include "../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+#include "Shaders/Shared.h"
+
+static const char* gLightLayoutNames[LIGHT_LAYOUT_COUNT] = { "Split", "Interleaved", "Compact" };
+
+struct Light
+{
+	vec4 mPosition; // float4(position.xyz, radius)
+	vec4 mColor; // float4(color.rgb, intensity)
+};
+
+// Light i of a CPU array is element mFirst + i * mStride of GPU buffer mBuffer (0: pLightPosAndRadiusBuffer, 1: pLightColorAndIntensityBuffer)
+struct LightBufferView
+{
+	uint32_t mBuffer;
+	uint32_t mFirst;
+	uint32_t mStride;
+};
+
+#if LIGHT_LAYOUT == LIGHT_LAYOUT_INTERLEAVED
+static const LightBufferView gLightPositionViews[] = { { 0, 0, 2 } };
+static const LightBufferView gLightColorViews[] = { { 0, 1, 2 } };
+static const uint32_t gLightBufferElementsPerLight[2] = { 2, 0 }; // 0: the buffer is not allocated
+#elif LIGHT_LAYOUT == LIGHT_LAYOUT_COMPACT
+static const LightBufferView gLightPositionViews[] = { { 0, 0, 1 }, { 1, 0, 2 } };
+static const LightBufferView gLightColorViews[] = { { 1, 1, 2 } };
+static const uint32_t gLightBufferElementsPerLight[2] = { 1, 2 };
+#else
+static const LightBufferView gLightPositionViews[] = { { 0, 0, 1 } };
+static const LightBufferView gLightColorViews[] = { { 1, 0, 1 } };
+static const uint32_t gLightBufferElementsPerLight[2] = { 1, 1 };
+#endif
+
+static const uint32_t gLightPositionViewCount = sizeof(gLightPositionViews) / sizeof(gLightPositionViews[0]);
+static const uint32_t gLightColorViewCount = sizeof(gLightColorViews) / sizeof(gLightColorViews[0]);
+
+/************************************************************************/
+// Benchmark
+/************************************************************************/
+#define LIGHT_LAYOUT_BENCHMARK_TILES 16 // per axis
+#define LIGHT_LAYOUT_BENCHMARK_SAMPLES 16 // shaded points per tile
+
+// CPU storage of one layout, the culling and shading passes read it like the shaders do
+template <uint32_t Layout>
+struct LightLayoutStorage
+{
+	vec4*  pSpheres;
+	vec4*  pColors;
+	Light* pLights;
+
+	void init(const vec4* pPositions, const vec4* pColorsSrc, uint32_t count)
+	{
+		pSpheres = NULL;
+		pColors = NULL;
+		pLights = NULL;
+		if (Layout != LIGHT_LAYOUT_INTERLEAVED)
+		{
+			pSpheres = (vec4*)tf_memalign(64, count * sizeof(vec4));
+			memcpy(pSpheres, pPositions, count * sizeof(vec4));
+		}
+		if (Layout == LIGHT_LAYOUT_SPLIT)
+		{
+			pColors = (vec4*)tf_memalign(64, count * sizeof(vec4));
+			memcpy(pColors, pColorsSrc, count * sizeof(vec4));
+		}
+		else
+		{
+			pLights = (Light*)tf_memalign(64, count * sizeof(Light));
+			for (uint32_t i = 0; i < count; ++i)
+				pLights[i] = { pPositions[i], pColorsSrc[i] };
+		}
+	}
+
+	void exit()
+	{
+		tf_free(pSpheres);
+		tf_free(pColors);
+		tf_free(pLights);
+	}
+
+	inline const vec4& cullSphere(uint32_t i) const { return Layout == LIGHT_LAYOUT_INTERLEAVED ? pLights[i].mPosition : pSpheres[i]; }
+	inline const vec4& shadePosition(uint32_t i) const { return Layout == LIGHT_LAYOUT_SPLIT ? pSpheres[i] : pLights[i].mPosition; }
+	inline const vec4& shadeColor(uint32_t i) const { return Layout == LIGHT_LAYOUT_SPLIT ? pColors[i] : pLights[i].mColor; }
+};
+
+struct LightLayoutBenchmarkTiles
+{
+	uint32_t  mLightCount;
+	float     mBoxMin[2];
+	float     mTileSize[2];
+	uint32_t* pTileLightCounts;
+	uint32_t* pTileLightIndices; // MAX_NUM_LIGHTS_PER_TILE + 1 per tile, the last one is scratch
+	float*    pTileResults;
+};
+
+template <uint32_t Layout>
+struct LightLayoutBenchmarkTask
+{
+	const LightLayoutStorage<Layout>* pStorage;
+	LightLayoutBenchmarkTiles*         pTiles;
+};
+
+// Columns of the light box in x / y, like screen tiles with an unbounded depth range
+template <uint32_t Layout>
+static void lightLayoutCullTile(void* pUserData, uint64_t tile)
+{
+	const LightLayoutBenchmarkTask<Layout>* pTask = (const LightLayoutBenchmarkTask<Layout>*)pUserData;
+	LightLayoutBenchmarkTiles* pTiles = pTask->pTiles;
+	const float minX = pTiles->mBoxMin[0] + (float)(tile % LIGHT_LAYOUT_BENCHMARK_TILES) * pTiles->mTileSize[0];
+	const float minY = pTiles->mBoxMin[1] + (float)(tile / LIGHT_LAYOUT_BENCHMARK_TILES) * pTiles->mTileSize[1];
+	const float maxX = minX + pTiles->mTileSize[0];
+	const float maxY = minY + pTiles->mTileSize[1];
+
+	uint32_t* pIndices = pTiles->pTileLightIndices + tile * (MAX_NUM_LIGHTS_PER_TILE + 1);
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < pTiles->mLightCount; ++i)
+	{
+		// branchless append, so the loop is bound by reading the spheres rather than by mispredictions
+		const vec4& s = pTask->pStorage->cullSphere(i);
+		const float dx = fmaxf(fmaxf(minX - s.getX(), s.getX() - maxX), 0.0f);
+		const float dy = fmaxf(fmaxf(minY - s.getY(), s.getY() - maxY), 0.0f);
+		pIndices[count] = i;
+		count = min(count + (dx * dx + dy * dy <= s.getW() * s.getW() ? 1u : 0u), (uint32_t)MAX_NUM_LIGHTS_PER_TILE);
+	}
+	pTiles->pTileLightCounts[tile] = count;
+}
+
+template <uint32_t Layout>
+static void lightLayoutShadeTile(void* pUserData, uint64_t tile)
+{
+	const LightLayoutBenchmarkTask<Layout>* pTask = (const LightLayoutBenchmarkTask<Layout>*)pUserData;
+	LightLayoutBenchmarkTiles* pTiles = pTask->pTiles;
+	const float minX = pTiles->mBoxMin[0] + (float)(tile % LIGHT_LAYOUT_BENCHMARK_TILES) * pTiles->mTileSize[0];
+	const float minY = pTiles->mBoxMin[1] + (float)(tile / LIGHT_LAYOUT_BENCHMARK_TILES) * pTiles->mTileSize[1];
+	const uint32_t* pIndices = pTiles->pTileLightIndices + tile * (MAX_NUM_LIGHTS_PER_TILE + 1);
+	const uint32_t count = pTiles->pTileLightCounts[tile];
+
+	float result = 0.0f;
+	for (uint32_t sample = 0; sample < LIGHT_LAYOUT_BENCHMARK_SAMPLES; ++sample)
+	{
+		const float px = minX + pTiles->mTileSize[0] * ((float)(sample % 4) + 0.5f) * 0.25f;
+		const float py = minY + pTiles->mTileSize[1] * ((float)(sample / 4) + 0.5f) * 0.25f;
+		for (uint32_t k = 0; k < count; ++k)
+		{
+			const vec4& p = pTask->pStorage->shadePosition(pIndices[k]);
+			const vec4& c = pTask->pStorage->shadeColor(pIndices[k]);
+			const float dx = p.getX() - px, dy = p.getY() - py, dz = p.getZ();
+			const float distanceSq = dx * dx + dy * dy + dz * dz;
+			const float falloff = fmaxf(1.0f - distanceSq / (p.getW() * p.getW() + 1e-6f), 0.0f);
+			result += (c.getX() + c.getY() + c.getZ()) * c.getW() * falloff / (distanceSq + 1.0f);
+		}
+	}
+	pTiles->pTileResults[tile] = result;
+}
+
+static double runLightLayoutPass(ThreadSystem* pThreadSystem, TaskFunc pFunc, void* pTask, uint32_t iterations)
+{
+	const uint32_t tileCount = LIGHT_LAYOUT_BENCHMARK_TILES * LIGHT_LAYOUT_BENCHMARK_TILES;
+	double best = 1e30;
+	for (uint32_t i = 0; i < iterations; ++i)
+	{
+		HiresTimer timer;
+		initHiresTimer(&timer);
+		if (pThreadSystem)
+		{
+			addThreadSystemRangeTask(pThreadSystem, pFunc, pTask, tileCount);
+			waitThreadSystemIdle(pThreadSystem);
+		}
+		else
+		{
+			for (uint32_t tile = 0; tile < tileCount; ++tile)
+				pFunc(pTask, tile);
+		}
+		best = fmin(best, (double)getHiresTimerUSec(&timer, false) / 1000.0);
+	}
+	return best;
+}
+
+// Best of iterations in ms: [0] culling, [1] shading. Returns the sum of the shading results (same for every layout).
+template <uint32_t Layout>
+static double benchmarkLightLayout(ThreadSystem* pThreadSystem, const vec4* pPositions, const vec4* pColors, LightLayoutBenchmarkTiles* pTiles,
+	uint32_t iterations, double* pMilliseconds)
+{
+	LightLayoutStorage<Layout> storage;
+	storage.init(pPositions, pColors, pTiles->mLightCount);
+	LightLayoutBenchmarkTask<Layout> task = { &storage, pTiles };
+
+	pMilliseconds[0] = runLightLayoutPass(pThreadSystem, lightLayoutCullTile<Layout>, &task, iterations);
+	pMilliseconds[1] = runLightLayoutPass(pThreadSystem, lightLayoutShadeTile<Layout>, &task, iterations);
+	storage.exit();
+
+	double checksum = 0.0;
+	for (uint32_t tile = 0; tile < LIGHT_LAYOUT_BENCHMARK_TILES * LIGHT_LAYOUT_BENCHMARK_TILES; ++tile)
+		checksum += pTiles->pTileResults[tile];
+	return checksum;
+}
+
+/**
+ * @brief Culls seeded random lights into tiles and shades the tiles with every layout, for every light count,
+ * and logs the best culling and shading time of each layout and the winner of each pass.
+ */
+void benchmarkLightLayouts(ThreadSystem* pThreadSystem, const uint32_t* pLightCounts, uint32_t lightCountCount, uint32_t iterations)
+{
+	uint32_t maxLights = 0;
+	for (uint32_t i = 0; i < lightCountCount; ++i)
+		maxLights = max(maxLights, pLightCounts[i]);
+
+	// same distribution as the random light setup
+	vec4* pPositions = (vec4*)tf_memalign(64, maxLights * sizeof(vec4));
+	vec4* pColors = (vec4*)tf_memalign(64, maxLights * sizeof(vec4));
+	std::mt19937 mt(1);
+	std::normal_distribution<float> distribution(0.0f, 10.0f);
+	std::uniform_real_distribution<float> radiusDistribution(0.0f, 3.0f);
+	std::uniform_real_distribution<float> colorDistribution(0.0f, 1.0f);
+	for (uint32_t i = 0; i < maxLights; ++i)
+	{
+		pPositions[i] = vec4(distribution(mt), distribution(mt), distribution(mt), radiusDistribution(mt));
+		pColors[i] = vec4(colorDistribution(mt), colorDistribution(mt), colorDistribution(mt), 1.0f);
+	}
+
+	const uint32_t tileCount = LIGHT_LAYOUT_BENCHMARK_TILES * LIGHT_LAYOUT_BENCHMARK_TILES;
+	LightLayoutBenchmarkTiles tiles = {};
+	tiles.mBoxMin[0] = tiles.mBoxMin[1] = -30.0f;
+	tiles.mTileSize[0] = tiles.mTileSize[1] = 60.0f / (float)LIGHT_LAYOUT_BENCHMARK_TILES;
+	tiles.pTileLightCounts = (uint32_t*)tf_calloc(tileCount, sizeof(uint32_t));
+	tiles.pTileLightIndices = (uint32_t*)tf_calloc(tileCount * (MAX_NUM_LIGHTS_PER_TILE + 1), sizeof(uint32_t));
+	tiles.pTileResults = (float*)tf_calloc(tileCount, sizeof(float));
+
+	for (uint32_t i = 0; i < lightCountCount; ++i)
+	{
+		tiles.mLightCount = min(pLightCounts[i], maxLights);
+		double milliseconds[LIGHT_LAYOUT_COUNT][2] = {};
+		double checksums[LIGHT_LAYOUT_COUNT] = {};
+		checksums[LIGHT_LAYOUT_SPLIT] = benchmarkLightLayout<LIGHT_LAYOUT_SPLIT>(pThreadSystem, pPositions, pColors, &tiles, iterations, milliseconds[LIGHT_LAYOUT_SPLIT]);
+		checksums[LIGHT_LAYOUT_INTERLEAVED] =
+			benchmarkLightLayout<LIGHT_LAYOUT_INTERLEAVED>(pThreadSystem, pPositions, pColors, &tiles, iterations, milliseconds[LIGHT_LAYOUT_INTERLEAVED]);
+		checksums[LIGHT_LAYOUT_COMPACT] =
+			benchmarkLightLayout<LIGHT_LAYOUT_COMPACT>(pThreadSystem, pPositions, pColors, &tiles, iterations, milliseconds[LIGHT_LAYOUT_COMPACT]);
+
+		uint32_t winner[2] = {};
+		for (uint32_t pass = 0; pass < 2; ++pass)
+			for (uint32_t layout = 1; layout < LIGHT_LAYOUT_COUNT; ++layout)
+				if (milliseconds[layout][pass] < milliseconds[winner[pass]][pass])
+					winner[pass] = layout;
+
+		LOGF(eINFO, "Light layout %7u lights: cull %s %.3f / %s %.3f / %s %.3f ms -> %s, shade %s %.3f / %s %.3f / %s %.3f ms -> %s%s", tiles.mLightCount,
+			gLightLayoutNames[0], milliseconds[0][0], gLightLayoutNames[1], milliseconds[1][0], gLightLayoutNames[2], milliseconds[2][0], gLightLayoutNames[winner[0]],
+			gLightLayoutNames[0], milliseconds[0][1], gLightLayoutNames[1], milliseconds[1][1], gLightLayoutNames[2], milliseconds[2][1], gLightLayoutNames[winner[1]],
+			(checksums[0] == checksums[1] && checksums[0] == checksums[2]) ? "" : " (results differ)");
+	}
+
+	tf_free(tiles.pTileResults);
+	tf_free(tiles.pTileLightIndices);
+	tf_free(tiles.pTileLightCounts);
+	tf_free(pColors);
+	tf_free(pPositions);
+}
+
+#endif // !LIGHTLAYOUT_H
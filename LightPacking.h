@@ -0,0 +1,245 @@
+#ifndef LIGHTPACKING_H
+#define LIGHTPACKING_H
+
+// FP16 light format (LIGHT_FORMAT_FP16 in Shared.h): every vec4 of the light arrays is uploaded as four halves in a uint2,
+// which halves the light data the binning, culling and shading passes read (UnpackLight in lightFormat.h.fsl).
+// Positions are rounded to the nearest half and the rounding distance is added to the radius, rounded up,
+// so the packed sphere always contains the original one and culling stays conservative.
+// packLights() converts 8 lights per iteration with F16C (AVX2 builds) in parallel chunks, with a scalar fallback.
+#include <math.h>
+#include <string.h>
+#include <random>
+
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define LIGHT_PACKING_F16C 1
+#include <immintrin.h>
+#else
+#define LIGHT_PACKING_F16C 0
+#endif
+
+#include "../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../Common_3/Utilities/Interfaces/ITime.h"
+#include "../../../../Common_3/Utilities/Threading/ThreadSystem.h"
+#include "../../../../Common_3/Utilities/Math/MathTypes.h"
+#include "../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+#define LIGHT_PACKING_CHUNK 16384
+
+// round to nearest even, overflow to infinity
+static inline uint16_t lightFloatToHalf(float value)
+{
+	uint32_t f;
+	memcpy(&f, &value, sizeof(f));
+	const uint32_t sign = (f >> 16) & 0x8000u;
+	f &= 0x7fffffffu;
+
+	uint32_t h;
+	if (f >= (143u << 23)) // >= 65536, inf or nan
+	{
+		h = f > (255u << 23) ? 0x7e00u : 0x7c00u;
+	}
+	else if (f < (113u << 23)) // subnormal half or zero, the float add does the rounding
+	{
+		const uint32_t magicBits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+		float magic, v;
+		memcpy(&magic, &magicBits, sizeof(magic));
+		memcpy(&v, &f, sizeof(v));
+		v += magic;
+		memcpy(&h, &v, sizeof(h));
+		h -= magicBits;
+	}
+	else
+	{
+		const uint32_t mantissaOdd = (f >> 13) & 1u;
+		f += ((uint32_t)(15 - 127) << 23) + 0xfffu + mantissaOdd;
+		h = f >> 13;
+	}
+	return (uint16_t)(h | sign);
+}
+
+static inline float lightHalfToFloat(uint16_t half)
+{
+	const uint32_t shiftedExponent = 0x7c00u << 13;
+	uint32_t f = ((uint32_t)half & 0x7fffu) << 13;
+	const uint32_t exponent = shiftedExponent & f;
+	f += (127u - 15u) << 23;
+
+	float value;
+	if (exponent == shiftedExponent) // inf or nan
+	{
+		f += (128u - 16u) << 23;
+		memcpy(&value, &f, sizeof(value));
+	}
+	else if (exponent == 0) // subnormal
+	{
+		f += 1u << 23;
+		const uint32_t magicBits = 113u << 23;
+		float magic;
+		memcpy(&magic, &magicBits, sizeof(magic));
+		memcpy(&value, &f, sizeof(value));
+		value -= magic;
+	}
+	else
+	{
+		memcpy(&value, &f, sizeof(value));
+	}
+	return (half & 0x8000u) ? -value : value;
+}
+
+// Smallest half that is not below value (value >= 0)
+static inline uint16_t lightFloatToHalfUp(float value)
+{
+	uint16_t h = lightFloatToHalf(value);
+	if (lightHalfToFloat(h) < value)
+		++h;
+	return h;
+}
+
+// One light, pDst receives two uints: (x | y << 16, z | w << 16)
+static inline void packLight(const vec4& light, bool conservativeRadius, uint32_t* pDst)
+{
+	const uint16_t x = lightFloatToHalf(light.getX());
+	const uint16_t y = lightFloatToHalf(light.getY());
+	const uint16_t z = lightFloatToHalf(light.getZ());
+	uint16_t w;
+	if (conservativeRadius)
+	{
+		const float dx = light.getX() - lightHalfToFloat(x);
+		const float dy = light.getY() - lightHalfToFloat(y);
+		const float dz = light.getZ() - lightHalfToFloat(z);
+		w = lightFloatToHalfUp(light.getW() + sqrtf(dx * dx + dy * dy + dz * dz));
+	}
+	else
+	{
+		w = lightFloatToHalf(light.getW());
+	}
+	pDst[0] = (uint32_t)x | ((uint32_t)y << 16);
+	pDst[1] = (uint32_t)z | ((uint32_t)w << 16);
+}
+
+#if LIGHT_PACKING_F16C
+// Two lights per register: (x0 y0 z0 w0 | x1 y1 z1 w1) -> 8 halves
+static inline __m128i packLights2(__m256 lights, bool conservativeRadius)
+{
+	const __m128i nearest = _mm256_cvtps_ph(lights, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	if (!conservativeRadius)
+		return nearest;
+
+	// distance to the rounded position, broadcast in each light
+	const __m256 delta = _mm256_sub_ps(lights, _mm256_cvtph_ps(nearest));
+	const __m256 distance = _mm256_sqrt_ps(_mm256_dp_ps(delta, delta, 0x7f));
+	const __m256 inflated = _mm256_blend_ps(lights, _mm256_add_ps(lights, distance), 0x88);
+	const __m128i up = _mm256_cvtps_ph(inflated, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+	return _mm_blend_epi16(nearest, up, 0x88);
+}
+#endif
+
+struct LightPackingTask
+{
+	const vec4* pSrc;
+	uint32_t*   pDst;
+	uint32_t    mCount;
+	uint32_t    mDstStride; // uint2 elements between two packed lights
+	bool        mConservativeRadius;
+};
+
+static void packLightsChunk(void* pUserData, uint64_t chunk)
+{
+	const LightPackingTask* pTask = (const LightPackingTask*)pUserData;
+	const uint32_t begin = (uint32_t)chunk * LIGHT_PACKING_CHUNK;
+	const uint32_t end = min(begin + LIGHT_PACKING_CHUNK, pTask->mCount);
+	uint32_t i = begin;
+
+#if LIGHT_PACKING_F16C
+	const float* pSrc = (const float*)pTask->pSrc;
+	const uint32_t stride = pTask->mDstStride * 2;
+	for (; i + 8 <= end; i += 8)
+	{
+		for (uint32_t k = 0; k < 8; k += 2)
+		{
+			const __m128i packed = packLights2(_mm256_loadu_ps(pSrc + (i + k) * 4), pTask->mConservativeRadius);
+			uint32_t* pDst = pTask->pDst + (i + k) * stride;
+			if (stride == 2)
+			{
+				_mm_storeu_si128((__m128i*)pDst, packed);
+			}
+			else
+			{
+				_mm_storel_epi64((__m128i*)pDst, packed);
+				_mm_storel_epi64((__m128i*)(pDst + stride), _mm_unpackhi_epi64(packed, packed));
+			}
+		}
+	}
+#endif
+
+	for (; i < end; ++i)
+		packLight(pTask->pSrc[i], pTask->mConservativeRadius, pTask->pDst + i * pTask->mDstStride * 2);
+}
+
+/**
+ * @brief Packs count lights of pSrc into pDst (2 uints per light, dstStride uint2 apart). Blocking.
+ * pDst may be write-combined memory (mapped upload buffer), it is only written, never read.
+ * @param conservativeRadius w is a radius that has to cover the rounding of xyz (positions), otherwise w is rounded like xyz (colors)
+ */
+void packLights(ThreadSystem* pThreadSystem, const vec4* pSrc, uint32_t count, uint32_t* pDst, uint32_t dstStride, bool conservativeRadius)
+{
+	LightPackingTask task = { pSrc, pDst, count, dstStride, conservativeRadius };
+	const uint32_t chunkCount = (count + LIGHT_PACKING_CHUNK - 1) / LIGHT_PACKING_CHUNK;
+	if (pThreadSystem && chunkCount > 1)
+	{
+		addThreadSystemRangeTask(pThreadSystem, packLightsChunk, &task, chunkCount);
+		waitThreadSystemIdle(pThreadSystem);
+	}
+	else
+	{
+		for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+			packLightsChunk(&task, chunk);
+	}
+}
+
+/************************************************************************/
+// Benchmark
+/************************************************************************/
+// Packs seeded random lights, logs the average time and checks the SIMD path against the scalar one
+void benchmarkLightPacking(ThreadSystem* pThreadSystem, uint32_t numLights, uint32_t iterations)
+{
+	vec4* pLights = (vec4*)tf_memalign(32, numLights * sizeof(vec4));
+	uint32_t* pPacked = (uint32_t*)tf_memalign(32, numLights * 2 * sizeof(uint32_t));
+	std::mt19937 mt(1);
+	std::normal_distribution<float> distribution(0.0f, 10.0f);
+	std::uniform_real_distribution<float> radiusDistribution(0.0f, 3.0f);
+	for (uint32_t i = 0; i < numLights; ++i)
+		pLights[i] = vec4(distribution(mt), distribution(mt), distribution(mt), radiusDistribution(mt));
+
+	packLights(pThreadSystem, pLights, numLights, pPacked, 1, true);
+	uint32_t mismatches = 0;
+	uint32_t notContained = 0;
+	float maxPositionError = 0.0f;
+	for (uint32_t i = 0; i < numLights; ++i)
+	{
+		uint32_t reference[2];
+		packLight(pLights[i], true, reference);
+		mismatches += (reference[0] != pPacked[i * 2] || reference[1] != pPacked[i * 2 + 1]) ? 1 : 0;
+
+		const float dx = pLights[i].getX() - lightHalfToFloat((uint16_t)(pPacked[i * 2] & 0xffffu));
+		const float dy = pLights[i].getY() - lightHalfToFloat((uint16_t)(pPacked[i * 2] >> 16));
+		const float dz = pLights[i].getZ() - lightHalfToFloat((uint16_t)(pPacked[i * 2 + 1] & 0xffffu));
+		const float error = sqrtf(dx * dx + dy * dy + dz * dz);
+		maxPositionError = max(maxPositionError, error);
+		notContained += (lightHalfToFloat((uint16_t)(pPacked[i * 2 + 1] >> 16)) < pLights[i].getW() + error) ? 1 : 0;
+	}
+
+	HiresTimer timer;
+	initHiresTimer(&timer);
+	for (uint32_t i = 0; i < iterations; ++i)
+		packLights(pThreadSystem, pLights, numLights, pPacked, 1, true);
+	const double milliseconds = (double)getHiresTimerUSec(&timer, false) / 1000.0 / (double)max(iterations, 1u);
+
+	LOGF(eINFO, "Light packing: %u lights, avg %.3f ms (%s), SIMD vs scalar mismatches %u, max position error %g, spheres not contained %u", numLights,
+		milliseconds, LIGHT_PACKING_F16C ? "F16C" : "scalar", mismatches, maxPositionError, notContained);
+
+	tf_free(pPacked);
+	tf_free(pLights);
+}
+
+#endif // !LIGHTPACKING_H
@@ -0,0 +1,272 @@
+#ifndef OBJECTINSTANCES_H
+#define OBJECTINSTANCES_H
+
+// Instanced objects: every instance keeps its transform in SoA arrays (position, rotation quaternion, uniform scale).
+// setObjectInstance() queues the instance as moved, and updateObjectInstanceMatrices() rebuilds the world matrices
+// (translation * rotation * scale) of the queued instances only, AVX2: 8 per iteration gathered by index, in parallel chunks.
+// The matrices land in pWorld, the CPU copy the per frame object buffers are updated from.
+#include <math.h>
+#include <string.h>
+#include <random>
+
+#if defined(__AVX2__)
+#define OBJECT_INSTANCES_AVX2 1
+#include <immintrin.h>
+#else
+#define OBJECT_INSTANCES_AVX2 0
+#endif
+
+#include "../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../Common_3/Utilities/Interfaces/ITime.h"
+#include "../../../../Common_3/Utilities/Threading/ThreadSystem.h"
+#include "../../../../Common_3/Utilities/Math/MathTypes.h"
+#include "../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+#define OBJECT_INSTANCE_CHUNK 4096
+
+struct ObjectInstances
+{
+	ThreadSystem* pThreadSystem;
+	uint32_t      mCapacity; // multiple of 8
+
+	float*        pPositionX;
+	float*        pPositionY;
+	float*        pPositionZ;
+	float*        pRotationX; // unit quaternion
+	float*        pRotationY;
+	float*        pRotationZ;
+	float*        pRotationW;
+	float*        pScale;
+	mat4*         pWorld;
+
+	uint32_t*     pMoved;      // instances queued since the last update
+	uint8_t*      pMovedFlags; // 1 while queued
+	uint32_t      mMovedCount;
+
+	double        mLastMilliseconds;
+};
+
+// Columns of the world matrix of instance i, the same formula in the scalar and the SIMD path
+static inline mat4 objectInstanceMatrix(const ObjectInstances* pInstances, uint32_t i)
+{
+	const float x = pInstances->pRotationX[i], y = pInstances->pRotationY[i], z = pInstances->pRotationZ[i], w = pInstances->pRotationW[i];
+	const float s = pInstances->pScale[i];
+	const float s2 = s + s;
+	return mat4(vec4(s - s2 * (y * y + z * z), s2 * (x * y + w * z), s2 * (x * z - w * y), 0.0f),
+		vec4(s2 * (x * y - w * z), s - s2 * (x * x + z * z), s2 * (y * z + w * x), 0.0f),
+		vec4(s2 * (x * z + w * y), s2 * (y * z - w * x), s - s2 * (x * x + y * y), 0.0f),
+		vec4(pInstances->pPositionX[i], pInstances->pPositionY[i], pInstances->pPositionZ[i], 1.0f));
+}
+
+#if OBJECT_INSTANCES_AVX2
+// 8 lanes of (x, y, z, w) -> the vec4 of every lane, written to column c of its matrix
+static inline void objectInstanceStoreColumn8(mat4* pWorld, const uint32_t* pIndices, uint32_t c, __m256 x, __m256 y, __m256 z, __m256 w)
+{
+	const __m256 t0 = _mm256_unpacklo_ps(x, y); // x0 y0 x1 y1 | x4 y4 x5 y5
+	const __m256 t1 = _mm256_unpackhi_ps(x, y); // x2 y2 x3 y3 | x6 y6 x7 y7
+	const __m256 t2 = _mm256_unpacklo_ps(z, w);
+	const __m256 t3 = _mm256_unpackhi_ps(z, w);
+	const __m256 l04 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	const __m256 l15 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	const __m256 l26 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	const __m256 l37 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	const __m256 lanes[4] = { l04, l15, l26, l37 };
+	for (uint32_t k = 0; k < 4; ++k)
+	{
+		_mm_storeu_ps((float*)&pWorld[pIndices[k]] + c * 4, _mm256_castps256_ps128(lanes[k]));
+		_mm_storeu_ps((float*)&pWorld[pIndices[k + 4]] + c * 4, _mm256_extractf128_ps(lanes[k], 1));
+	}
+}
+#endif
+
+static void objectInstanceChunk(void* pUserData, uint64_t chunk)
+{
+	ObjectInstances* pInstances = (ObjectInstances*)pUserData;
+	const uint32_t begin = (uint32_t)chunk * OBJECT_INSTANCE_CHUNK;
+	const uint32_t end = min(begin + OBJECT_INSTANCE_CHUNK, pInstances->mMovedCount);
+	const uint32_t* pMoved = pInstances->pMoved;
+	uint32_t i = begin;
+
+#if OBJECT_INSTANCES_AVX2
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	for (; i + 8 <= end; i += 8)
+	{
+		const __m256i index = _mm256_loadu_si256((const __m256i*)(pMoved + i));
+		const __m256 x = _mm256_i32gather_ps(pInstances->pRotationX, index, 4);
+		const __m256 y = _mm256_i32gather_ps(pInstances->pRotationY, index, 4);
+		const __m256 z = _mm256_i32gather_ps(pInstances->pRotationZ, index, 4);
+		const __m256 w = _mm256_i32gather_ps(pInstances->pRotationW, index, 4);
+		const __m256 s = _mm256_i32gather_ps(pInstances->pScale, index, 4);
+		const __m256 s2 = _mm256_add_ps(s, s);
+
+		const __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+		const __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+		const __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+		objectInstanceStoreColumn8(pInstances->pWorld, pMoved + i, 0, _mm256_sub_ps(s, _mm256_mul_ps(s2, _mm256_add_ps(yy, zz))),
+			_mm256_mul_ps(s2, _mm256_add_ps(xy, wz)), _mm256_mul_ps(s2, _mm256_sub_ps(xz, wy)), zero);
+		objectInstanceStoreColumn8(pInstances->pWorld, pMoved + i, 1, _mm256_mul_ps(s2, _mm256_sub_ps(xy, wz)),
+			_mm256_sub_ps(s, _mm256_mul_ps(s2, _mm256_add_ps(xx, zz))), _mm256_mul_ps(s2, _mm256_add_ps(yz, wx)), zero);
+		objectInstanceStoreColumn8(pInstances->pWorld, pMoved + i, 2, _mm256_mul_ps(s2, _mm256_add_ps(xz, wy)),
+			_mm256_mul_ps(s2, _mm256_sub_ps(yz, wx)), _mm256_sub_ps(s, _mm256_mul_ps(s2, _mm256_add_ps(xx, yy))), zero);
+		objectInstanceStoreColumn8(pInstances->pWorld, pMoved + i, 3, _mm256_i32gather_ps(pInstances->pPositionX, index, 4),
+			_mm256_i32gather_ps(pInstances->pPositionY, index, 4), _mm256_i32gather_ps(pInstances->pPositionZ, index, 4), one);
+	}
+#endif
+
+	// scalar path, also the last instances of the final chunk
+	for (; i < end; ++i)
+		pInstances->pWorld[pMoved[i]] = objectInstanceMatrix(pInstances, pMoved[i]);
+}
+
+void initObjectInstances(ThreadSystem* pThreadSystem, ObjectInstances* pInstances, uint32_t capacity)
+{
+	memset((void*)pInstances, 0, sizeof(ObjectInstances));
+	pInstances->pThreadSystem = pThreadSystem;
+	pInstances->mCapacity = (capacity + 7) & ~7u;
+
+	float** arrays[] = { &pInstances->pPositionX, &pInstances->pPositionY, &pInstances->pPositionZ, &pInstances->pRotationX,
+		&pInstances->pRotationY, &pInstances->pRotationZ, &pInstances->pRotationW, &pInstances->pScale };
+	for (float** ppArray : arrays)
+		*ppArray = (float*)tf_memalign(32, pInstances->mCapacity * sizeof(float));
+	pInstances->pWorld = (mat4*)tf_memalign(32, pInstances->mCapacity * sizeof(mat4));
+	pInstances->pMoved = (uint32_t*)tf_malloc(pInstances->mCapacity * sizeof(uint32_t));
+	pInstances->pMovedFlags = (uint8_t*)tf_calloc(pInstances->mCapacity, sizeof(uint8_t));
+}
+
+void exitObjectInstances(ObjectInstances* pInstances)
+{
+	float** arrays[] = { &pInstances->pPositionX, &pInstances->pPositionY, &pInstances->pPositionZ, &pInstances->pRotationX,
+		&pInstances->pRotationY, &pInstances->pRotationZ, &pInstances->pRotationW, &pInstances->pScale };
+	for (float** ppArray : arrays)
+		tf_free(*ppArray);
+	tf_free(pInstances->pWorld);
+	tf_free(pInstances->pMoved);
+	tf_free(pInstances->pMovedFlags);
+	memset((void*)pInstances, 0, sizeof(ObjectInstances));
+}
+
+/**
+ * @brief Moves instance i and queues it for the next updateObjectInstanceMatrices().
+ * @param rotation unit quaternion (x, y, z, w)
+ */
+static inline void setObjectInstance(ObjectInstances* pInstances, uint32_t i, const vec3& position, const vec4& rotation, float scale)
+{
+	pInstances->pPositionX[i] = position.getX();
+	pInstances->pPositionY[i] = position.getY();
+	pInstances->pPositionZ[i] = position.getZ();
+	pInstances->pRotationX[i] = rotation.getX();
+	pInstances->pRotationY[i] = rotation.getY();
+	pInstances->pRotationZ[i] = rotation.getZ();
+	pInstances->pRotationW[i] = rotation.getW();
+	pInstances->pScale[i] = scale;
+	if (!pInstances->pMovedFlags[i])
+	{
+		pInstances->pMovedFlags[i] = 1;
+		pInstances->pMoved[pInstances->mMovedCount++] = i;
+	}
+}
+
+// Turns instance i in place
+static inline void setObjectInstanceRotation(ObjectInstances* pInstances, uint32_t i, const vec4& rotation)
+{
+	setObjectInstance(pInstances, i, vec3(pInstances->pPositionX[i], pInstances->pPositionY[i], pInstances->pPositionZ[i]), rotation, pInstances->pScale[i]);
+}
+
+/**
+ * @brief Rebuilds the world matrices of the instances moved since the last call. Blocking.
+ * @return the moved instances, [*pBegin, *pEnd) covers all of them (empty if none moved)
+ */
+uint32_t updateObjectInstanceMatrices(ObjectInstances* pInstances, uint32_t* pBegin, uint32_t* pEnd)
+{
+	HiresTimer timer;
+	initHiresTimer(&timer);
+
+	const uint32_t movedCount = pInstances->mMovedCount;
+	const uint32_t chunkCount = (movedCount + OBJECT_INSTANCE_CHUNK - 1) / OBJECT_INSTANCE_CHUNK;
+	if (pInstances->pThreadSystem && chunkCount > 1)
+	{
+		addThreadSystemRangeTask(pInstances->pThreadSystem, objectInstanceChunk, pInstances, chunkCount);
+		waitThreadSystemIdle(pInstances->pThreadSystem);
+	}
+	else
+	{
+		for (uint32_t chunk = 0; chunk < chunkCount; ++chunk)
+			objectInstanceChunk(pInstances, chunk);
+	}
+
+	uint32_t begin = UINT32_MAX;
+	uint32_t end = 0;
+	for (uint32_t i = 0; i < movedCount; ++i)
+	{
+		const uint32_t instance = pInstances->pMoved[i];
+		pInstances->pMovedFlags[instance] = 0;
+		begin = min(begin, instance);
+		end = max(end, instance + 1);
+	}
+	pInstances->mMovedCount = 0;
+	*pBegin = movedCount ? begin : 0;
+	*pEnd = end;
+
+	pInstances->mLastMilliseconds = (double)getHiresTimerUSec(&timer, false) / 1000.0;
+	return movedCount;
+}
+
+// Rotation of angle radians around +Y as a quaternion
+static inline vec4 objectInstanceRotationY(float angle) { return vec4(0.0f, sinf(angle * 0.5f), 0.0f, cosf(angle * 0.5f)); }
+
+/************************************************************************/
+// Benchmark
+/************************************************************************/
+// Moves every instance / every 8th instance per iteration, logs the average update time and checks the SIMD path against the scalar one
+void benchmarkObjectInstances(ThreadSystem* pThreadSystem, uint32_t numInstances, uint32_t iterations)
+{
+	ObjectInstances instances;
+	initObjectInstances(pThreadSystem, &instances, numInstances);
+	std::mt19937 mt(1);
+	std::uniform_real_distribution<float> positionDistribution(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> angleDistribution(-PI, PI);
+	std::uniform_real_distribution<float> scaleDistribution(0.01f, 0.1f);
+	for (uint32_t i = 0; i < numInstances; ++i)
+	{
+		const vec3 axis = normalize(vec3(positionDistribution(mt), positionDistribution(mt), positionDistribution(mt)) + vec3(0.0f, 0.0f, 1e-3f));
+		const float angle = angleDistribution(mt);
+		setObjectInstance(&instances, i, vec3(positionDistribution(mt), positionDistribution(mt), positionDistribution(mt)),
+			vec4(axis * sinf(angle * 0.5f), cosf(angle * 0.5f)), scaleDistribution(mt));
+	}
+
+	uint32_t begin = 0, end = 0;
+	updateObjectInstanceMatrices(&instances, &begin, &end);
+	float maxError = 0.0f;
+	for (uint32_t i = 0; i < numInstances; ++i)
+	{
+		const mat4 reference = objectInstanceMatrix(&instances, i);
+		const float* pReference = (const float*)&reference;
+		const float* pWorld = (const float*)&instances.pWorld[i];
+		for (uint32_t k = 0; k < 16; ++k)
+			maxError = max(maxError, fabsf(pWorld[k] - pReference[k]));
+	}
+
+	const uint32_t threadCount = pThreadSystem ? getThreadSystemThreadCount(pThreadSystem) : 1;
+	const uint32_t strides[] = { 1, 8 };
+	for (uint32_t stride : strides)
+	{
+		double totalMilliseconds = 0.0;
+		for (uint32_t iteration = 0; iteration < iterations; ++iteration)
+		{
+			const vec4 rotation = objectInstanceRotationY((float)iteration / 60.0f);
+			for (uint32_t i = 0; i < numInstances; i += stride)
+				setObjectInstanceRotation(&instances, i, rotation);
+			updateObjectInstanceMatrices(&instances, &begin, &end);
+			totalMilliseconds += instances.mLastMilliseconds;
+		}
+
+		LOGF(eINFO, "Object instances: %u instances, 1 in %u moved, %u threads, avg %.3f ms (%s), SIMD vs scalar max error %g", numInstances, stride,
+			threadCount, totalMilliseconds / (double)max(iterations, 1u), OBJECT_INSTANCES_AVX2 ? "AVX2" : "scalar", maxError);
+	}
+
+	exitObjectInstances(&instances);
+}
+
+#endif // !OBJECTINSTANCES_H
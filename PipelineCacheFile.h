@@ -0,0 +1,167 @@
+#ifndef PIPELINECACHEFILE_H
+#define PIPELINECACHEFILE_H
+
+// On-disk pipeline cache (RD_PIPELINE_CACHE). The driver blob is stored behind a header that keys it to the GPU
+// (vendor, model, driver version) and to a hash of the shader binaries it was built from. Any mismatch, or a blob that
+// fails its own hash, starts from an empty cache instead. The file is read in Init, but the cache is only created once
+// addShaders() has hashed the binaries, and it is written back on Exit.
+#include <string.h>
+
+#include "../../../../Common_3/Graphics/Interfaces/IGraphics.h"
+#include "../../../../Common_3/Utilities/Interfaces/IFileSystem.h"
+#include "../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+#define PIPELINE_CACHE_FILE_MAGIC 0x43505444u // "DTPC"
+#define PIPELINE_CACHE_FILE_VERSION 1u
+#define PIPELINE_CACHE_HASH_SEED 14695981039346656037ull
+
+struct PipelineCacheFileHeader
+{
+	uint32_t mMagic;
+	uint32_t mVersion;
+	uint32_t mVendorId;
+	uint32_t mModelId;
+	char     mDriverVersion[64];
+	uint64_t mShaderHash;
+	uint64_t mDataSize;
+	uint64_t mDataHash;
+};
+
+// Blob read in Init, consumed by addPipelineCacheFromFile()
+struct PipelineCacheFile
+{
+	void*    pData;
+	uint64_t mSize;
+	uint64_t mShaderHash;
+};
+
+// FNV-1a
+static inline uint64_t hashPipelineCacheBytes(uint64_t hash, const void* pData, size_t size)
+{
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ pBytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+static inline void fillPipelineCacheDeviceKey(Renderer* pRenderer, PipelineCacheFileHeader* pHeader)
+{
+	const GpuVendorPreset& preset = pRenderer->pActiveGpuSettings->mGpuVendorPreset;
+	pHeader->mVendorId = preset.mVendorId;
+	pHeader->mModelId = preset.mModelId;
+	strncpy(pHeader->mDriverVersion, preset.mGpuDriverVersion, sizeof(pHeader->mDriverVersion) - 1);
+}
+
+/**
+ * @brief Folds the binaries of every stage of a shader into hash. A binary that cannot be opened only contributes its name.
+ */
+uint64_t hashShaderBinaries(uint64_t hash, const ShaderLoadDesc* pDesc)
+{
+	for (uint32_t i = 0; i < sizeof(pDesc->mStages) / sizeof(pDesc->mStages[0]); ++i)
+	{
+		const char* pFileName = pDesc->mStages[i].pFileName;
+		if (!pFileName)
+			continue;
+		hash = hashPipelineCacheBytes(hash, pFileName, strlen(pFileName));
+
+		FileStream stream = {};
+		if (!fsOpenStreamFromPath(RD_SHADER_BINARIES, pFileName, FM_READ_BINARY, &stream))
+			continue;
+		uint8_t buffer[4096];
+		size_t read = 0;
+		while ((read = fsReadFromStream(&stream, buffer, sizeof(buffer))) > 0)
+			hash = hashPipelineCacheBytes(hash, buffer, read);
+		fsCloseStream(&stream);
+	}
+	return hash;
+}
+
+/**
+ * @brief Reads the cache file if it was written on this GPU and driver. pFile is left empty otherwise.
+ */
+void readPipelineCacheFile(Renderer* pRenderer, const char* pFileName, PipelineCacheFile* pFile)
+{
+	*pFile = {};
+	FileStream stream = {};
+	if (!fsOpenStreamFromPath(RD_PIPELINE_CACHE, pFileName, FM_READ_BINARY, &stream))
+		return;
+
+	PipelineCacheFileHeader header = {};
+	PipelineCacheFileHeader device = {};
+	fillPipelineCacheDeviceKey(pRenderer, &device);
+	const bool valid = fsReadFromStream(&stream, &header, sizeof(header)) == sizeof(header) && header.mMagic == PIPELINE_CACHE_FILE_MAGIC &&
+					   header.mVersion == PIPELINE_CACHE_FILE_VERSION && header.mVendorId == device.mVendorId && header.mModelId == device.mModelId &&
+					   strncmp(header.mDriverVersion, device.mDriverVersion, sizeof(header.mDriverVersion)) == 0 &&
+					   (ssize_t)(sizeof(header) + header.mDataSize) == fsGetStreamFileSize(&stream);
+	if (valid && header.mDataSize)
+	{
+		pFile->pData = tf_malloc(header.mDataSize);
+		if (fsReadFromStream(&stream, pFile->pData, header.mDataSize) == header.mDataSize &&
+			hashPipelineCacheBytes(PIPELINE_CACHE_HASH_SEED, pFile->pData, header.mDataSize) == header.mDataHash)
+		{
+			pFile->mSize = header.mDataSize;
+			pFile->mShaderHash = header.mShaderHash;
+		}
+		else
+		{
+			tf_free(pFile->pData);
+			pFile->pData = NULL;
+		}
+	}
+	fsCloseStream(&stream);
+
+	if (!pFile->pData)
+		LOGF(eINFO, "Pipeline cache: %s does not match this GPU / driver, starting empty", pFileName);
+}
+
+/**
+ * @brief Creates the pipeline cache, seeded with the file blob when it was built from the same shader binaries. Frees the blob.
+ */
+void addPipelineCacheFromFile(Renderer* pRenderer, PipelineCacheFile* pFile, uint64_t shaderHash, PipelineCache** ppCache)
+{
+	PipelineCacheDesc desc = {};
+	if (pFile->pData && pFile->mShaderHash == shaderHash)
+	{
+		desc.pData = pFile->pData;
+		desc.mSize = (size_t)pFile->mSize;
+	}
+	else if (pFile->pData)
+	{
+		LOGF(eINFO, "Pipeline cache: shader binaries changed, starting empty");
+	}
+	addPipelineCache(pRenderer, &desc, ppCache);
+
+	tf_free(pFile->pData);
+	*pFile = {};
+}
+
+void writePipelineCacheFile(Renderer* pRenderer, PipelineCache* pCache, const char* pFileName, uint64_t shaderHash)
+{
+	size_t size = 0;
+	getPipelineCacheData(pRenderer, pCache, &size, NULL);
+	if (!size)
+		return;
+	void* pData = tf_malloc(size);
+	getPipelineCacheData(pRenderer, pCache, &size, pData);
+
+	PipelineCacheFileHeader header = {};
+	header.mMagic = PIPELINE_CACHE_FILE_MAGIC;
+	header.mVersion = PIPELINE_CACHE_FILE_VERSION;
+	fillPipelineCacheDeviceKey(pRenderer, &header);
+	header.mShaderHash = shaderHash;
+	header.mDataSize = size;
+	header.mDataHash = hashPipelineCacheBytes(PIPELINE_CACHE_HASH_SEED, pData, size);
+
+	FileStream stream = {};
+	if (fsOpenStreamFromPath(RD_PIPELINE_CACHE, pFileName, FM_WRITE_BINARY, &stream))
+	{
+		fsWriteToStream(&stream, &header, sizeof(header));
+		fsWriteToStream(&stream, pData, size);
+		fsCloseStream(&stream);
+		LOGF(eINFO, "Pipeline cache: wrote %zu KB to %s", size / 1024, pFileName);
+	}
+	tf_free(pData);
+}
+
+#endif // !PIPELINECACHEFILE_H
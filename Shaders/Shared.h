@@ -1,3 +1,44 @@
-#define TOTAL_IMGS 84
-#define MAX_LIGHTS 4096
-#define TILE_RES 16
\ No newline at end of file
+#define TOTAL_IMGS 84 // Sponza material texture files
+#define MAX_MATERIAL_TEXTURES 4096 // textureMaps capacity
+#define INITIAL_LIGHT_CAPACITY 4096
+#define TILE_RES 16 // default tile size, the culling kernels are also built for the other TILE_SIZE_* (TILE_RES_X / Y in lightCullResource.h.fsl)
+#define TILE_SIZE_8X8 0 // tile size permutations, see gTileSizes
+#define TILE_SIZE_16X16 1
+#define TILE_SIZE_32X32 2
+#define TILE_SIZE_32X8 3
+#define TILE_SIZE_COUNT 4
+#define MAX_NUM_LIGHTS_PER_TILE 272
+#define CLUSTER_DEPTH_SLICES 16
+#define MAX_NUM_LIGHTS_PER_CLUSTER_TILE 544
+#define LIGHT_BIN_TILES 8
+#define LIGHT_BIN_INITIAL_CAPACITY 65536 // light bin indices of all bins together, grown from the LIGHT_OVERFLOW_BIN_LIGHTS readback
+#define LIGHT_GRID_INITIAL_CAPACITY 65536 // Forward+ light indices of all tiles together, grown from the LIGHT_OVERFLOW_GRID_LIGHTS readback
+#define CLUSTER_LIGHT_INITIAL_CAPACITY 65536 // cluster light indices of all tiles together, grown from the LIGHT_OVERFLOW_CLUSTER_LIGHTS readback
+#define LIGHT_BVH_LEAF_BIT 0x80000000u
+#define LIGHT_BVH_MAX_ROOTS 256
+#define LIGHT_BVH_STACK_SIZE 32
+#define GBUFFER_CULL_THREADS 64
+#define DRAW_FLAG_ALPHA_BLENDED 0x1u
+#define DEPTH_PYRAMID_DOWNSAMPLE_THREADS 8
+#define LIGHT_BIN_PYRAMID_LEVEL 3 // log2(LIGHT_BIN_TILES): one depth pyramid texel per light bin
+#define LIGHT_LIST_INDEX32 0 // tile light list encodings, see lightList.h.fsl
+#define LIGHT_LIST_INDEX16 1
+#define LIGHT_LIST_BITMASK 2
+#define LIGHT_LIST_ENCODING_COUNT 3
+#define LIGHT_LIST_MASK_LIGHTS 4096 // bin positions a bitmask light list covers, the lights of the bin after them spill
+#define LIGHT_OVERFLOW_CAPACITY 65536 // spill nodes of the tile light lists, clusters and Forward+ grids of a frame slot, see lightSpill.h.fsl
+#define LIGHT_OVERFLOW_END 0xFFFFFFFFu
+#define LIGHT_OVERFLOW_NODES 0     // light overflow counters: spill nodes allocated, can exceed LIGHT_OVERFLOW_CAPACITY
+#define LIGHT_OVERFLOW_TILES 1     // tile light lists, Clustered tiles and Forward+ grids that overflowed
+#define LIGHT_OVERFLOW_DROPPED 2   // lights dropped by full light bins, and the cluster lists cut from a full clusterLightIndices
+#define LIGHT_OVERFLOW_MAX_LIGHTS 3 // most lights culled into one tile list
+#define LIGHT_OVERFLOW_BIN_LIGHTS 4 // light bin indices allocated, can exceed the light bin capacity
+#define LIGHT_OVERFLOW_GRID_LIGHTS 5 // Forward+ light indices allocated, can exceed the light grid capacity
+#define LIGHT_OVERFLOW_CLUSTER_LIGHTS 6 // cluster light indices allocated, can exceed the cluster light capacity
+#define LIGHT_OVERFLOW_COUNTER_COUNT 7
+#define LIGHT_FORMAT_FP16 1 // light buffers hold four halves per element, see LightPacking.h
+#define LIGHT_LAYOUT_SPLIT 0       // GPU light storage, see LightLayout.h
+#define LIGHT_LAYOUT_INTERLEAVED 1
+#define LIGHT_LAYOUT_COMPACT 2
+#define LIGHT_LAYOUT_COUNT 3
+#define LIGHT_LAYOUT LIGHT_LAYOUT_SPLIT
\ No newline at end of file
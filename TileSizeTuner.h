@@ -0,0 +1,91 @@
+#ifndef TILESIZETUNER_H
+#define TILESIZETUNER_H
+
+// Auto-tuning of the culling tile size (TILE_SIZE_* in Shared.h). Every permutation is run for mFramesPerVariant frames on the
+// current GPU, resolution and light count, the light culling GPU time of the frames after the warm-up is averaged and the
+// fastest permutation is kept. The times come back frames in flight late, so the app tags every measured frame with the
+// variant it was recorded with and only finishes the tuning once no measured frame is left in flight.
+#include <float.h>
+
+#include "Shaders/Shared.h"
+
+// frames right after a switch, the light grid buffers have just been recreated and the caches are cold
+#define TILE_SIZE_TUNER_WARMUP_FRAMES 8
+
+static const char* gTileSizeNames[TILE_SIZE_COUNT] = { "8x8", "16x16", "32x32", "32x8" };
+// pixels per tile (x, y) of each permutation
+static const uint32_t gTileSizes[TILE_SIZE_COUNT][2] = { { 8, 8 }, { 16, 16 }, { 32, 32 }, { 32, 8 } };
+
+struct TileSizeTuner
+{
+	uint32_t mFramesPerVariant;
+	uint32_t mVariant; // permutation being recorded, TILE_SIZE_COUNT once every permutation was recorded
+	uint32_t mFrame;   // frames recorded with mVariant
+	uint32_t mSampleCount[TILE_SIZE_COUNT];
+	double   mTotalMs[TILE_SIZE_COUNT];
+	bool     mActive;
+};
+
+void beginTileSizeTuning(TileSizeTuner* pTuner, uint32_t framesPerVariant)
+{
+	*pTuner = {};
+	pTuner->mFramesPerVariant = framesPerVariant > TILE_SIZE_TUNER_WARMUP_FRAMES ? framesPerVariant : TILE_SIZE_TUNER_WARMUP_FRAMES + 1;
+	pTuner->mActive = true;
+}
+
+/**
+ * @brief Tile size of the frame about to be recorded. *pMeasure is set when its culling time counts towards the average.
+ * Once every permutation was recorded the last one stays selected until the tuning is finished.
+ */
+uint32_t nextTileSizeTuningFrame(TileSizeTuner* pTuner, bool* pMeasure)
+{
+	if (pTuner->mVariant < TILE_SIZE_COUNT && pTuner->mFrame == pTuner->mFramesPerVariant)
+	{
+		++pTuner->mVariant;
+		pTuner->mFrame = 0;
+	}
+
+	if (pTuner->mVariant == TILE_SIZE_COUNT)
+	{
+		*pMeasure = false;
+		return TILE_SIZE_COUNT - 1;
+	}
+
+	*pMeasure = pTuner->mFrame >= TILE_SIZE_TUNER_WARMUP_FRAMES;
+	++pTuner->mFrame;
+	return pTuner->mVariant;
+}
+
+void addTileSizeTuningSample(TileSizeTuner* pTuner, uint32_t variant, float gpuMs)
+{
+	pTuner->mTotalMs[variant] += gpuMs;
+	++pTuner->mSampleCount[variant];
+}
+
+bool isTileSizeTuningRecorded(const TileSizeTuner* pTuner) { return pTuner->mVariant == TILE_SIZE_COUNT; }
+
+// Fastest permutation on average, fallback when none of them got a sample
+uint32_t getTunedTileSize(const TileSizeTuner* pTuner, uint32_t fallback)
+{
+	uint32_t best = fallback;
+	double bestMs = DBL_MAX;
+	for (uint32_t i = 0; i < TILE_SIZE_COUNT; ++i)
+	{
+		if (!pTuner->mSampleCount[i])
+			continue;
+		const double ms = pTuner->mTotalMs[i] / (double)pTuner->mSampleCount[i];
+		if (ms < bestMs)
+		{
+			bestMs = ms;
+			best = i;
+		}
+	}
+	return best;
+}
+
+float getTileSizeTuningAverageMs(const TileSizeTuner* pTuner, uint32_t variant)
+{
+	return pTuner->mSampleCount[variant] ? (float)(pTuner->mTotalMs[variant] / (double)pTuner->mSampleCount[variant]) : 0.0f;
+}
+
+#endif // !TILESIZETUNER_H
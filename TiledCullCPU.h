@@ -0,0 +1,630 @@
+#ifndef TILEDCULLCPU_H
+#define TILEDCULLCPU_H
+
+// CPU reference of the tile light culling in TiledCullBaseline / TiledCullHalfZ / TiledCullModifiedZ.
+// Lights are transformed to view space once per run, then every tile tests all of them in SIMD batches
+// (AVX2: 8 lights, SSE: 4 lights). Tile rows are spread across the thread system.
+#include <float.h>
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+#include "../../../../Common_3/Utilities/Interfaces/ILog.h"
+#include "../../../../Common_3/Utilities/Interfaces/ITime.h"
+#include "../../../../Common_3/Utilities/Threading/ThreadSystem.h"
+#include "../../../../Common_3/Utilities/Math/MathTypes.h"
+#include "../../../../Common_3/Utilities/Interfaces/IMemory.h"
+
+#include "Shaders/Shared.h"
+#include "TileSizeTuner.h"
+
+// light arrays are padded to this so every SIMD path can use aligned full-width loads
+#define TILED_CULL_CPU_LIGHT_ALIGN 8
+#define TILED_CULL_CPU_LIGHT_CHUNK 1024
+// largest entry of gTileSizes, bounds the per tile depth scratch
+#define TILED_CULL_CPU_MAX_TILE_RES 32
+
+enum TiledCullCpuMode
+{
+	TILED_CULL_CPU_BASELINE = 0,
+	TILED_CULL_CPU_HALFZ,
+	TILED_CULL_CPU_MODIFIED_Z,
+	TILED_CULL_CPU_MODE_COUNT
+};
+
+struct TiledCullCpuDesc
+{
+	const float* pDepth;             // device depth (reverse Z), mWidth * mHeight, 0 = nothing rendered
+	uint32_t     mWidth;
+	uint32_t     mHeight;
+	uint32_t     mTileWidth;         // pixels per tile, one of gTileSizes
+	uint32_t     mTileHeight;
+	mat4         mView;              // UniformExtCamData::mView
+	mat4         mProjectInv;        // UniformExtCamData::mProjectInv
+	const vec4*  pLightPosAndRadius; // gLightPositionAndRadius
+	uint32_t     mNumLights;
+	uint32_t     mMode;              // TiledCullCpuMode
+	bool         mScalar;            // skip the SIMD kernel (used to cross-check it)
+};
+
+// Light lists of one tile. Baseline only fills bucket 0, Half-Z / Modified-Z fill the near (0) and far (1) bucket
+// exactly like the two halves of g_group_shared_light_idx. Counts are not clamped to MAX_NUM_LIGHTS_PER_TILE.
+struct TiledCullCpuTile
+{
+	uint32_t mOffset[2];
+	uint32_t mCount[2];
+	float    mMinZ;
+	float    mMaxZ;
+	float    mHalfZ;
+};
+
+struct TiledCullCpuRow
+{
+	uint32_t* pIndices;
+	uint32_t  mSize;
+	uint32_t  mCapacity;
+	uint32_t* pScratch; // far bucket, appended to pIndices after each tile
+	uint32_t  mScratchSize;
+	uint32_t  mScratchCapacity;
+};
+
+struct TiledCullCpu
+{
+	ThreadSystem*     pThreadSystem;
+	TiledCullCpuDesc  mDesc;
+
+	// view space light spheres (SoA)
+	float*            pLightX;
+	float*            pLightY;
+	float*            pLightZ;
+	float*            pLightR;
+	uint32_t          mLightCapacity;
+	uint32_t          mPaddedLightCount;
+
+	TiledCullCpuTile* pTiles;
+	uint32_t          mTileCapacity;
+	TiledCullCpuRow*  pRows;
+	uint32_t          mRowCapacity;
+	uint32_t          mNumTilesX;
+	uint32_t          mNumTilesY;
+};
+
+struct TiledCullCpuStats
+{
+	double   mMilliseconds;       // average per run
+	double   mTilesPerSecond;
+	double   mLightTestsPerSecond; // tiles * lights
+	uint64_t mTotalTileLights;
+	bool     mMatchesScalar;
+};
+
+static inline uint32_t tiledCullCpuCtz(uint32_t v)
+{
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, v);
+	return (uint32_t)idx;
+#else
+	return (uint32_t)__builtin_ctz(v);
+#endif
+}
+
+static inline void tiledCullCpuPush(uint32_t** ppData, uint32_t* pSize, uint32_t* pCapacity, uint32_t value)
+{
+	if (*pSize == *pCapacity)
+	{
+		*pCapacity = *pCapacity ? *pCapacity * 2 : 1024;
+		*ppData = (uint32_t*)tf_realloc(*ppData, *pCapacity * sizeof(uint32_t));
+	}
+	(*ppData)[(*pSize)++] = value;
+}
+
+static inline void tiledCullCpuPushMask(TiledCullCpuRow* pRow, uint32_t bucket, uint32_t mask, uint32_t base)
+{
+	while (mask)
+	{
+		uint32_t idx = base + tiledCullCpuCtz(mask);
+		if (bucket == 0)
+			tiledCullCpuPush(&pRow->pIndices, &pRow->mSize, &pRow->mCapacity, idx);
+		else
+			tiledCullCpuPush(&pRow->pScratch, &pRow->mScratchSize, &pRow->mScratchCapacity, idx);
+		mask &= mask - 1;
+	}
+}
+
+static void tiledCullCpuTransformLights(void* pUserData, uint64_t chunk)
+{
+	TiledCullCpu* pCull = (TiledCullCpu*)pUserData;
+	const TiledCullCpuDesc& desc = pCull->mDesc;
+
+	const uint32_t begin = (uint32_t)chunk * TILED_CULL_CPU_LIGHT_CHUNK;
+	const uint32_t end = min(begin + TILED_CULL_CPU_LIGHT_CHUNK, pCull->mPaddedLightCount);
+
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		if (i < desc.mNumLights)
+		{
+			const vec4& p = desc.pLightPosAndRadius[i];
+			vec4 c = desc.mView * vec4(p.getXYZ(), 1.0f);
+			pCull->pLightX[i] = c.getX();
+			pCull->pLightY[i] = c.getY();
+			pCull->pLightZ[i] = c.getZ();
+			pCull->pLightR[i] = p.getW();
+		}
+		else
+		{
+			// padding: every "distance < radius" test fails
+			pCull->pLightX[i] = 0.0f;
+			pCull->pLightY[i] = 0.0f;
+			pCull->pLightZ[i] = 0.0f;
+			pCull->pLightR[i] = -FLT_MAX;
+		}
+	}
+}
+
+static void tiledCullCpuTile(TiledCullCpu* pCull, uint32_t tileX, uint32_t tileY, TiledCullCpuRow* pRow)
+{
+	const TiledCullCpuDesc& desc = pCull->mDesc;
+	TiledCullCpuTile& tile = pCull->pTiles[tileY * pCull->mNumTilesX + tileX];
+
+	// ConvertProjDepthToView: z / w of mProjectInv * (0, 0, depth, 1)
+	const vec4& invCol2 = desc.mProjectInv.getCol(2);
+	const vec4& invCol3 = desc.mProjectInv.getCol(3);
+
+	float viewZ[TILED_CULL_CPU_MAX_TILE_RES * TILED_CULL_CPU_MAX_TILE_RES];
+	uint32_t viewZCount = 0;
+	float minZ = FLT_MAX;
+	float maxZ = 0.0f;
+
+	const uint32_t x0 = tileX * desc.mTileWidth;
+	const uint32_t y0 = tileY * desc.mTileHeight;
+	const uint32_t x1 = min(x0 + desc.mTileWidth, desc.mWidth);
+	const uint32_t y1 = min(y0 + desc.mTileHeight, desc.mHeight);
+	for (uint32_t y = y0; y < y1; ++y)
+	{
+		const float* pDepthRow = desc.pDepth + (size_t)y * desc.mWidth;
+		for (uint32_t x = x0; x < x1; ++x)
+		{
+			const float depth = pDepthRow[x];
+			if (depth == 0.0f)
+				continue;
+
+			const float z = (invCol2.getZ() * depth + invCol3.getZ()) / (invCol2.getW() * depth + invCol3.getW());
+			viewZ[viewZCount++] = z;
+			minZ = min(minZ, z);
+			maxZ = max(maxZ, z);
+		}
+	}
+
+	const float halfZ = (minZ + maxZ) * 0.5f;
+
+	// depth range [lo, hi] of each bucket
+	float lo[2] = { minZ, halfZ };
+	float hi[2] = { maxZ, maxZ };
+	uint32_t bucketCount = 1;
+
+	if (desc.mMode == TILED_CULL_CPU_HALFZ)
+	{
+		hi[0] = halfZ;
+		bucketCount = 2;
+	}
+	else if (desc.mMode == TILED_CULL_CPU_MODIFIED_Z)
+	{
+		float minZ2 = FLT_MAX;
+		float maxZ2 = 0.0f;
+		for (uint32_t i = 0; i < viewZCount; ++i)
+		{
+			if (viewZ[i] >= halfZ)
+				minZ2 = min(minZ2, viewZ[i]);
+			if (viewZ[i] <= halfZ)
+				maxZ2 = max(maxZ2, viewZ[i]);
+		}
+
+		hi[0] = min(halfZ, maxZ2);
+		lo[1] = max(halfZ, minZ2);
+		bucketCount = 2;
+	}
+
+	tile.mMinZ = minZ;
+	tile.mMaxZ = maxZ;
+	tile.mHalfZ = halfZ;
+
+	// side planes through the origin, same corner order as the shaders
+	float plane[4][3];
+	{
+		const float width = (float)pCull->mNumTilesX;
+		const float height = (float)pCull->mNumTilesY;
+		const float pxm = (float)tileX / width * 2.0f - 1.0f;
+		const float pxp = (float)(tileX + 1) / width * 2.0f - 1.0f;
+		const float pym = (height - (float)tileY) / height * 2.0f - 1.0f;
+		const float pyp = (height - (float)(tileY + 1)) / height * 2.0f - 1.0f;
+		const float corners[4][2] = { { pxm, pym }, { pxp, pym }, { pxp, pyp }, { pxm, pyp } };
+
+		vec3 p[4];
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			vec4 v = desc.mProjectInv * vec4(corners[i][0], corners[i][1], 1.0f, 1.0f);
+			p[i] = v.getXYZ() / v.getW();
+		}
+
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			vec3 n = normalize(cross(p[i], p[(i + 1) & 3]));
+			plane[i][0] = n.getX();
+			plane[i][1] = n.getY();
+			plane[i][2] = n.getZ();
+		}
+	}
+
+	tile.mOffset[0] = pRow->mSize;
+	tile.mCount[1] = 0;
+	pRow->mScratchSize = 0;
+
+	const float* pX = pCull->pLightX;
+	const float* pY = pCull->pLightY;
+	const float* pZ = pCull->pLightZ;
+	const float* pR = pCull->pLightR;
+	uint32_t i = 0;
+
+#if defined(__AVX2__)
+	if (!desc.mScalar)
+	{
+		__m256 nx[4], ny[4], nz[4];
+		for (uint32_t k = 0; k < 4; ++k)
+		{
+			nx[k] = _mm256_set1_ps(plane[k][0]);
+			ny[k] = _mm256_set1_ps(plane[k][1]);
+			nz[k] = _mm256_set1_ps(plane[k][2]);
+		}
+		const __m256 lo0 = _mm256_set1_ps(lo[0]), hi0 = _mm256_set1_ps(hi[0]);
+		const __m256 lo1 = _mm256_set1_ps(lo[1]), hi1 = _mm256_set1_ps(hi[1]);
+
+		for (; i < pCull->mPaddedLightCount; i += 8)
+		{
+			const __m256 x = _mm256_load_ps(pX + i);
+			const __m256 y = _mm256_load_ps(pY + i);
+			const __m256 z = _mm256_load_ps(pZ + i);
+			const __m256 r = _mm256_load_ps(pR + i);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (uint32_t k = 0; k < 4; ++k)
+			{
+				__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, nx[k]), _mm256_mul_ps(y, ny[k])), _mm256_mul_ps(z, nz[k]));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, r, _CMP_LT_OQ));
+			}
+
+			if (!_mm256_movemask_ps(inside))
+				continue;
+
+			__m256 b0 = _mm256_and_ps(_mm256_cmp_ps(_mm256_sub_ps(lo0, z), r, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_sub_ps(z, hi0), r, _CMP_LT_OQ));
+			tiledCullCpuPushMask(pRow, 0, (uint32_t)_mm256_movemask_ps(_mm256_and_ps(inside, b0)), i);
+
+			if (bucketCount > 1)
+			{
+				__m256 b1 = _mm256_and_ps(_mm256_cmp_ps(_mm256_sub_ps(lo1, z), r, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_sub_ps(z, hi1), r, _CMP_LT_OQ));
+				tiledCullCpuPushMask(pRow, 1, (uint32_t)_mm256_movemask_ps(_mm256_and_ps(inside, b1)), i);
+			}
+		}
+	}
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+	if (!desc.mScalar)
+	{
+		__m128 nx[4], ny[4], nz[4];
+		for (uint32_t k = 0; k < 4; ++k)
+		{
+			nx[k] = _mm_set1_ps(plane[k][0]);
+			ny[k] = _mm_set1_ps(plane[k][1]);
+			nz[k] = _mm_set1_ps(plane[k][2]);
+		}
+		const __m128 lo0 = _mm_set1_ps(lo[0]), hi0 = _mm_set1_ps(hi[0]);
+		const __m128 lo1 = _mm_set1_ps(lo[1]), hi1 = _mm_set1_ps(hi[1]);
+
+		for (; i < pCull->mPaddedLightCount; i += 4)
+		{
+			const __m128 x = _mm_load_ps(pX + i);
+			const __m128 y = _mm_load_ps(pY + i);
+			const __m128 z = _mm_load_ps(pZ + i);
+			const __m128 r = _mm_load_ps(pR + i);
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (uint32_t k = 0; k < 4; ++k)
+			{
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, nx[k]), _mm_mul_ps(y, ny[k])), _mm_mul_ps(z, nz[k]));
+				inside = _mm_and_ps(inside, _mm_cmplt_ps(d, r));
+			}
+
+			if (!_mm_movemask_ps(inside))
+				continue;
+
+			__m128 b0 = _mm_and_ps(_mm_cmplt_ps(_mm_sub_ps(lo0, z), r), _mm_cmplt_ps(_mm_sub_ps(z, hi0), r));
+			tiledCullCpuPushMask(pRow, 0, (uint32_t)_mm_movemask_ps(_mm_and_ps(inside, b0)), i);
+
+			if (bucketCount > 1)
+			{
+				__m128 b1 = _mm_and_ps(_mm_cmplt_ps(_mm_sub_ps(lo1, z), r), _mm_cmplt_ps(_mm_sub_ps(z, hi1), r));
+				tiledCullCpuPushMask(pRow, 1, (uint32_t)_mm_movemask_ps(_mm_and_ps(inside, b1)), i);
+			}
+		}
+	}
+#endif
+
+	// scalar path, also the remainder of the SIMD loop (none while the light count is padded)
+	for (; i < desc.mNumLights; ++i)
+	{
+		const float x = pX[i], y = pY[i], z = pZ[i], r = pR[i];
+
+		bool inside = true;
+		for (uint32_t k = 0; k < 4; ++k)
+			inside = inside && (x * plane[k][0] + y * plane[k][1] + z * plane[k][2] < r);
+
+		if (!inside)
+			continue;
+
+		for (uint32_t b = 0; b < bucketCount; ++b)
+		{
+			if ((lo[b] - z < r) && (z - hi[b] < r))
+				tiledCullCpuPushMask(pRow, b, 1u, i);
+		}
+	}
+
+	tile.mCount[0] = pRow->mSize - tile.mOffset[0];
+	tile.mOffset[1] = pRow->mSize;
+	for (uint32_t k = 0; k < pRow->mScratchSize; ++k)
+		tiledCullCpuPush(&pRow->pIndices, &pRow->mSize, &pRow->mCapacity, pRow->pScratch[k]);
+	tile.mCount[1] = pRow->mScratchSize;
+}
+
+static void tiledCullCpuTileRow(void* pUserData, uint64_t tileY)
+{
+	TiledCullCpu* pCull = (TiledCullCpu*)pUserData;
+	TiledCullCpuRow* pRow = &pCull->pRows[tileY];
+	pRow->mSize = 0;
+
+	for (uint32_t tileX = 0; tileX < pCull->mNumTilesX; ++tileX)
+		tiledCullCpuTile(pCull, tileX, (uint32_t)tileY, pRow);
+}
+
+static void tiledCullCpuDispatch(TiledCullCpu* pCull, TaskFunc pTask, uint32_t count)
+{
+	if (pCull->pThreadSystem)
+	{
+		addThreadSystemRangeTask(pCull->pThreadSystem, pTask, pCull, count);
+		waitThreadSystemIdle(pCull->pThreadSystem);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < count; ++i)
+			pTask(pCull, i);
+	}
+}
+
+void initTiledCullCpu(ThreadSystem* pThreadSystem, TiledCullCpu* pCull)
+{
+	*pCull = {};
+	pCull->pThreadSystem = pThreadSystem;
+}
+
+void exitTiledCullCpu(TiledCullCpu* pCull)
+{
+	tf_free(pCull->pLightX);
+	tf_free(pCull->pLightY);
+	tf_free(pCull->pLightZ);
+	tf_free(pCull->pLightR);
+
+	for (uint32_t i = 0; i < pCull->mRowCapacity; ++i)
+	{
+		tf_free(pCull->pRows[i].pIndices);
+		tf_free(pCull->pRows[i].pScratch);
+	}
+	tf_free(pCull->pRows);
+	tf_free(pCull->pTiles);
+
+	*pCull = {};
+}
+
+// Blocking. Results stay valid until the next run.
+void runTiledCullCpu(TiledCullCpu* pCull, const TiledCullCpuDesc* pDesc)
+{
+	ASSERT(pDesc->mTileWidth * pDesc->mTileHeight <= TILED_CULL_CPU_MAX_TILE_RES * TILED_CULL_CPU_MAX_TILE_RES);
+
+	pCull->mDesc = *pDesc;
+	pCull->mNumTilesX = (pDesc->mWidth + pDesc->mTileWidth - 1) / pDesc->mTileWidth;
+	pCull->mNumTilesY = (pDesc->mHeight + pDesc->mTileHeight - 1) / pDesc->mTileHeight;
+	pCull->mPaddedLightCount = (pDesc->mNumLights + TILED_CULL_CPU_LIGHT_ALIGN - 1) & ~(TILED_CULL_CPU_LIGHT_ALIGN - 1);
+
+	if (pCull->mPaddedLightCount > pCull->mLightCapacity)
+	{
+		tf_free(pCull->pLightX);
+		tf_free(pCull->pLightY);
+		tf_free(pCull->pLightZ);
+		tf_free(pCull->pLightR);
+
+		const size_t size = pCull->mPaddedLightCount * sizeof(float);
+		pCull->pLightX = (float*)tf_memalign(32, size);
+		pCull->pLightY = (float*)tf_memalign(32, size);
+		pCull->pLightZ = (float*)tf_memalign(32, size);
+		pCull->pLightR = (float*)tf_memalign(32, size);
+		pCull->mLightCapacity = pCull->mPaddedLightCount;
+	}
+
+	const uint32_t tileCount = pCull->mNumTilesX * pCull->mNumTilesY;
+	if (tileCount > pCull->mTileCapacity)
+	{
+		tf_free(pCull->pTiles);
+		pCull->pTiles = (TiledCullCpuTile*)tf_malloc(tileCount * sizeof(TiledCullCpuTile));
+		pCull->mTileCapacity = tileCount;
+	}
+
+	if (pCull->mNumTilesY > pCull->mRowCapacity)
+	{
+		pCull->pRows = (TiledCullCpuRow*)tf_realloc(pCull->pRows, pCull->mNumTilesY * sizeof(TiledCullCpuRow));
+		memset(pCull->pRows + pCull->mRowCapacity, 0, (pCull->mNumTilesY - pCull->mRowCapacity) * sizeof(TiledCullCpuRow));
+		pCull->mRowCapacity = pCull->mNumTilesY;
+	}
+
+	tiledCullCpuDispatch(pCull, tiledCullCpuTransformLights, (pCull->mPaddedLightCount + TILED_CULL_CPU_LIGHT_CHUNK - 1) / TILED_CULL_CPU_LIGHT_CHUNK);
+	tiledCullCpuDispatch(pCull, tiledCullCpuTileRow, pCull->mNumTilesY);
+}
+
+const TiledCullCpuTile* getTiledCullCpuTile(const TiledCullCpu* pCull, uint32_t tileX, uint32_t tileY)
+{
+	return &pCull->pTiles[tileY * pCull->mNumTilesX + tileX];
+}
+
+const uint32_t* getTiledCullCpuTileLights(const TiledCullCpu* pCull, uint32_t tileX, uint32_t tileY, uint32_t bucket, uint32_t* pCount)
+{
+	const TiledCullCpuTile* pTile = getTiledCullCpuTile(pCull, tileX, tileY);
+	*pCount = pTile->mCount[bucket];
+	return pCull->pRows[tileY].pIndices + pTile->mOffset[bucket];
+}
+
+/************************************************************************/
+// Benchmark
+/************************************************************************/
+struct TiledCullCpuBenchmarkDesc
+{
+	uint32_t mWidth;
+	uint32_t mHeight;
+	uint32_t mNumLights;
+	uint32_t mIterations;
+	uint32_t mSeed;
+	float    mLightSpawnBoxScale;
+	mat4     mView;
+	mat4     mProject;
+};
+
+// Synthetic depth: sky on top, receding floor with a row of near pillars, written as reverse Z device depth.
+static void tiledCullCpuGenerateDepth(const TiledCullCpuBenchmarkDesc* pDesc, float* pDepth)
+{
+	const vec4& col2 = pDesc->mProject.getCol(2);
+	const vec4& col3 = pDesc->mProject.getCol(3);
+
+	for (uint32_t y = 0; y < pDesc->mHeight; ++y)
+	{
+		const float v = (float)y / (float)pDesc->mHeight;
+		for (uint32_t x = 0; x < pDesc->mWidth; ++x)
+		{
+			float depth = 0.0f;
+			if (v > 0.15f)
+			{
+				float viewZ = 2.0f + 60.0f * (1.0f - v);
+				if (((x * 10) / pDesc->mWidth) % 3 == 0)
+					viewZ *= 0.25f;
+
+				depth = (col2.getZ() * viewZ + col3.getZ()) / (col2.getW() * viewZ + col3.getW());
+			}
+			pDepth[(size_t)y * pDesc->mWidth + x] = depth;
+		}
+	}
+}
+
+// Same distribution as randomizeLightPosition, but seeded so runs are comparable.
+static void tiledCullCpuGenerateLights(const TiledCullCpuBenchmarkDesc* pDesc, vec4* pLights)
+{
+	std::mt19937 mt(pDesc->mSeed);
+	std::normal_distribution<float> distribution(0.0f, 2.0f);
+	std::uniform_real_distribution<float> radius(0.0f, 3.0f);
+
+	for (uint32_t i = 0; i < pDesc->mNumLights; ++i)
+	{
+		vec3 v(distribution(mt), distribution(mt), distribution(mt));
+		v = v * pDesc->mLightSpawnBoxScale;
+		pLights[i] = vec4(v.getX() + v.getY(), v.getY(), v.getZ(), radius(mt));
+	}
+}
+
+static bool tiledCullCpuCompare(const TiledCullCpu* pA, const TiledCullCpu* pB)
+{
+	if (pA->mNumTilesX != pB->mNumTilesX || pA->mNumTilesY != pB->mNumTilesY)
+		return false;
+
+	for (uint32_t ty = 0; ty < pA->mNumTilesY; ++ty)
+	{
+		for (uint32_t tx = 0; tx < pA->mNumTilesX; ++tx)
+		{
+			for (uint32_t b = 0; b < 2; ++b)
+			{
+				uint32_t countA = 0, countB = 0;
+				const uint32_t* pLightsA = getTiledCullCpuTileLights(pA, tx, ty, b, &countA);
+				const uint32_t* pLightsB = getTiledCullCpuTileLights(pB, tx, ty, b, &countB);
+				if (countA != countB || memcmp(pLightsA, pLightsB, countA * sizeof(uint32_t)) != 0)
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// Runs every mode at every tile size of gTileSizes on synthetic data and reports throughput.
+// pOutStats holds TILE_SIZE_COUNT * TILED_CULL_CPU_MODE_COUNT entries, mode fastest.
+void benchmarkTiledCullCpu(ThreadSystem* pThreadSystem, const TiledCullCpuBenchmarkDesc* pDesc, TiledCullCpuStats* pOutStats)
+{
+	static const char* modeNames[TILED_CULL_CPU_MODE_COUNT] = { "Baseline", "Half-Z", "Modified-Z" };
+
+	float* pDepth = (float*)tf_malloc((size_t)pDesc->mWidth * pDesc->mHeight * sizeof(float));
+	vec4* pLights = (vec4*)tf_memalign(16, pDesc->mNumLights * sizeof(vec4));
+	tiledCullCpuGenerateDepth(pDesc, pDepth);
+	tiledCullCpuGenerateLights(pDesc, pLights);
+
+	TiledCullCpu cull, reference;
+	initTiledCullCpu(pThreadSystem, &cull);
+	initTiledCullCpu(pThreadSystem, &reference);
+
+	TiledCullCpuDesc cullDesc = {};
+	cullDesc.pDepth = pDepth;
+	cullDesc.mWidth = pDesc->mWidth;
+	cullDesc.mHeight = pDesc->mHeight;
+	cullDesc.mView = pDesc->mView;
+	cullDesc.mProjectInv = inverse(pDesc->mProject);
+	cullDesc.pLightPosAndRadius = pLights;
+	cullDesc.mNumLights = pDesc->mNumLights;
+
+	for (uint32_t tileSize = 0; tileSize < TILE_SIZE_COUNT; ++tileSize)
+	{
+		cullDesc.mTileWidth = gTileSizes[tileSize][0];
+		cullDesc.mTileHeight = gTileSizes[tileSize][1];
+
+		for (uint32_t mode = 0; mode < TILED_CULL_CPU_MODE_COUNT; ++mode)
+		{
+			TiledCullCpuStats& stats = pOutStats[tileSize * TILED_CULL_CPU_MODE_COUNT + mode];
+			cullDesc.mMode = mode;
+
+			cullDesc.mScalar = true;
+			runTiledCullCpu(&reference, &cullDesc);
+
+			cullDesc.mScalar = false;
+			runTiledCullCpu(&cull, &cullDesc);
+			stats.mMatchesScalar = tiledCullCpuCompare(&cull, &reference);
+
+			HiresTimer timer;
+			initHiresTimer(&timer);
+			for (uint32_t i = 0; i < pDesc->mIterations; ++i)
+				runTiledCullCpu(&cull, &cullDesc);
+			const double seconds = (double)getHiresTimerUSec(&timer, false) / 1e6 / (double)max(pDesc->mIterations, 1u);
+
+			const double tileCount = (double)cull.mNumTilesX * (double)cull.mNumTilesY;
+			stats.mMilliseconds = seconds * 1e3;
+			stats.mTilesPerSecond = tileCount / seconds;
+			stats.mLightTestsPerSecond = tileCount * (double)pDesc->mNumLights / seconds;
+			stats.mTotalTileLights = 0;
+			for (uint32_t ty = 0; ty < cull.mNumTilesY; ++ty)
+				stats.mTotalTileLights += cull.pRows[ty].mSize;
+
+			LOGF(eINFO, "CPU tile cull %s %s tiles: %ux%u, %u lights, %.3f ms, %.2f Mtiles/s, %.2f Glight-tests/s, %llu tile-lights, SIMD %s scalar",
+				modeNames[mode], gTileSizeNames[tileSize], pDesc->mWidth, pDesc->mHeight, pDesc->mNumLights, stats.mMilliseconds, stats.mTilesPerSecond / 1e6,
+				stats.mLightTestsPerSecond / 1e9, (unsigned long long)stats.mTotalTileLights, stats.mMatchesScalar ? "matches" : "DIFFERS from");
+		}
+	}
+
+	exitTiledCullCpu(&reference);
+	exitTiledCullCpu(&cull);
+	tf_free(pLights);
+	tf_free(pDepth);
+}
+
+#endif // !TILEDCULLCPU_H